@@ -1,9 +1,12 @@
+#include <stddef.h>
 #include <string.h>
 
 /* contiki */
 #include "contiki.h"
 #include "contiki-net.h"
+#include "lib/random.h"
 #include "net/rpl/rpl.h"
+#include "net/rpl/rpl-private.h" /* dis_output() */
 
 /* coap */
 #if WITH_COAP == 3
@@ -23,26 +26,22 @@
 /* th-12 */
 #include "th-12.h"
 #include "dht.h"
+#include "msgbuf.h"
+#include "senml.h"
+#include "platform_stats.h"
+#include "rtt.h"
+#include "readlog.h"
+#include "recstore.h"
+#include "kvparse.h"
+#include "slot.h"
+#include "post-cycle.h"
+#include "th12-post.h"
+#include "energy.h"
+#include "prof.h"
+#if TH12MAC
+#include "th12mac.h"
+#endif
 
-/* default POST location */
-/* hostname for the sink */
-#define DEFAULT_SINK_NAME "coap-8.lowpan.com" 
-/* path to post to */
-#define DEFAULT_SINK_PATH "/sink"
-
-/* with 2 min post interval, sink checks every 4th wake, and up to 3 sink failures before reboot */
-/* node should recover with in 8 min. Worst case would be 24min and triggering a reboot */ 
-
-/* how long to wait between posts */
-#define DEFAULT_POST_INTERVAL 300
-/* stay awake for this long on power up */
-#define DEFAULT_WAKE_TIME 120
-/* perform a sink check this number of wake cycles */
-#define DEFAULT_POSTS_PER_CHECK 256
-/* after SINK_CHECK_TRIES of sink check failures, the node will reboot itself */
-#define DEFAULT_MAX_POST_FAILS 1
-/* whether or not the sensor is allowed to sleep */
-#define DEFAULT_SLEEP_ALLOWED 1
 
 /* MAX len for paths and hostnames */
 #define SINK_MAXLEN 31
@@ -53,12 +52,20 @@
 /* the final voltage */
 #define BATTERY_DELAY (100 * CLOCK_SECOND)
 
-/* try to reread the sensor this many times if it reports a bad checksum before giving up */
-#define SENSOR_RETRIES 3
+/* sensor rereads after a bad checksum, up to SENSOR_RETRIES */
 static uint8_t sensor_tries;
 
-/* how far in the future to schedule the retry. Should be short */
-#define RETRY_INTERVAL (0.05 * CLOCK_SECOND)
+/* the dht needs to warm up after being powered on. The datasheet says 2 sec */
+/* but most sensors are ready sooner. The first sleepy wake probes from */
+/* DHT_WARMUP_MIN in DHT_WARMUP_STEP increments and the time of the first */
+/* clean read, plus a margin, is used for the following wakes */
+#define DHT_WARMUP_MAX (2 * CLOCK_SECOND)
+#define DHT_WARMUP_MIN (0.5 * CLOCK_SECOND)
+#define DHT_WARMUP_STEP (0.25 * CLOCK_SECOND)
+#define DHT_WARMUP_MARGIN (0.1 * CLOCK_SECOND)
+static clock_time_t dht_warmup = DHT_WARMUP_MAX;
+static uint8_t warmup_measured = 0;
+static uint8_t warmup_probing = 0;
 
 /* How long to wait before sleeping after starting the coap post */
 /* will also sleep if a response to the post is recieved */
@@ -67,10 +74,13 @@ static uint8_t sensor_tries;
 
 /* give up waiting for a dag after DAG_TIMEOUT */
 #define DAG_TIMEOUT (DEFAULT_WAKE_TIME * CLOCK_SECOND)
+/* RPL doesn't signal when it joins, check this often */
+#define DAG_POLL_INTERVAL (0.25 * CLOCK_SECOND)
 
 /* debug */
 #define DEBUG DEBUG_FULL
 #include "net/uip-debug.h"
+#include "tlog.h"
 
 #define REMOTE_PORT     UIP_HTONS(COAP_DEFAULT_PORT)
 
@@ -79,7 +89,7 @@ AUTOSTART_PROCESSES(&th_12, &resolv_process);
 
 static void set_sleep_ok(void *ptr);
 static struct ctimer ct_powerwake;
-struct etimer et_do_dht, et_poweron_timeout;
+struct etimer et_do_dht, et_poweron_timeout, et_warmup;
 static dht_result_t dht_current;
 
 /* sink state */
@@ -88,8 +98,6 @@ static uint8_t sink_ok = 0;
 static int8_t resolv_ok = 0;
 /* number of wakes */
 static uint8_t wakes = 0;
-/* number of failed checks */
-static uint8_t sink_checks_failed = 0;
 
 /* flag tracks if this is the first post */
 static uint8_t first_post = 1;
@@ -110,6 +118,14 @@ static struct ctimer ct_report_batt;
 /* time the next post is scheduled for: used to calculate how long to sleep */
 static clock_time_t next_post;
 
+/* posts go out in a slot of the interval picked by the EUI-64 */
+/* the first post after power up is spread the same way so a fleet doesn't boot in lockstep */
+/* when a post collides the slot moves to where its retransmission got through */
+static uint32_t slot_id;
+/* sink time - clock_seconds(), 0 until the sink sends its time */
+static int32_t slot_epoch = 0;
+static void slot_shift(clock_time_t delay);
+
 /* used to go to sleep */
 static struct ctimer ct_sleep;
 
@@ -119,18 +135,65 @@ static uint8_t con_ok;
 /* track if we are doing a sensor retry or not */
 static uint8_t retry = 0;
 
+/* a sink check was started early in this wake */
+static uint8_t con_pending = 0;
+
 /* other things we need */
 static rpl_dag_t *dag;
-static process_event_t ev_resolv_failed;
+static process_event_t ev_resolv_done;
 static process_event_t ev_post_con_started, ev_post_complete;
+static process_event_t ev_warmup_probe;
+
+/* readings waiting to be posted */
+/* a ring: when it is full the oldest reading is dropped */
+typedef struct {
+  clock_time_t time; /* when the reading was taken */
+  int16_t t;
+  uint16_t rh;
+} sample_t;
+static sample_t batch[BATCH_MAX];
+static uint8_t batch_head, batch_count;
+/* the readings in the post being sent, logged if it doesn't get through */
+static sample_t inflight[BATCH_MAX];
+static uint8_t inflight_count = 0;
+
+/* the radio is off after a sleep until something needs it */
+static uint8_t radio_awake = 1;
+
+/* posts that went out, cycle.suppressed counts the ones the deadband dropped */
+static uint16_t posts_sent;
+/* NON posts that weren't ACKed by the parent */
+static uint16_t posts_noack;
+
+/* link-layer ACK tracking for NON posts */
+static uint8_t tx_watch = 0, tx_failed;
+/* do_post is sending the same post again */
+static uint8_t post_resend = 0;
+
+/* rto estimate for the sink, kept across sleeps */
+/* reset when the sink address changes */
+static struct rtt sink_rtt;
+static uip_ipaddr_t rtt_addr;
+/* the CON in flight */
+static coap_transaction_t *con_t = NULL;
+static clock_time_t con_sent;
+static uint8_t con_tries, con_done;
 
 
 /* flash config */
 /* MAX len for paths and hostnames */
 #define SINK_MAXLEN 31
 
-#define TH12_CONFIG_PAGE 0x1D000 /* nvm page where conf will be stored */
-#define TH12_CONFIG_VERSION 1
+/* the config and the state page are records in the record store */
+/* they used to have an nvm page each, TH12_LEGACY_*_PAGE in th12-flash.h, */
+/* those are read once to migrate */
+#define TH12_CONFIG_KEY 0
+#define TH12_STATE_KEY 1
+/* no formatted record store was found at boot */
+static uint8_t th12_legacy = 0;
+
+/* fields are only ever added at the end, and the version goes up with each addition */
+#define TH12_CONFIG_VERSION 5
 #define TH12_CONFIG_MAGIC 0x5448
 
 /* th12 config */
@@ -141,11 +204,17 @@ typedef struct {
   uint8_t sink_path[SINK_MAXLEN + 1]; /* path to post to */
   uint16_t post_interval; /* how long to wait between posts */
   uint16_t wake_time; /* stay awake for this long on power up */
-  uint16_t posts_per_check; /* perform a sink check this number of wake cycles */
+  uint16_t posts_per_check; /* at most this many wake cycles between sink checks */
   uint16_t sleep_allowed; /* whether or not the sensor is allowed to sleep */
   uint16_t max_post_fails; /* after SINK_CHECK_TRIES of sink check failures, the node will reboot itself */
 /* sink's ip address */
   uip_ipaddr_t sink_addr;
+  uint16_t payload_format; /* FORMAT_JSON or FORMAT_SENML_CBOR */
+  uint16_t batch_size; /* readings per post, one reading is taken every post_interval */
+  uint16_t deadband_t; /* 0.1C, 0 to ignore temperature */
+  uint16_t deadband_rh; /* 0.1%, 0 to ignore humidity */
+  uint16_t heartbeat; /* max seconds between posts when in the deadband */
+  uint32_t sink_ttl; /* seconds before the cached sink address is re-resolved */
 } TH12Config;
 
 static TH12Config th12_cfg;
@@ -162,38 +231,77 @@ th12_config_set_default(TH12Config *c)
   c->posts_per_check = DEFAULT_POSTS_PER_CHECK;
   c->sleep_allowed = DEFAULT_SLEEP_ALLOWED;
   c->max_post_fails = DEFAULT_MAX_POST_FAILS;
+  c->payload_format = DEFAULT_PAYLOAD_FORMAT;
+  c->batch_size = DEFAULT_BATCH_SIZE;
+  c->deadband_t = DEFAULT_DEADBAND_T;
+  c->deadband_rh = DEFAULT_DEADBAND_RH;
+  c->heartbeat = DEFAULT_HEARTBEAT;
+  c->sink_ttl = DEFAULT_SINK_TTL;
 }
 
+/* size of each config version, for the old config page which doesn't store a length */
+static const uint16_t th12_config_size[TH12_CONFIG_VERSION + 1] = {
+  0,
+  offsetof(TH12Config, payload_format),
+  offsetof(TH12Config, batch_size),
+  offsetof(TH12Config, deadband_t),
+  offsetof(TH12Config, sink_ttl),
+  sizeof(TH12Config),
+};
+
+/* compile time check: the config has to fit in a record */
+typedef char th12_config_fits[(sizeof(TH12Config) <= RECSTORE_MAX) ? 1 : -1];
+
 /* write out config to flash */
+/* appends a record, there's only an erase when the store switches pages */
 void th12_config_save(TH12Config *c) {
-	nvmErr_t err;
-	err = nvm_erase(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype, 1 << TH12_CONFIG_PAGE/4096);
-	err = nvm_write(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype, (uint8_t *)c, TH12_CONFIG_PAGE, sizeof(TH12Config));
+	recstore_write(TH12_CONFIG_KEY, c, sizeof(TH12Config));
+}
+
+/* fill c from a stored config of len bytes */
+/* fields newer than the stored version get their defaults */
+static int
+th12_config_migrate(TH12Config *c, TH12Config *old, uint16_t len)
+{
+	if (len < th12_config_size[1] || old->magic != TH12_CONFIG_MAGIC || old->version == 0) {
+		PRINTF("th12 config bad magic %04x\n\r", old->magic);
+		return 0;
+	}
+	if (old->version != TH12_CONFIG_VERSION) {
+		PRINTF("th12 config: migrating version %d\n\r", old->version);
+	}
+	th12_config_set_default(c);
+	memcpy(c, old, len);
+	c->version = TH12_CONFIG_VERSION;
+	return 1;
 }
 
 /* load the config from flash to the pass conf structure */
-void th12_config_restore(TH12Config *c) {
-	nvmErr_t err;
+/* returns 0 if there is no config */
+int th12_config_restore(TH12Config *c) {
 	nvmType_t type;
+	TH12Config old;
+	int len;
+
 	if (mc1322x_config.flags.nvmtype == 0) { 
 	  nvm_detect(gNvmInternalInterface_c, &type); 
 	  mc1322x_config.flags.nvmtype = type;
 	}
-	err = nvm_read(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype, c, TH12_CONFIG_PAGE, sizeof(TH12Config));
-}
 
-/* check the flash for magic number and proper version */
-int th12_config_valid(TH12Config *c) {
-	if (c->magic == TH12_CONFIG_MAGIC &&
-	    c->version == TH12_CONFIG_VERSION) {
-		return 1;
+	if (recstore_init()) {
+	  len = recstore_read(TH12_CONFIG_KEY, &old, sizeof(TH12Config));
+	  if (len > (int)sizeof(TH12Config)) {
+	    len = sizeof(TH12Config);
+	  }
 	} else {
-#if DEBUG
-		if (c->magic != TH12_CONFIG_MAGIC) { PRINTF("th12 config bad magic %04x\n\r", c->magic); }
-		if (c->version != TH12_CONFIG_MAGIC) { PRINTF("th12 config bad version %04x\n\r", c->version); }
-#endif
-		return 0;
+	  th12_legacy = 1;
+	  nvm_read(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype, &old, TH12_LEGACY_CONFIG_PAGE, sizeof(TH12Config));
+	  len = (old.version <= TH12_CONFIG_VERSION) ? th12_config_size[old.version] : sizeof(TH12Config);
+	}
+	if (len <= 0) {
+	  return 0;
 	}
+	return th12_config_migrate(c, &old, len);
 }
 
 void th12_config_print(void) {
@@ -207,35 +315,485 @@ void th12_config_print(void) {
 	PRINTF("  posts per check: %d\n\r",   th12_cfg.posts_per_check);
 	PRINTF("  max post fails: %d\n\r",   th12_cfg.max_post_fails);
 	PRINTF("  sleep allowed: %d\n\r",   th12_cfg.sleep_allowed);
+	PRINTF("  payload format: %d\n\r",   th12_cfg.payload_format);
+	PRINTF("  batch size: %d\n\r",   th12_cfg.batch_size);
+	PRINTF("  deadband: %d %d\n\r",   th12_cfg.deadband_t, th12_cfg.deadband_rh);
+	PRINTF("  heartbeat: %d\n\r",   th12_cfg.heartbeat);
+	PRINTF("  sink ttl: %lu\n\r",   (unsigned long)th12_cfg.sink_ttl);
 	PRINTF("  ip addr: ");
 	PRINT6ADDR(&th12_cfg.sink_addr);
 	PRINTF("\n\r");	
 }
 
-int
-ipaddr_sprint(char *s, const uip_ipaddr_t *addr)
+/* state */
+/* things learned at run time that make a wake or a reboot faster: the */
+/* resolved sink address and the RPL parent. It's only written when they change */
+/* new fields go at the end, like the config */
+#define TH12_STATE_VERSION 1
+#define TH12_STATE_MAGIC 0x5353
+
+typedef struct {
+  uint16_t magic;
+  uint16_t version;
+  /* sink address cache, sink_name is what addr was resolved from */
+  uint8_t sink_name[SINK_MAXLEN + 1];
+  uip_ipaddr_t sink_addr;
+  /* the DAG we were last in, has_dag is 0 if none was saved */
+  uint8_t has_dag;
+  uint8_t channel; /* the DAG is only good on this channel */
+  uint8_t instance_id;
+  uint8_t prefix_len;
+  uip_ipaddr_t dag_id;
+  uip_ipaddr_t prefix;
+  uip_ipaddr_t parent;
+  uip_lladdr_t parent_lladdr;
+  uint16_t rank;
+} TH12State;
+
+static TH12State th12_state;
+
+typedef char th12_state_fits[(sizeof(TH12State) <= RECSTORE_MAX) ? 1 : -1];
+
+void th12_state_save(TH12State *c) {
+	recstore_write(TH12_STATE_KEY, c, sizeof(TH12State));
+}
+
+/* call after th12_config_restore(), which finds the record store */
+void th12_state_restore(TH12State *c) {
+	TH12State old;
+	int len;
+
+	if (th12_legacy) {
+	  nvm_read(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype, &old, TH12_LEGACY_STATE_PAGE, sizeof(TH12State));
+	  len = sizeof(TH12State);
+	} else {
+	  len = recstore_read(TH12_STATE_KEY, &old, sizeof(TH12State));
+	}
+
+	memset(c, 0, sizeof(TH12State));
+	if (len > 0 && old.magic == TH12_STATE_MAGIC) {
+	  if (len > (int)sizeof(TH12State)) {
+	    len = sizeof(TH12State);
+	  }
+	  memcpy(c, &old, len);
+	}
+	c->magic = TH12_STATE_MAGIC;
+	c->version = TH12_STATE_VERSION;
+}
+
+/* sink address cache */
+/* sink checks and reboots use the cached address and don't have to wait for DNS */
+
+/* clock_seconds() of the last resolv or post that confirmed the cached address */
+/* an entry restored from flash was confirmed before this boot so it starts stale */
+static unsigned long sink_cache_ok;
+static uint8_t sink_cache_fresh = 0;
+
+/* the cache holds an address for the current sink name */
+static uint8_t
+sink_cache_valid(void)
+{
+	return th12_state.sink_name[0] != 0 &&
+		strncmp((char *)th12_state.sink_name, (char *)th12_cfg.sink_name, SINK_MAXLEN) == 0;
+}
+
+/* the cached address is valid and was confirmed within the ttl */
+static uint8_t
+sink_cache_current(void)
+{
+	return sink_cache_valid() && sink_cache_fresh &&
+		(clock_seconds() - sink_cache_ok) < th12_cfg.sink_ttl;
+}
+
+/* a resolv or a post confirmed addr */
+static void
+sink_cache_update(uip_ipaddr_t *addr)
+{
+	sink_cache_ok = clock_seconds();
+	sink_cache_fresh = 1;
+	if (sink_cache_valid() && uip_ipaddr_cmp(&th12_state.sink_addr, addr)) {
+		return;
+	}
+	PRINTF("sink cache: saving new address\n\r");
+	strncpy((char *)th12_state.sink_name, (char *)th12_cfg.sink_name, SINK_MAXLEN + 1);
+	uip_ipaddr_copy(&th12_state.sink_addr, addr);
+	th12_state_save(&th12_state);
+}
+
+/* a post to the cached address failed, resolve again before the next one */
+static void
+sink_cache_invalidate(void)
+{
+	if (th12_state.sink_name[0] == 0) {
+		return;
+	}
+	PRINTF("sink cache: invalidated\n\r");
+	th12_state.sink_name[0] = 0;
+	sink_cache_fresh = 0;
+	th12_state_save(&th12_state);
+}
+
+/* fast rpl rejoin */
+/* after a reboot the saved parent gets a unicast DIS and is used as the */
+/* default route right away, so the first post doesn't wait for discovery. */
+/* The parent's DIO joins the DAG as usual and RPL sends the DAO. If it */
+/* doesn't answer within REJOIN_TIMEOUT the node goes back to normal discovery */
+#define REJOIN_TIMEOUT (2 * CLOCK_SECOND)
+/* seconds, RPL replaces this with its own default route when it joins */
+#define REJOIN_DEFRT_LIFETIME 60
+static struct ctimer ct_rejoin;
+
+/* save the DAG and parent if they changed */
+/* rank changes alone aren't worth a flash write */
+static void
+rpl_state_update(void)
+{
+	rpl_dag_t *d = rpl_get_any_dag();
+	uip_ds6_nbr_t *nbr;
+
+	if (d == NULL || d->preferred_parent == NULL) {
+		return;
+	}
+	nbr = uip_ds6_nbr_lookup(&d->preferred_parent->addr);
+	if (nbr == NULL) {
+		return;
+	}
+	if (th12_state.has_dag &&
+	    th12_state.channel == mc1322x_config.channel &&
+	    uip_ipaddr_cmp(&th12_state.dag_id, &d->dag_id) &&
+	    uip_ipaddr_cmp(&th12_state.parent, &d->preferred_parent->addr)) {
+		return;
+	}
+
+	PRINTF("saving rpl parent ");
+	PRINT6ADDR(&d->preferred_parent->addr);
+	PRINTF("\n\r");
+	th12_state.has_dag = 1;
+	th12_state.channel = mc1322x_config.channel;
+	th12_state.instance_id = d->instance->instance_id;
+	th12_state.prefix_len = d->prefix_info.length;
+	uip_ipaddr_copy(&th12_state.dag_id, &d->dag_id);
+	uip_ipaddr_copy(&th12_state.prefix, &d->prefix_info.prefix);
+	uip_ipaddr_copy(&th12_state.parent, &d->preferred_parent->addr);
+	memcpy(&th12_state.parent_lladdr, &nbr->lladdr, sizeof(uip_lladdr_t));
+	th12_state.rank = d->rank;
+	th12_state_save(&th12_state);
+}
+
+/* the global address the saved prefix gives us */
+static void
+rpl_state_addr(uip_ipaddr_t *ipaddr)
+{
+	uip_ipaddr_copy(ipaddr, &th12_state.prefix);
+	uip_ds6_set_addr_iid(ipaddr, &uip_lladdr);
+}
+
+static void
+rpl_rejoin_check(void *ptr)
+{
+	uip_ds6_defrt_t *rt;
+	uip_ds6_addr_t *a;
+	uip_ipaddr_t ipaddr;
+
+	if (rpl_get_any_dag() != NULL) {
+		PRINTF("rejoined DAG\n\r");
+		return;
+	}
+
+	PRINTF("saved parent didn't answer, back to discovery\n\r");
+	rt = uip_ds6_defrt_lookup(&th12_state.parent);
+	if (rt != NULL) {
+		uip_ds6_defrt_rm(rt);
+	}
+	rpl_state_addr(&ipaddr);
+	a = uip_ds6_addr_lookup(&ipaddr);
+	if (a != NULL) {
+		uip_ds6_addr_rm(a);
+	}
+	dis_output(NULL);
+}
+
+/* called at boot, returns 1 if there was a parent to rejoin through */
+static uint8_t
+rpl_rejoin_start(void)
+{
+	uip_ipaddr_t ipaddr;
+
+	/* a channel change means a different network */
+	if (!th12_state.has_dag || th12_state.channel != mc1322x_config.channel) {
+		return 0;
+	}
+
+	PRINTF("rejoining through ");
+	PRINT6ADDR(&th12_state.parent);
+	PRINTF(" rank %u\n\r", th12_state.rank);
+
+	rpl_state_addr(&ipaddr);
+	uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+	/* skip neighbor discovery for the parent */
+	uip_ds6_nbr_add(&th12_state.parent, &th12_state.parent_lladdr, 1, NBR_REACHABLE);
+	uip_ds6_defrt_add(&th12_state.parent, REJOIN_DEFRT_LIFETIME);
+	dis_output(&th12_state.parent);
+	ctimer_set(&ct_rejoin, REJOIN_TIMEOUT, rpl_rejoin_check, NULL);
+	return 1;
+}
+
+/* sink check scheduling, report by exception and what follows a post */
+/* are decided in post-cycle.c, which tools/sim/fleetsim.c runs too */
+static struct post_cycle cycle;
+
+/* the post cycle's copy of the config */
+static void
+cycle_config(void)
+{
+  cycle.cfg.posts_per_check = th12_cfg.posts_per_check;
+  cycle.cfg.max_post_fails = th12_cfg.max_post_fails;
+  cycle.cfg.batch_size = th12_cfg.batch_size;
+  cycle.cfg.deadband_t = th12_cfg.deadband_t;
+  cycle.cfg.deadband_rh = th12_cfg.deadband_rh;
+  cycle.cfg.heartbeat = th12_cfg.heartbeat;
+}
+
+/* print an ipv6 address with the longest run of zeros as :: */
+void
+ipaddr_put(struct msgbuf *m, const uip_ipaddr_t *addr)
 {
   uint16_t a;
   unsigned int i;
   int f;
-  int n;
-  n = 0;
   for(i = 0, f = 0; i < sizeof(uip_ipaddr_t); i += 2) {
     a = (addr->u8[i] << 8) + addr->u8[i + 1];
     if(a == 0 && f >= 0) {
       if(f++ == 0) {
-	n += sprintf(&s[n], "::");
+	msgbuf_puts(m, "::");
       }
     } else {
       if(f > 0) {
         f = -1;
       } else if(i > 0) {
-	n += sprintf(&s[n], ":");
+	msgbuf_putc(m, ':');
       }
-      n += sprintf(&s[n], "%x", a); 
+      msgbuf_put_hex16(m, a);
+    }
+  }
+}
+
+/* config parameters, set one at a time with ?param=name and the value as the body */
+/* or several at once as a JSON object or CBOR map: {"netloc":"sink.local","interval":300} */
+/* a batch is checked as a whole, committed to flash once and its side effects run once */
+/* a side effect only runs if its parameter changed, so sending the same values again is harmless */
+enum { P_U16, P_U32, P_STR, P_IP, P_CHANNEL };
+
+/* side effects of a change */
+#define FX_SCHEDULE 0x01     /* post with the new interval */
+#define FX_WAKE     0x02     /* restart the wake timer */
+#define FX_SINK     0x04     /* resolve and check the sink again */
+#define FX_CHANNEL  0x08     /* save the channel and reboot */
+
+struct param {
+  const char *name;
+  uint8_t type;
+  uint8_t effect;
+  uint16_t offset;           /* in TH12Config */
+  uint32_t min, max;         /* allowed values, or the longest string */
+};
+
+#define PARAM(name, type, field, effect, min, max) \
+  { name, type, effect, offsetof(TH12Config, field), min, max }
+
+static const struct param params[] = {
+  PARAM("interval", P_U16, post_interval, FX_SCHEDULE, 1, 0xffff),
+  PARAM("wake_time", P_U16, wake_time, FX_WAKE, 0, 0xffff),
+  PARAM("posts_per_check", P_U16, posts_per_check, 0, 1, 0xffff),
+  PARAM("max_post_fails", P_U16, max_post_fails, 0, 1, 0xffff),
+  PARAM("sleep_allowed", P_U16, sleep_allowed, 0, 0, 1),
+  PARAM("format", P_U16, payload_format, 0, 0, 1),
+  PARAM("batch_size", P_U16, batch_size, 0, 1, BATCH_MAX),
+  PARAM("deadband_t", P_U16, deadband_t, 0, 0, 0xffff),
+  PARAM("deadband_rh", P_U16, deadband_rh, 0, 0, 0xffff),
+  PARAM("heartbeat", P_U16, heartbeat, 0, 0, 0xffff),
+  PARAM("sink_ttl", P_U32, sink_ttl, 0, 0, 0xffffffff),
+  PARAM("netloc", P_STR, sink_name, FX_SINK, 0, SINK_MAXLEN),
+  PARAM("path", P_STR, sink_path, FX_SINK, 0, SINK_MAXLEN),
+  PARAM("ip", P_IP, sink_addr, FX_SINK, 0, 0),
+  { "channel", P_CHANNEL, FX_CHANNEL, 0, 11, 26 },
+};
+#define NPARAMS (sizeof(params) / sizeof(params[0]))
+
+/* the new config while a request is checked */
+struct config_txn {
+  TH12Config cfg;
+  uint8_t channel;           /* as in mc1322x_config, 0 is channel 11 */
+  const char *bad;           /* the key that was rejected */
+  uint8_t bad_len;
+};
+static struct config_txn txn;
+
+static const struct param *
+param_find(const char *name, size_t len)
+{
+  uint8_t i;
+  for(i = 0; i < NPARAMS; i++) {
+    if(strlen(params[i].name) == len && strncmp(params[i].name, name, len) == 0) {
+      return &params[i];
+    }
+  }
+  return NULL;
+}
+
+/* check value and put it in the transaction, -1 if it isn't valid */
+static int
+param_set(struct config_txn *t, const struct param *p, const char *value)
+{
+  uint8_t *field = (uint8_t *)&t->cfg + p->offset;
+  uip_ipaddr_t addr;
+  char *end;
+  uint32_t v;
+
+  switch(p->type) {
+  case P_STR:
+    if(strlen(value) > p->max) {
+      return -1;
     }
+    memset(field, 0, SINK_MAXLEN + 1);
+    memcpy(field, value, strlen(value));
+    break;
+  case P_IP:
+    if(!uiplib_ipaddrconv(value, &addr)) {
+      return -1;
+    }
+    memcpy(field, &addr, sizeof(uip_ipaddr_t));
+    break;
+  default:
+    if(*value < '0' || *value > '9') {
+      return -1;
+    }
+    v = strtoul(value, &end, 10);
+    if(*end != 0 || v < p->min || v > p->max) {
+      return -1;
+    }
+    if(p->type == P_CHANNEL) {
+      t->channel = v - 11;
+    } else if(p->type == P_U32) {
+      *(uint32_t *)field = v;
+    } else {
+      *(uint16_t *)field = v;
+    }
+  }
+  return 0;
+}
+
+static void
+config_begin(struct config_txn *t)
+{
+  t->cfg = th12_cfg;
+  t->channel = mc1322x_config.channel;
+  t->bad = NULL;
+}
+
+/* non-zero if the transaction changes the parameter */
+static int
+param_changed(struct config_txn *t, const struct param *p)
+{
+  size_t size;
+
+  switch(p->type) {
+  case P_CHANNEL:
+    return t->channel != mc1322x_config.channel;
+  case P_STR:
+    size = SINK_MAXLEN + 1;
+    break;
+  case P_IP:
+    size = sizeof(uip_ipaddr_t);
+    break;
+  case P_U32:
+    size = sizeof(uint32_t);
+    break;
+  default:
+    size = sizeof(uint16_t);
+  }
+  return memcmp((uint8_t *)&t->cfg + p->offset, (uint8_t *)&th12_cfg + p->offset, size) != 0;
+}
+
+static int
+config_pair(const char *key, uint8_t key_len, const char *value, void *ctx)
+{
+  struct config_txn *t = ctx;
+  const struct param *p = param_find(key, key_len);
+
+  if(p == NULL || param_set(t, p, value) < 0) {
+    t->bad = key;
+    t->bad_len = key_len;
+    return 1;
+  }
+  return 0;
+}
+
+/* save a checked transaction and run its side effects */
+static void
+config_commit(struct config_txn *t)
+{
+  uint8_t effects = 0;
+  uint8_t i;
+
+  for(i = 0; i < NPARAMS; i++) {
+    if(param_changed(t, &params[i])) {
+      effects |= params[i].effect;
+    }
+  }
+  if(memcmp(&th12_cfg, &t->cfg, sizeof(TH12Config)) != 0) {
+    th12_cfg = t->cfg;
+    th12_config_save(&th12_cfg);
+    cycle_config();
+  }
+  if(effects & FX_SCHEDULE) {
+    /* send a post_complete event to schedule a post with the new interval */
+    process_post(&th_12, ev_post_complete, NULL);
+  }
+  if(effects & FX_WAKE) {
+    ctimer_set(&ct_powerwake, th12_cfg.wake_time * CLOCK_SECOND, set_sleep_ok, NULL);
+  }
+  if(effects & FX_SINK) {
+    PRINT6ADDR(&th12_cfg.sink_addr);
+    sink_ok = 0; resolv_ok = 0; wakes = 0; cycle.con_interval = 1;
+    process_start(&read_dht, NULL);
+  }
+  if(effects & FX_CHANNEL) {
+    mc1322x_config.channel = t->channel;
+    set_channel(mc1322x_config.channel);
+    mc1322x_config_save(&mc1322x_config);
+    readlog_flush();
+    CRM->SW_RST = 0x87651234;
+    while (1) { continue; }
+  }
+}
+
+/* the value of a parameter, strings and addresses quoted if json is set */
+static void
+param_put(struct msgbuf *m, const struct param *p, int json)
+{
+  const uint8_t *field = (const uint8_t *)&th12_cfg + p->offset;
+
+  switch(p->type) {
+  case P_STR:
+  case P_IP:
+    if(json) { msgbuf_putc(m, '"'); }
+    if(p->type == P_STR) {
+      msgbuf_puts(m, (const char *)field);
+    } else {
+      ipaddr_put(m, (const uip_ipaddr_t *)field);
+    }
+    if(json) { msgbuf_putc(m, '"'); }
+    break;
+  case P_CHANNEL:
+    msgbuf_put_uint(m, mc1322x_config.channel + 11);
+    break;
+  case P_U32:
+    msgbuf_put_uint(m, *(const uint32_t *)field);
+    break;
+  default:
+    msgbuf_put_uint(m, *(const uint16_t *)field);
   }
-  return n;
 }
 
 RESOURCE(config, METHOD_GET | METHOD_POST , "config", "title=\"Config parameters\";rt=\"Data\"");
@@ -243,153 +801,385 @@ RESOURCE(config, METHOD_GET | METHOD_POST , "config", "title=\"Config parameters
 void
 config_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
-  void *param;
-  uip_ipaddr_t *new_addr;
+  const struct param *p = NULL;
+  const uint8_t *payload;
+  char value[KV_VALUE_MAX];
   const char *pstr;
   size_t len = 0;
+  struct msgbuf m;
+  uint8_t i;
 
   /* refresh the wake timer */
   ctimer_set(&ct_powerwake, th12_cfg.wake_time * CLOCK_SECOND, set_sleep_ok, NULL);
-  
-  if ((len = REST.get_query_variable(request, "param", &pstr))) {
-    if (strncmp(pstr, "interval", len) == 0) {
-      param = &th12_cfg.post_interval;
-    } else if(strncmp(pstr, "wake_time", len) == 0) {
-      param = &th12_cfg.wake_time;
-    } else if(strncmp(pstr, "posts_per_check", len) == 0) {
-      param = &th12_cfg.posts_per_check;
-    } else if(strncmp(pstr, "max_post_fails", len) == 0) {
-      param = &th12_cfg.max_post_fails;
-    } else if(strncmp(pstr, "sleep_allowed", len) == 0) {
-      param = &th12_cfg.sleep_allowed;
-    } else if(strncmp(pstr, "channel", len) == 0) {
-      param = &mc1322x_config.channel;
-    } else if (strncmp(pstr, "netloc", len) == 0) {
-      param = th12_cfg.sink_name;
-    } else if(strncmp(pstr, "path", len) == 0) {
-      param = th12_cfg.sink_path;
-    } else if(strncmp(pstr, "ip", len) == 0) {
-      new_addr = &th12_cfg.sink_addr;
-    } else {
+  txn.bad = NULL;
+
+  if((len = REST.get_query_variable(request, "param", &pstr))) {
+    if((p = param_find(pstr, len)) == NULL) {
       goto bad;
     }
-  } else {
-    goto bad;
   }
 
   if (REST.get_method_type(request) == METHOD_POST) {
-    const uint8_t *new;
-    REST.get_request_payload(request, &new);
-    if(strncmp(pstr, "channel", len) == 0) {
-      *(uint8_t *)param = (uint8_t)atoi(new) - 11;
-    } else if ( (strncmp(pstr, "netloc", len) == 0) || 
-		(strncmp(pstr, "path", len) == 0) ) {
-      strncpy(param, new, SINK_MAXLEN);
-    } else if(strncmp(pstr, "ip", len) == 0) {
-      uiplib_ipaddrconv(new, new_addr);
-      PRINT6ADDR(new_addr);      
-    }  else {
-      *(uint16_t *)param = (uint16_t)atoi(new);
-    }
-    th12_config_save(&th12_cfg);
-    
-    /* do clean-up actions */
-    if (strncmp(pstr, "interval", len) == 0) {
-      /* send a post_complete event to schedule a post with the new interval */
-      process_post(&th_12, ev_post_complete, NULL);
-    } else if(strncmp(pstr, "wake_time", len) == 0) {
-      ctimer_set(&ct_powerwake, th12_cfg.wake_time * CLOCK_SECOND, set_sleep_ok, NULL);
-    } else if ( (strncmp(pstr, "netloc", len) == 0) || 
-		(strncmp(pstr, "path", len) == 0)  ||
-		(strncmp(pstr, "ip", len) == 0) ) {
-      sink_ok = 0; resolv_ok = 0; wakes = 0;
-      process_start(&read_dht, NULL);
-    } else if(strncmp(pstr, "channel", len) == 0) {
-      set_channel(mc1322x_config.channel);
-      mc1322x_config_save(&mc1322x_config);
-      CRM->SW_RST = 0x87651234;
-      while (1) { continue; }
+    len = REST.get_request_payload(request, &payload);
+    config_begin(&txn);
+    if(p != NULL) {
+      /* a single parameter with the plain value as the body */
+      if(len >= KV_VALUE_MAX) {
+        goto bad;
+      }
+      memcpy(value, payload, len);
+      value[len] = 0;
+      if(param_set(&txn, p, value) < 0) {
+        goto bad;
+      }
+    } else if(kv_parse(payload, len, config_pair, &txn) != 0) {
+      goto bad;
     }
+    config_commit(&txn);
+    REST.set_response_status(response, REST.status.CHANGED);
 
   } else { /* GET */
-    uint8_t n;
-    if (strncmp(pstr, "channel", len) == 0) {
-      n = sprintf(buffer, "%d", *(uint8_t *)param + 11);
-    } else if ( (strncmp(pstr, "netloc", len) == 0) || 
-		(strncmp(pstr, "path", len) == 0) ) {
-      strncpy(buffer, param, SINK_MAXLEN);
-      REST.set_response_payload(response, buffer, strlen(param));
-    } else if ( (strncmp(pstr, "ip", len) == 0)) {
-      n = ipaddr_sprint(buffer, &th12_cfg.sink_addr);
+    msgbuf_init(&m, (char *)buffer, preferred_size);
+    if(p != NULL) {
+      param_put(&m, p, 0);
     } else {
-      n = sprintf(buffer, "%d", *(uint16_t *)param);
+      /* everything as one json object */
+      for(i = 0; i < NPARAMS; i++) {
+        msgbuf_putc(&m, i == 0 ? '{' : ',');
+        msgbuf_putc(&m, '"');
+        msgbuf_puts(&m, params[i].name);
+        msgbuf_puts(&m, "\":");
+        param_put(&m, &params[i], 1);
+      }
+      msgbuf_putc(&m, '}');
+      REST.set_header_content_type(response, REST.type.APPLICATION_JSON);
     }
-    REST.set_response_payload(response, buffer, n);
+    REST.set_response_payload(response, buffer, msgbuf_len(&m));
   }
 
   return;
 
 bad:
   REST.set_response_status(response, REST.status.BAD_REQUEST);
+  if(p == NULL && txn.bad != NULL) {
+    /* name the rejected key */
+    REST.set_response_payload(response, txn.bad, txn.bad_len);
+  }
+}
+
+RESOURCE(energy, METHOD_GET, "energy", "title=\"Time per power state\";rt=\"Data\"");
 
+/* seconds with three decimals */
+static void
+seconds_put(struct msgbuf *m, uint64_t ms)
+{
+  msgbuf_put_uint(m, (uint32_t)(ms / 1000));
+  msgbuf_putc(m, '.');
+  ms %= 1000;
+  msgbuf_putc(m, '0' + ms / 100);
+  msgbuf_putc(m, '0' + ms / 10 % 10);
+  msgbuf_putc(m, '0' + ms % 10);
 }
 
-char buf[256];
+/* {"up":86400.000,"cpu":120.500,"idle":2500.250,"sleep":83779.250,"rx":1900.100,"tx":12.300,"sensor":350.000,"flash":0.800} */
+/* seconds since boot; cpu, idle and sleep add up to up, the others draw on top */
+/* tx is only counted with th12mac, otherwise it's part of rx */
+void
+energy_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  struct msgbuf m;
+  uint64_t up, idle, slept, radio, tx;
+
+  up = energy_uptime_ms();
+  idle = energy_idle_ms();
+  slept = energy_ms(ENERGY_SLEEP);
+  radio = energy_ms(ENERGY_RADIO);
+  tx = energy_tx_ms();
+  if (idle + slept > up) {
+    idle = up - slept;
+  }
+  if (tx > radio) {
+    tx = radio;
+  }
+
+  msgbuf_init(&m, (char *)buffer, preferred_size);
+  msgbuf_puts(&m, "{\"up\":");
+  seconds_put(&m, up);
+  msgbuf_puts(&m, ",\"cpu\":");
+  seconds_put(&m, up - idle - slept);
+  msgbuf_puts(&m, ",\"idle\":");
+  seconds_put(&m, idle);
+  msgbuf_puts(&m, ",\"sleep\":");
+  seconds_put(&m, slept);
+  msgbuf_puts(&m, ",\"rx\":");
+  seconds_put(&m, radio - tx);
+  msgbuf_puts(&m, ",\"tx\":");
+  seconds_put(&m, tx);
+  msgbuf_puts(&m, ",\"sensor\":");
+  seconds_put(&m, energy_ms(ENERGY_SENSOR));
+  msgbuf_puts(&m, ",\"flash\":");
+  seconds_put(&m, energy_ms(ENERGY_FLASH));
+  msgbuf_putc(&m, '}');
+  REST.set_header_content_type(response, REST.type.APPLICATION_JSON);
+  REST.set_response_payload(response, buffer, msgbuf_len(&m));
+}
 
-uint16_t create_dht_msg(dht_result_t *d, char *buf)
+RESOURCE(profile, METHOD_GET, "profile", "title=\"Wake cycle profile\";rt=\"Data\"");
+
+/* binary, see prof_export() and tools/profile.py */
+typedef char profile_fits_in_chunk[(3 + PROF_CYCLES * (2 + 2 * PROF_POINTS) <= REST_MAX_CHUNK_SIZE) ? 1 : -1];
+
+void
+profile_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
-	rpl_dag_t *dag;
-	uint8_t n = 0;
-	rimeaddr_t *addr;
-	uint16_t frac_t, int_t;
-	char neg = ' ';
+  REST.set_header_content_type(response, REST.type.APPLICATION_OCTET_STREAM);
+  REST.set_response_payload(response, buffer, prof_export(buffer, preferred_size));
+}
 
-	addr = &rimeaddr_node_addr;
+RESOURCE(stats, METHOD_GET, "stats", "title=\"Post counters\";rt=\"Data\"");
 
-	if(d->t < 0) {
-	  neg = '-';
-	  int_t = (-1 * d->t)/10;
-	  frac_t = (-1 * d->t) % 10;
-	} else {
-	  neg = ' ';
-	  int_t = d->t/10;
-	  frac_t = d->t % 10;
+/* {"sent":12,"suppressed":130,"noack":1,"rto":230,"con":9,"con_failed":1,"con_probes":2,"con_interval":16,"log":0} */
+/* rto is in ms */
+void
+stats_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  struct msgbuf m;
+
+  msgbuf_init(&m, (char *)buffer, preferred_size);
+  msgbuf_puts(&m, "{\"sent\":");
+  msgbuf_put_uint(&m, posts_sent);
+  msgbuf_puts(&m, ",\"suppressed\":");
+  msgbuf_put_uint(&m, cycle.suppressed);
+  msgbuf_puts(&m, ",\"noack\":");
+  msgbuf_put_uint(&m, posts_noack);
+  msgbuf_puts(&m, ",\"rto\":");
+  msgbuf_put_uint(&m, (uint32_t)sink_rtt.rto * 1000 / CLOCK_SECOND);
+  msgbuf_puts(&m, ",\"con\":");
+  msgbuf_put_uint(&m, cycle.cons_sent);
+  msgbuf_puts(&m, ",\"con_failed\":");
+  msgbuf_put_uint(&m, cycle.cons_failed);
+  msgbuf_puts(&m, ",\"con_probes\":");
+  msgbuf_put_uint(&m, cycle.con_probes);
+  msgbuf_puts(&m, ",\"con_interval\":");
+  msgbuf_put_uint(&m, cycle.con_interval);
+  msgbuf_puts(&m, ",\"log\":");
+  msgbuf_put_uint(&m, readlog_count());
+  msgbuf_putc(&m, '}');
+  REST.set_header_content_type(response, REST.type.APPLICATION_JSON);
+  REST.set_response_payload(response, buffer, msgbuf_len(&m));
+}
+
+#define BUF_SIZE 512
+char buf[BUF_SIZE];
+static uint16_t buf_len;
+
+/* compile time check: fails to build if a sensor post doesn't fit in one frame */
+typedef char dht_msg_fits_in_frame[(DHT_MSG_CBOR_MAX <= FRAME_PAYLOAD_MAX) ? 1 : -1];
+
+/* a batch is fragmented, but it has to fit in buf and in one coap chunk */
+/* older readings add a record for t and h with a 32-bit relative time */
+/* json: [-2147483648,-400,1000], */
+#define BATCH_SAMPLE_JSON_MAX 26
+#define BATCH_CBOR_MAX (DHT_MSG_CBOR_MAX + (BATCH_MAX - 1) * BATCH_SAMPLE_CBOR_MAX)
+/* {"t":"-40.0C","h":"100.0%","vb":"65535mV","s":[]} */
+#define BATCH_JSON_MAX (51 + (BATCH_MAX - 1) * BATCH_SAMPLE_JSON_MAX)
+typedef char batch_fits_in_buf[(BATCH_CBOR_MAX < BUF_SIZE && BATCH_JSON_MAX < BUF_SIZE) ? 1 : -1];
+typedef char batch_fits_in_chunk[(BATCH_CBOR_MAX <= REST_MAX_CHUNK_SIZE && BATCH_JSON_MAX <= REST_MAX_CHUNK_SIZE) ? 1 : -1];
+
+/* drain posts: a 2 byte array head plus t and h records with times */
+/* json: {"q":[...]} with the same samples as a batch */
+#define LOG_CBOR_MAX (2 + LOG_DRAIN_MAX * BATCH_SAMPLE_CBOR_MAX)
+#define LOG_JSON_MAX (8 + LOG_DRAIN_MAX * BATCH_SAMPLE_JSON_MAX)
+typedef char log_fits_in_buf[(LOG_CBOR_MAX < BUF_SIZE && LOG_JSON_MAX < BUF_SIZE) ? 1 : -1];
+typedef char log_fits_in_chunk[(LOG_CBOR_MAX <= REST_MAX_CHUNK_SIZE && LOG_JSON_MAX <= REST_MAX_CHUNK_SIZE) ? 1 : -1];
+
+/* add a reading to the batch */
+static void
+batch_add(dht_result_t *d)
+{
+  sample_t *s;
+
+  if (batch_count == BATCH_MAX) {
+    batch_head = (batch_head + 1) % BATCH_MAX;
+    batch_count--;
+  }
+  s = &batch[(batch_head + batch_count) % BATCH_MAX];
+  s->time = clock_time();
+  s->t = d->t;
+  s->rh = d->rh;
+  batch_count++;
+}
+
+/* the i-th oldest reading in the batch */
+static sample_t *
+batch_get(uint8_t i)
+{
+  return &batch[(batch_head + i) % BATCH_MAX];
+}
+
+/* age of a reading in seconds, as a negative number */
+static int32_t
+batch_age(sample_t *s)
+{
+  return -(int32_t)((clock_time() - s->time) / CLOCK_SECOND);
+}
+
+uint16_t create_dht_msg_senml(dht_result_t *d, char *buf)
+{
+	struct msgbuf m;
+	uint8_t i, older;
+
+	/* the newest reading is d, older ones carry their relative time */
+	older = batch_count ? batch_count - 1 : 0;
+
+	msgbuf_init(&m, buf, BUF_SIZE);
+	senml_start(&m, (report_batt ? 3 : 2) + 2 * older);
+	for (i = 0; i < older; i++) {
+	  sample_t *s = batch_get(i);
+	  senml_decimal_at(&m, "t", s->t, -1, batch_age(s));
+	  senml_decimal_at(&m, "h", s->rh, -1, batch_age(s));
+	}
+	senml_decimal(&m, "t", d->t, -1);
+	senml_decimal(&m, "h", d->rh, -1);
+	if (report_batt == 1) {
+	  senml_decimal(&m, "vb", vbatt, -3);
+	}
+
+	PRINTF("senml: %d bytes\n", msgbuf_len(&m));
+	return msgbuf_len(&m);
+}
+
+uint16_t create_dht_msg(dht_result_t *d, char *buf)
+{
+	struct msgbuf m;
+	uint16_t n;
+
+	if (th12_cfg.payload_format == FORMAT_SENML_CBOR) {
+	  return create_dht_msg_senml(d, buf);
 	}
 
-	/* {"eui":"ec473c4d12bdd1ce","t":" 22.1C","h":"18.3%","vb":"2678mV"} */
-	n += sprintf(&(buf[n]),"{\"t\":\"%c%d.%dC\",\"h\":\"%d.%d%%\"",
-		     neg,
-		     int_t,
-		     frac_t,
-		     d->rh / 10,
-		     d->rh % 10,
-		     vbatt
-		);
+	/* {"t":" 22.1C","h":"18.3%","vb":"2678mV"} */
+	msgbuf_init(&m, buf, BUF_SIZE);
+	msgbuf_puts(&m, "{\"t\":\"");
+	if (d->t >= 0) {
+	  msgbuf_putc(&m, ' ');
+	}
+	msgbuf_put_fixed(&m, d->t, 1);
+	msgbuf_puts(&m, "C\",\"h\":\"");
+	msgbuf_put_fixed(&m, d->rh, 1);
+	msgbuf_puts(&m, "%\"");
 
 	if (report_batt == 1) {
-	  n += sprintf(&buf[n], ",\"vb\":\"%dmV\"}", vbatt);
-	} else {
-	  n += sprintf(&buf[n], "}");
+	  msgbuf_puts(&m, ",\"vb\":\"");
+	  msgbuf_put_uint(&m, vbatt);
+	  msgbuf_puts(&m, "mV\"");
 	}
 
-	buf[n] = 0;
+	/* older readings in the batch: "s":[[-600,221,183],[-300,220,184]] */
+	/* seconds relative to now and the raw fixed-point values */
+	if (batch_count > 1) {
+	  uint8_t i;
+	  msgbuf_puts(&m, ",\"s\":[");
+	  for (i = 0; i < batch_count - 1; i++) {
+	    sample_t *s = batch_get(i);
+	    if (i > 0) {
+	      msgbuf_putc(&m, ',');
+	    }
+	    msgbuf_putc(&m, '[');
+	    msgbuf_put_int(&m, batch_age(s));
+	    msgbuf_putc(&m, ',');
+	    msgbuf_put_int(&m, s->t);
+	    msgbuf_putc(&m, ',');
+	    msgbuf_put_uint(&m, s->rh);
+	    msgbuf_putc(&m, ']');
+	  }
+	  msgbuf_putc(&m, ']');
+	}
+	msgbuf_putc(&m, '}');
+
+	n = msgbuf_finish(&m);
 	PRINTF("buf: %s\n", buf);
 	return n;
 }
 
+/* a post of the oldest stored readings, n is set to how many went in */
+uint16_t create_log_msg(char *buf, uint8_t *n)
+{
+	static struct readlog_rec r[LOG_DRAIN_MAX];
+	struct msgbuf m;
+	uint32_t now = readlog_now();
+	uint8_t i;
+
+	*n = readlog_peek(r, LOG_DRAIN_MAX);
+	msgbuf_init(&m, buf, BUF_SIZE);
+
+	if (th12_cfg.payload_format == FORMAT_SENML_CBOR) {
+	  senml_start(&m, 2 * *n);
+	  for (i = 0; i < *n; i++) {
+	    senml_decimal_at(&m, "t", r[i].t, -1, (int32_t)(r[i].time - now));
+	    senml_decimal_at(&m, "h", r[i].rh, -1, (int32_t)(r[i].time - now));
+	  }
+	  return msgbuf_len(&m);
+	}
+
+	/* {"q":[[-3600,221,183],[-3300,220,184]]} */
+	msgbuf_puts(&m, "{\"q\":[");
+	for (i = 0; i < *n; i++) {
+	  if (i > 0) {
+	    msgbuf_putc(&m, ',');
+	  }
+	  msgbuf_putc(&m, '[');
+	  msgbuf_put_int(&m, (int32_t)(r[i].time - now));
+	  msgbuf_putc(&m, ',');
+	  msgbuf_put_int(&m, r[i].t);
+	  msgbuf_putc(&m, ',');
+	  msgbuf_put_uint(&m, r[i].rh);
+	  msgbuf_putc(&m, ']');
+	}
+	msgbuf_puts(&m, "]}");
+
+	msgbuf_finish(&m);
+	return msgbuf_len(&m);
+}
+
+/* the post didn't get through, keep its readings */
+static void
+log_inflight(void)
+{
+	struct readlog_rec r;
+	uint8_t i;
+
+	for (i = 0; i < inflight_count; i++) {
+	  r.time = readlog_now() - (clock_time() - inflight[i].time) / CLOCK_SECOND;
+	  r.t = inflight[i].t;
+	  r.rh = inflight[i].rh;
+	  readlog_put(&r);
+	}
+	if (inflight_count) {
+	  PRINTF("logged %d readings, %d stored\n\r", inflight_count, readlog_count());
+	}
+	inflight_count = 0;
+}
+
 uint16_t create_error_msg(char *error, char *buf)
 {
-	uint8_t n = 0;
-	rimeaddr_t *addr;
+	struct msgbuf m;
+	uint16_t n;
+
+	msgbuf_init(&m, buf, BUF_SIZE);
 
-	addr = &rimeaddr_node_addr;
+	if (th12_cfg.payload_format == FORMAT_SENML_CBOR) {
+	  senml_start(&m, 1);
+	  senml_string(&m, "err", error);
+	  return msgbuf_len(&m);
+	}
 
-	/* {"eui":"ec473c4d12bdd1ce","err":"sensor failed"} */
-	n += sprintf(&(buf[n]),"{\"err\":\"%s\"}",
-		     error
-		);
+	/* {"err":"sensor failed"} */
+	msgbuf_puts(&m, "{\"err\":\"");
+	msgbuf_puts(&m, error);
+	msgbuf_puts(&m, "\"}");
 
-	buf[n] = 0;
+	n = msgbuf_finish(&m);
 	PRINTF("buf: %s\n", buf);
 	return n;
 }
@@ -397,12 +1187,25 @@ uint16_t create_error_msg(char *error, char *buf)
 
 PROCESS_NAME(do_post);
 
+static void
+radio_on(void)
+{
+	if (!radio_awake) {
+		maca_on();
+		energy_on(ENERGY_RADIO);
+		radio_awake = 1;
+	}
+}
+
 void
 go_to_sleep(void *ptr)
 {
 
 	if(sleep_ok == 1) {
 		PRINTF("go to sleep\n\r");
+		PRINTF("scheduler runs this wake: %lu idle: %lu rtc ticks\n\r",
+		       (unsigned long)sched_runs, (unsigned long)idle_rtc_ticks);
+		PRINTF("posts sent: %u suppressed: %u\n\r", posts_sent, cycle.suppressed);
 		/* sleep until we need to post */
 		dht_uninit();
 
@@ -411,16 +1214,26 @@ go_to_sleep(void *ptr)
 		  /* to keep the boost on */
 		  CRM->WU_CNTLbits.EXT_OUT_POL |= (1 << 2);
 		  gpio_set(KBI1);
+		  /* the sensor shares the pin, so it stays powered */
+		  energy_on(ENERGY_SENSOR);
 		} else {
 		  CRM->WU_CNTLbits.EXT_OUT_POL &= ~(1 << 2);
 		  gpio_reset(KBI1);
 		}
 
+		/* the radio is off from here until radio_on() */
+		energy_off(ENERGY_RADIO);
 		if (next_post > (clock_time() + 5)) {
+		  prof_mark(PROF_SLEEP);
+		  energy_on(ENERGY_SLEEP);
 		  rtimer_arch_sleep((next_post - clock_time() - 5) * (rtc_freq/CLOCK_CONF_SECOND));
+		  energy_off(ENERGY_SLEEP);
+		  prof_start();
 		}
 
 		dht_init();
+		prof_mark(PROF_DHT_INIT);
+		radio_awake = 0;
 	} else {
 		PRINTF("can't sleep now, sleep not ok\n\r");
 	}
@@ -429,118 +1242,410 @@ go_to_sleep(void *ptr)
 
 }
 
-/* This function is will be passed to COAP_BLOCKING_REQUEST() to handle responses. */
-void
-client_chunk_handler(void *response)
+/* the sink can piggyback a config delta on its response to any post */
+/* {"mb":7,"interval":600} or the same as a CBOR map, mb numbers the delta */
+/* it's applied like a batch POST to /config, so it costs no extra radio time */
+/* the following posts carry ?mb=7, or ?mbx=7 if it was rejected, until */
+/* the sink answers without that delta */
+/* with th12mac only the CON sink checks are answered before the node */
+/* sleeps, so deltas land there. NON posts listen for the answer only */
+/* while an ack is outstanding, see post_tx_check() */
+#define MB_NONE     0
+#define MB_APPLIED  1
+#define MB_REJECTED 2
+static uint8_t mailbox_ack = MB_NONE;
+static uint16_t mailbox_seq;
+static char mailbox_query[MAILBOX_ACK_MAX + 1];
+
+/* the sink can also send its time, {"ts":1760000000}, to align the post slots */
+struct sink_reply {
+  int32_t mb;
+  uint32_t ts;
+};
+
+static int
+sink_reply_pair(const char *key, uint8_t key_len, const char *value, void *ctx)
+{
+  struct sink_reply *r = ctx;
+
+  if(key_len == 2 && strncmp(key, "mb", 2) == 0) {
+    r->mb = (uint16_t)strtoul(value, NULL, 10);
+  } else if(key_len == 2 && strncmp(key, "ts", 2) == 0) {
+    r->ts = strtoul(value, NULL, 10);
+  }
+  return 0;
+}
+
+static int
+mailbox_pair(const char *key, uint8_t key_len, const char *value, void *ctx)
+{
+  if(key_len == 2 && (strncmp(key, "mb", 2) == 0 || strncmp(key, "ts", 2) == 0)) {
+    return 0;
+  }
+  return config_pair(key, key_len, value, ctx);
+}
+
+static void
+mailbox_check(const uint8_t *p, uint16_t len)
+{
+  struct msgbuf m;
+  struct sink_reply r = { -1, 0 };
+
+  if(len == 0 || (p[0] != '{' && (p[0] & 0xe0) != 0xa0) ||
+     kv_parse(p, len, sink_reply_pair, &r) != 0) {
+    /* a plain answer, so the sink has no delta for us */
+    mailbox_ack = MB_NONE;
+    return;
+  }
+  if(r.ts != 0) {
+    int32_t epoch = r.ts - clock_seconds();
+    /* the time is in whole seconds, don't move the slot for the rounding */
+    if(slot_epoch == 0 || epoch > slot_epoch + 1 || epoch < slot_epoch - 1) {
+      slot_epoch = epoch;
+    }
+  }
+  if(r.mb < 0) {
+    mailbox_ack = MB_NONE;
+    return;
+  }
+  if(mailbox_ack != MB_NONE && r.mb == mailbox_seq) {
+    /* already done, the sink hasn't seen the ack yet */
+    return;
+  }
+
+  mailbox_seq = r.mb;
+  config_begin(&txn);
+  mailbox_ack = (kv_parse(p, len, mailbox_pair, &txn) == 0) ? MB_APPLIED : MB_REJECTED;
+  msgbuf_init(&m, mailbox_query, sizeof(mailbox_query));
+  msgbuf_puts(&m, mailbox_ack == MB_APPLIED ? "mb=" : "mbx=");
+  msgbuf_put_uint(&m, mailbox_seq);
+  msgbuf_finish(&m);
+  PRINTF("mailbox %u %s\n\r", mailbox_seq, mailbox_ack == MB_APPLIED ? "applied" : "rejected");
+
+  if(mailbox_ack == MB_APPLIED) {
+    /* may reboot for a channel change, the delta is sent again then and changes nothing */
+    config_commit(&txn);
+  }
+}
+
+#if TH12MAC
+static struct ctimer ct_tx;
+
+/* runs once the post has left the stack, after the last fragment */
+static void
+post_tx_check(void *ptr)
+{
+  uint8_t resent = cycle.tx_tries > 0;
+  uint8_t next;
+
+  tx_watch = 0;
+  if (tx_failed) {
+    posts_noack++;
+  }
+  /* the sink's last answer had a delta: its next one confirms the ack */
+  /* or carries a newer delta, so it's worth the radio time to hear it */
+  next = post_cycle_tx(&cycle, !tx_failed, mailbox_ack != MB_NONE);
+  if (next == POST_CYCLE_SLEEP || next == POST_CYCLE_LISTEN) {
+    PRINTF("post ACKed\n\r");
+    prof_mark(PROF_RESPONSE);
+    if (resent) {
+      slot_shift(clock_time() - cycle.last_post);
+    }
+    if (next == POST_CYCLE_LISTEN) {
+      /* client_chunk_handler() sleeps as soon as the answer is in */
+      /* rtt_rto() would age the estimate on every post, so read it as it is */
+      ctimer_set(&ct_sleep, sink_rtt.rto, go_to_sleep, NULL);
+      return;
+    }
+    ctimer_stop(&ct_sleep);
+    go_to_sleep(NULL);
+    return;
+  }
+
+  ctimer_stop(&ct_sleep);
+  if (next == POST_CYCLE_RESEND) {
+    PRINTF("post not ACKed, sending again\n\r");
+    post_resend = 1;
+    process_exit(&do_post);
+    process_start(&do_post, NULL);
+  } else {
+    /* the next wake does a sink check */
+    PRINTF("post not ACKed, giving up\n\r");
+    log_inflight();
+    go_to_sleep(NULL);
+  }
+}
+
+/* called by th12mac from inside the stack for every frame sent */
+static void
+post_tx_done(int status)
+{
+  if (!tx_watch) {
+    return;
+  }
+  if (status != MAC_TX_OK) {
+    tx_failed = 1;
+  }
+  /* fragments go out back to back, so this ends up firing after the last one */
+  ctimer_set(&ct_tx, 0, post_tx_check, NULL);
+}
+#endif
+
+/* the sink answered a NON or a CON */
+static void
+sink_answered(void *response)
 {
   const uint8_t *chunk;
 
   ctimer_stop(&ct_sleep);
+  prof_mark(PROF_RESPONSE);
   int len = coap_get_payload(response, &chunk);
   printf("|%.*s", len, (char *)chunk);
 
+  post_cycle_answered(&cycle, len != 0);
+
   if (len != 0) {
     sink_ok = 1;
-    sink_checks_failed = 0;
     con_ok = 1;
     if (!sleep_ok) {
       gpio_set(GPIO_43);
     }
+    mailbox_check(chunk, len);
   }
+}
 
+/* This function is will be passed to COAP_BLOCKING_REQUEST() to handle responses. */
+void
+client_chunk_handler(void *response)
+{
+  sink_answered(response);
   go_to_sleep(NULL);
 }
 
+/* started with data != NULL to refresh the cached address in the background */
+/* a background resolv doesn't touch resolv_ok or wake do_post */
 PROCESS(resolv_sink, "resolv sink hostname");
 PROCESS_THREAD(resolv_sink, ev, data)
 {
+  static uint8_t background;
 
   PROCESS_BEGIN();
 
   static struct timer t_get_dag_timeout;
+  static struct etimer et_dag_poll;
+  background = (data != NULL);
   timer_set(&t_get_dag_timeout, DAG_TIMEOUT);
 
-  ev_resolv_failed = process_alloc_event();
-
-  dag = NULL;
+  dag = rpl_get_any_dag();
 
+  /* sleep on an etimer between checks so the scheduler can idle */
   while (dag == NULL && !timer_expired(&t_get_dag_timeout)) {
-
-    PROCESS_PAUSE();
-
+    etimer_set(&et_dag_poll, DAG_POLL_INTERVAL);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et_dag_poll));
     dag = rpl_get_any_dag();
+  }
 
-    if (dag != NULL ) {
-      uip_ipaddr_t *addr;
-      PRINTF("joined DAG.\n");
+  if (dag == NULL) {
+    PRINTF("DAG timed out\n\r");
+    if (!background) {
+      resolv_ok = 0;
+      process_post(&do_post, ev_resolv_done, NULL);
+    }
+    PROCESS_EXIT();
+  }
 
-      PRINTF("Trying to resolv %s\n", th12_cfg.sink_name);
-      resolv_query(th12_cfg.sink_name);
+  PRINTF("joined DAG.\n");
+  prof_mark(PROF_DAG);
+  PRINTF("Trying to resolv %s\n", th12_cfg.sink_name);
+  resolv_query(th12_cfg.sink_name);
 
-      PROCESS_WAIT_EVENT();
+  PROCESS_WAIT_EVENT_UNTIL(ev == resolv_event_found);
+  {
+    uip_ipaddr_t *addr;
+    PRINTF("resolv_event_found\n");
 
-      if(ev == resolv_event_found) {
-	uip_ipaddr_t *addr;
-	PRINTF("resolv_event_found\n");
+    addr = &(th12_cfg.sink_addr);
+    if(resolv_lookup(th12_cfg.sink_name, &addr) == RESOLV_STATUS_CACHED) {
+      memcpy(&th12_cfg.sink_addr, addr, sizeof(uip_ipaddr_t));
+      PRINT6ADDR(&th12_cfg.sink_addr);
+      PRINTF("\n\r");
+      sink_cache_update(&th12_cfg.sink_addr);
+      resolv_ok = 1;
+      prof_mark(PROF_RESOLVED);
+    } else {
+      PRINTF("host not found\n\r");
+      /* a failed refresh keeps using the cached address */
+      if (!background) {
+	resolv_ok = 0;
+      }
+    }
+  }
 
-	addr = &(th12_cfg.sink_addr);
-	if(resolv_lookup(th12_cfg.sink_name, &addr) == RESOLV_STATUS_CACHED) {
-	  memcpy(&th12_cfg.sink_addr, addr, sizeof(uip_ipaddr_t));
-	  PRINT6ADDR(&th12_cfg.sink_addr);
-	  PRINTF("\n\r");
-	  resolv_ok = 1;
-	} else {
-	  PRINTF("host not found\n\r");
-	  resolv_ok = 0;
-	  process_post(&do_post, ev_resolv_failed, NULL);
-	}
+  /* wake do_post, which is blocked waiting on the result */
+  if (!background) {
+    process_post(&do_post, ev_resolv_done, NULL);
+  }
 
-	PROCESS_EXIT();
+  PROCESS_END();
+}
 
-      }
+/* start resolving the sink */
+/* called at the start of a wake so the DAG and DNS wait overlaps the sensor warm-up */
+/* a cached address is used right away and only refreshed in the background */
+static void
+sink_check_start(void)
+{
+  con_pending = 1;
+  sink_ok = 0;
+  process_exit(&resolv_sink);
+  if (strncmp("", th12_cfg.sink_name, SINK_MAXLEN) == 0) {
+    PRINTF("sink name null, trying with ip ");
+    PRINT6ADDR(&th12_cfg.sink_addr);
+    PRINTF("\n\r");
+    resolv_ok = 1;
+  } else if (sink_cache_valid()) {
+    PRINTF("using cached sink address\n\r");
+    uip_ipaddr_copy(&th12_cfg.sink_addr, &th12_state.sink_addr);
+    resolv_ok = 1;
+    if (!sink_cache_current()) {
+      process_start(&resolv_sink, (void *)1);
     }
+  } else {
+    resolv_ok = -1;
+    process_start(&resolv_sink, NULL);
   }
+}
 
-  if (timer_expired(&t_get_dag_timeout) ) {
-    PRINTF("DAG timed out\n\r");
-    resolv_ok = 0;
+/* the engine calls this when the CON is answered */
+/* it has already freed the transaction */
+static void
+con_response(void *data, void *response)
+{
+  con_t = NULL;
+  con_done = 1;
+  /* Karn: only the weak estimator takes samples from retransmitted exchanges */
+  rtt_sample(&sink_rtt, clock_time() - con_sent, con_tries);
+  PRINTF("CON answered after %d retransmits, rto now %u\n\r", con_tries, sink_rtt.rto);
+  process_poll(&do_post);
+  /* do_post finishes the check and sleeps through ev_post_complete */
+  sink_answered(response);
+}
+
+/* do_post was killed with a CON in flight */
+static void
+con_abort(void)
+{
+  if (con_t != NULL) {
+    coap_clear_transaction(con_t);
+    con_t = NULL;
   }
+}
 
-  PROCESS_END();
+/* a post to the sink with len bytes of buf */
+static void
+request_init(coap_packet_t *request, coap_message_type_t type, uint16_t len)
+{
+  coap_init_message(request, type, COAP_POST, 0 );
+  coap_set_header_uri_path(request, th12_cfg.sink_path);
+  if (mailbox_ack != MB_NONE) {
+    coap_set_header_uri_query(request, mailbox_query);
+  }
+  if (th12_cfg.payload_format == FORMAT_SENML_CBOR) {
+    coap_set_header_content_type(request, SENML_CBOR_CONTENT_FORMAT);
+  } else {
+    coap_set_header_content_type(request, APPLICATION_JSON);
+  }
+  coap_set_payload(request, buf, len);
+}
+
+/* send a CON and wait for the answer, con_done is set if it came */
+static struct etimer et_con;
+static
+PT_THREAD(con_exchange(struct pt *pt, process_event_t ev, coap_packet_t *request))
+{
+  static uint16_t rto;
+
+  PT_BEGIN(pt);
+
+  if (!uip_ipaddr_cmp(&rtt_addr, &th12_cfg.sink_addr)) {
+    uip_ipaddr_copy(&rtt_addr, &th12_cfg.sink_addr);
+    rtt_init(&sink_rtt);
+  }
+
+  con_done = 0;
+  request->mid = coap_get_mid();
+  con_t = coap_new_transaction(request->mid, &th12_cfg.sink_addr, REMOTE_PORT);
+  if (con_t == NULL) {
+    PT_EXIT(pt);
+  }
+  con_t->callback = con_response;
+  con_t->callback_data = NULL;
+  con_t->packet_len = coap_serialize_message(request, con_t->packet);
+  con_tries = 0;
+  con_sent = clock_time();
+  coap_send_transaction(con_t);
+  /* the transaction stays open for the response, the timeouts are ours */
+  etimer_stop(&con_t->retrans_timer);
+
+  rto = rtt_rto(&sink_rtt);
+  while (1) {
+    /* up to half again, like RFC 7252's ACK_RANDOM_FACTOR, so two nodes */
+    /* that share a slot don't retransmit into each other every time */
+    etimer_set(&et_con, rto + random_rand() % (rto / 2 + 1));
+    PT_WAIT_UNTIL(pt, con_done || etimer_expired(&et_con));
+    if (con_done) {
+      break;
+    }
+    if (con_tries == CON_MAX_RETRANSMIT) {
+      PRINTF("CON timed out\n\r");
+      con_abort();
+      break;
+    }
+    con_tries++;
+    rto = rtt_backoff(rto);
+    PRINTF("CON retransmit %d, next timeout %u\n\r", con_tries, rto);
+    coap_send_message(&con_t->addr, con_t->port, con_t->packet, con_t->packet_len);
+  }
+
+  PT_END(pt);
 }
 
 PROCESS(do_post, "post results");
 PROCESS_THREAD(do_post, ev, data)
 {
   static uint8_t doing_con;
+  static struct pt con_pt;
+  static uint8_t drained;
 
+  PROCESS_EXITHANDLER(con_abort());
   PROCESS_BEGIN();
   static coap_packet_t request[1]; /* This way the packet can be treated as pointer as usual. */
 
   PRINTF("do post\n\r");
+  radio_on();
+  if (!post_resend) {
+    posts_sent++;
+  }
 
   /* we do a NON post since a CON could take 60 seconds to time out and we don't want to stay awake that long */
-  if (!resolv_ok || (wakes % th12_cfg.posts_per_check ) == 0) {
+  /* the sink check is normally started at wake, but not for reads started by /config */
+  if (!con_pending && post_cycle_check_due(&cycle, resolv_ok)) {
+    sink_check_start();
+  }
+  doing_con = con_pending;
+  con_pending = 0;
+  post_cycle_send(&cycle, doing_con, post_resend);
+  post_resend = 0;
+
+  if (doing_con) {
     PRINTF("sink check with CON\n");
-    resolv_ok = -1; sink_ok = 0;
-    if (strncmp("", th12_cfg.sink_name, SINK_MAXLEN) == 0) {
-      PRINTF("sink name null, trying with ip ");
-      PRINT6ADDR(&th12_cfg.sink_addr);
-      PRINTF("\n\r");
-      resolv_ok = 1;
-    } else {
-      process_start(&resolv_sink, NULL);
-    }
-    coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0 );
+    request_init(request, COAP_TYPE_CON, buf_len);
     con_ok = 0;
     process_post(&th_12, ev_post_con_started, NULL);
   } else {
     PRINTF("NON post\n");
-    coap_init_message(request, COAP_TYPE_NON, COAP_POST, 0 );
+    request_init(request, COAP_TYPE_NON, buf_len);
   }
-  coap_set_header_uri_path(request, th12_cfg.sink_path);
-  coap_set_header_content_type(request, APPLICATION_JSON);
-  coap_set_payload(request, buf, strlen(buf));
 
   /* there is no good way to know if a NON request has finished */
   /* if it sucessful we might get a response back in client_chuck_handler */
@@ -553,21 +1658,67 @@ PROCESS_THREAD(do_post, ev, data)
     ctimer_set(&ct_sleep, SLEEP_AFTER_POST, go_to_sleep, NULL);
   }
 
-  while (resolv_ok == -1) {
-    PROCESS_PAUSE();
-    if (resolv_ok == 0) {
-      PRINTF("resolv failed\n");
-      sink_checks_failed++;
-      process_post(&th_12, ev_post_complete, NULL);
-      PROCESS_EXIT();
+  if (resolv_ok == -1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == ev_resolv_done);
+  }
+  if (resolv_ok == 0) {
+    PRINTF("resolv failed\n");
+    post_cycle_failed(&cycle);
+    if (doing_con) {
+      post_cycle_check_result(&cycle, 0);
     }
+    log_inflight();
+    process_post(&th_12, ev_post_complete, NULL);
+    PROCESS_EXIT();
+  }
+
+  /* the engine polls us when the response arrives or the transaction times out */
+  /* for CONs, con_response() polls us */
+
+  prof_mark(PROF_POST);
+  if (doing_con) {
+    PROCESS_PT_SPAWN(&con_pt, con_exchange(&con_pt, ev, request));
+  } else {
+#if TH12MAC
+    /* sleep as soon as the parent ACKs the frames */
+    tx_watch = 1;
+    tx_failed = 0;
+#endif
+    COAP_BLOCKING_REQUEST(&th12_cfg.sink_addr, REMOTE_PORT, request, client_chunk_handler);
+    PRINTF("status %u: %s\n", coap_error_code, coap_error_message);
   }
 
-  COAP_BLOCKING_REQUEST(&th12_cfg.sink_addr, REMOTE_PORT, request, client_chunk_handler);
-  PRINTF("status %u: %s\n", coap_error_code, coap_error_message);
+  if (doing_con) {
+    post_cycle_check_result(&cycle, con_ok);
+    if (con_ok && con_tries > 0) {
+      slot_shift(clock_time() - con_sent);
+    }
+  }
   if (con_ok == 0) {
     PRINTF("CON failed\n");
-    sink_checks_failed++;
+    post_cycle_failed(&cycle);
+    if (doing_con) {
+      sink_cache_invalidate();
+      log_inflight();
+    }
+  } else if (doing_con) {
+    inflight_count = 0;
+    if (strncmp("", th12_cfg.sink_name, SINK_MAXLEN) != 0) {
+      sink_cache_update(&th12_cfg.sink_addr);
+    }
+    rpl_state_update();
+  }
+
+  /* the sink is answering: send some of what was stored while it wasn't */
+  while (doing_con && con_ok && post_cycle_drain(&cycle, readlog_count())) {
+    buf_len = create_log_msg(buf, &drained);
+    PRINTF("draining %d of %d stored readings\n\r", drained, readlog_count());
+    request_init(request, COAP_TYPE_CON, buf_len);
+    con_ok = 0;
+    PROCESS_PT_SPAWN(&con_pt, con_exchange(&con_pt, ev, request));
+    if (con_ok) {
+      readlog_consume(drained);
+    }
   }
 
   process_post(&th_12, ev_post_complete, NULL);
@@ -581,6 +1732,25 @@ static process_event_t ev_sensor_retry_request;
 void do_result( dht_result_t d) {
 	uint16_t frac_t, int_t;
 	char neg = ' ';
+	uint8_t next;
+
+	/* the first sleepy wake probes for how long the sensor takes to warm up */
+	if (warmup_probing) {
+		clock_time_t warm = clock_time() - dht_power_time();
+		if ((d.ok == 1) && (d.t != 0) && (d.rh != 0)) {
+			dht_warmup = warm + DHT_WARMUP_MARGIN;
+			if (dht_warmup > DHT_WARMUP_MAX) { dht_warmup = DHT_WARMUP_MAX; }
+			warmup_measured = 1;
+			warmup_probing = 0;
+			PRINTF("dht warm-up measured: %d ticks\n\r", (int)dht_warmup);
+		} else if (warm < DHT_WARMUP_MAX) {
+			/* not warm yet, doesn't count as a sensor failure */
+			process_post(&th_12, ev_warmup_probe, NULL);
+			return;
+		} else {
+			warmup_probing = 0;
+		}
+	}
 
 	sensor_tries++;
 
@@ -588,8 +1758,6 @@ void do_result( dht_result_t d) {
 	if ((d.ok == 1) && 
 	    ((d.t != 0) && (d.rh != 0))) {
 	  
-		adc_service();
-
 		dht_current.t = d.t;
 		dht_current.rh = d.rh;
 
@@ -606,12 +1774,32 @@ void do_result( dht_result_t d) {
 #endif
 
 		ANNOTATE("temp: %c%d.%dC humid: %d.%d%%, ", neg, int_t, frac_t, d.rh / 10, d.rh % 10);
+		ANNOTATE("conf: %d, ", d.conf);
 		ANNOTATE("a0: %4dmV, a5: %4dmV, a6: %4dmV ", adc_voltage(0), adc_voltage(5), adc_voltage(6));
-		vbatt = adc_voltage(0) * 2;
 		ANNOTATE("vbatt: %dmV ", vbatt);
 		ANNOTATE("\n\r");
 
-		create_dht_msg(&d, buf);
+		/* sink checks always post so the CON goes out */
+		next = post_cycle_reading(&cycle, d.t, d.rh, batch_count, con_pending);
+		if (next == POST_CYCLE_SUPPRESS) {
+		  PRINTF("in deadband, not posting\n\r");
+		  process_post(&th_12, ev_post_complete, NULL);
+		  return;
+		}
+
+		batch_add(&d);
+		if (next == POST_CYCLE_BATCH) {
+		  /* keep the radio off and sleep until the batch is full */
+		  PRINTF("batched %d of %d\n\r", batch_count, th12_cfg.batch_size);
+		  process_post(&th_12, ev_post_complete, NULL);
+		  return;
+		}
+
+		buf_len = create_dht_msg(&d, buf);
+		for (inflight_count = 0; inflight_count < batch_count; inflight_count++) {
+		  inflight[inflight_count] = *batch_get(inflight_count);
+		}
+		batch_head = batch_count = 0;
 
 		/* NON posts leave the do_post process hanging around */
 		/* kill it so we can start another */
@@ -624,13 +1812,19 @@ void do_result( dht_result_t d) {
 	  } else {
 	    PRINTF("bad checksum\n\r");
 	  }
+	  /* the measured warm-up may be too short now, go back to the safe value */
+	  if (warmup_measured) {
+	    warmup_measured = 0;
+	    dht_warmup = DHT_WARMUP_MAX;
+	  }
 	  if(sensor_tries < SENSOR_RETRIES) {
 	    PRINTF("retry sensor: %d\n\r", sensor_tries);
 	    process_post(&th_12, ev_sensor_retry_request, NULL);
 	  } else {
 	    PRINTF("too many sensor retries, giving up.\n\r");
 	    retry = 0;
-	    create_error_msg("sensor failed", buf);
+	    buf_len = create_error_msg("sensor failed", buf);
+	    inflight_count = 0;
 	    process_exit(&do_post);
 	    process_start(&do_post, NULL);
 	  }
@@ -645,6 +1839,11 @@ set_sleep_ok(void *ptr)
 	gpio_reset(GPIO_43);
 	if (th12_cfg.sleep_allowed) {
 	  sleep_ok = 1;
+	  /* killing a sink check would leave et_do_dht stopped */
+	  if (process_is_running(&do_post)) {
+	    PRINTF("post in progress, sleeping when it's done\n\r");
+	    return;
+	  }
 	  go_to_sleep(NULL);
 	}
 }
@@ -655,6 +1854,55 @@ set_report_batt_ok(void *ptr)
 	report_batt = 1;
 }
 
+/* how much longer the sensor needs to warm up */
+static clock_time_t
+warmup_left(clock_time_t warmup)
+{
+	clock_time_t warm = clock_time() - dht_power_time();
+	return (warm >= warmup) ? 0 : warmup - warm;
+}
+
+/* set et_do_dht for the next post slot */
+static void
+slot_schedule(void)
+{
+  clock_time_t wait;
+
+  wait = slot_wait(clock_seconds() + slot_epoch, clock_time() % CLOCK_SECOND,
+		   slot_id, th12_cfg.post_interval, CLOCK_SECOND);
+  next_post = clock_time() + wait;
+  etimer_set(&et_do_dht, wait);
+  PRINTF("next post in %lu ticks\n\r", (unsigned long)wait);
+}
+
+/* a retransmission got through delay ticks after the first send, so nobody */
+/* else posts then: move the slot there. A random per-post jitter would */
+/* keep colliding posts moving instead of settling, see tools/sim */
+static void
+slot_shift(clock_time_t delay)
+{
+  if (th12_cfg.post_interval == 0) {
+    return;
+  }
+  slot_id = slot_id % ((uint32_t)th12_cfg.post_interval * CLOCK_SECOND) + delay;
+  PRINTF("slot moved by %lu ticks\n\r", (unsigned long)delay);
+}
+
+/* extra delay before the first post, within SLOT_BOOT_SPREAD or the interval */
+static clock_time_t
+slot_boot_delay(void)
+{
+  uint32_t spread = SLOT_BOOT_SPREAD;
+
+  if (spread > th12_cfg.post_interval) {
+    spread = th12_cfg.post_interval;
+  }
+  if (spread == 0) {
+    return 0;
+  }
+  return slot_id % (spread * CLOCK_SECOND);
+}
+
 static struct ctimer ct_ledoff;
 void
 led_off(void *ptr)
@@ -664,12 +1912,16 @@ led_off(void *ptr)
 
 PROCESS_THREAD(th_12, ev, data)
 {
+  static uint8_t cfg_found;
 
   PROCESS_BEGIN();
 
+  energy_init();
   ev_post_con_started = process_alloc_event();
+  ev_resolv_done = process_alloc_event();
   ev_post_complete = process_alloc_event();
   ev_sensor_retry_request = process_alloc_event();
+  ev_warmup_probe = process_alloc_event();
 
   /* Initialize the REST engine. */
   /* You need one of these */
@@ -679,6 +1931,12 @@ PROCESS_THREAD(th_12, ev, data)
 
   rplinfo_activate_resources();
   rest_activate_resource(&resource_config);
+  rest_activate_resource(&resource_energy);
+  rest_activate_resource(&resource_profile);
+  rest_activate_resource(&resource_stats);
+#if TH12MAC
+  th12mac_register_tx(post_tx_done);
+#endif
 
   register_dht_result(do_result);
 
@@ -714,18 +1972,37 @@ PROCESS_THREAD(th_12, ev, data)
   gpio_reset(GPIO_43);
 
   /* get the config from flash or make a default config */
-  th12_config_restore(&th12_cfg);
-  if (!th12_config_valid(&th12_cfg)) {
+  cfg_found = th12_config_restore(&th12_cfg);
+  if (!cfg_found) {
     th12_config_set_default(&th12_cfg);
+  }
+  th12_state_restore(&th12_state);
+  /* the old pages have been read, the record store can be formatted over them now */
+  if (th12_legacy || !cfg_found) {
     th12_config_save(&th12_cfg);
   }
+  if (th12_legacy) {
+    th12_state_save(&th12_state);
+    th12_legacy = 0;
+  }
   th12_config_print();
+  post_cycle_init(&cycle);
+  cycle_config();
+  readlog_init();
+  rtt_init(&sink_rtt);
 
   ctimer_set(&ct_ledoff, 5 * CLOCK_SECOND, led_off, NULL);
 
   /* do an initial post on startup */
   /* this will be a "sink check" and will wait for a DAG to be found and force a sink resolv */
-  etimer_set(&et_do_dht, 5 * CLOCK_SECOND);
+  /* with a saved parent there's no discovery to wait for */
+  slot_id = slot_hash(uip_lladdr.addr, sizeof(uip_lladdr.addr));
+  random_init(slot_id);
+  if (rpl_rejoin_start()) {
+    etimer_set(&et_do_dht, REJOIN_FIRST_POST + slot_boot_delay());
+  } else {
+    etimer_set(&et_do_dht, FIRST_POST + slot_boot_delay());
+  }
   ctimer_set(&ct_powerwake, th12_cfg.wake_time * CLOCK_SECOND, set_sleep_ok, NULL);
   ctimer_set(&ct_report_batt, BATTERY_DELAY, set_report_batt_ok, NULL);
 
@@ -733,53 +2010,75 @@ PROCESS_THREAD(th_12, ev, data)
 
     PROCESS_WAIT_EVENT();
 
-    if(ev == PROCESS_EVENT_TIMER && etimer_expired(&et_do_dht)) {
+    if(ev == PROCESS_EVENT_TIMER && data == &et_do_dht) {
+      prof_wake();
       PRINTF("do_dht expired\n\r");
-      PRINTF("sink_ok %d wakes %d failed %d retry %d\n\r", sink_ok, wakes, sink_checks_failed, retry);
-      PRINTF("mod %d\n", wakes % th12_cfg.posts_per_check);
-      next_post = clock_time() + th12_cfg.post_interval * CLOCK_SECOND;
-      etimer_set(&et_do_dht, th12_cfg.post_interval * CLOCK_SECOND);
+      PRINTF("sink_ok %d wakes %d failed %d retry %d\n\r", sink_ok, wakes, cycle.sink_checks_failed, retry);
+      PRINTF("since check %d interval %d\n", cycle.wakes_since_con, cycle.con_interval);
+      slot_schedule();
 
-      if (sink_checks_failed >= th12_cfg.max_post_fails) {
+      if (post_cycle_reboot_due(&cycle)) {
 	if(vbatt > 2700) {
 	  PRINTF("max sink failures reached, rebooting\n\r");
+	  readlog_flush();
 	  CRM->SW_RST = 0x87651234;
 	  while (1) { continue; }
 	} else {
 	  /* If the battery voltage is too low, we can't reboot (has the boost will stop running) */
 	  /* restart RPL and try again... */
-	  sink_checks_failed = 0;
+	  cycle.sink_checks_failed = 0;
 	  rpl_init();
 	}
       }
 
       if(!retry) {
 	wakes++;
+	post_cycle_wake(&cycle);
+	sched_runs = 0;
+	idle_rtc_ticks = 0;
+	sensor_tries = 0;
       }
 
-      if(sleep_ok == 1) {
-	dht_init();
+      /* the sensor was powered when we woke up in go_to_sleep */
+      /* do everything that doesn't need the reading while it warms up */
+      /* the radio is only needed if this wake will post */
+      if(post_cycle_likely(&cycle, resolv_ok, batch_count)) {
+	radio_on();
+      }
 
-	CRM->WU_CNTLbits.EXT_OUT_POL = 0xf; /* drive KBI0-3 high during sleep */
-	rtimer_arch_sleep(2 * rtc_freq);
-	maca_on();
+      adc_service();
+      prof_mark(PROF_ADC);
+      vbatt = adc_voltage(0) * 2;
 
+      if(!retry && post_cycle_check_due(&cycle, resolv_ok)) {
+	sink_check_start();
       }
 
-      if (!retry) {
-	sensor_tries = 0;
+      /* read the sensor once it has warmed up */
+      /* only a fresh power up on a sleepy wake can be used to measure the warm-up */
+      if(sleep_ok == 1 && !warmup_measured && !retry) {
+	warmup_probing = 1;
+	etimer_set(&et_warmup, warmup_left(DHT_WARMUP_MIN));
+      } else {
+	etimer_set(&et_warmup, warmup_left(dht_warmup));
       }
+    }
+
+    if(ev == PROCESS_EVENT_TIMER && data == &et_warmup) {
       process_start(&read_dht, NULL);
     }
 
+    if(ev == ev_warmup_probe) {
+      etimer_set(&et_warmup, DHT_WARMUP_STEP);
+    }
+
     if ( ev == ev_post_con_started) {
       etimer_stop(&et_do_dht);
       PRINTF("stopping do_dht timer: waiting for CON to complete\n\r");
     }
 
     if( ev == ev_post_complete ) {
-      next_post = clock_time() + th12_cfg.post_interval * CLOCK_SECOND;
-      etimer_set(&et_do_dht, th12_cfg.post_interval * CLOCK_SECOND);
+      slot_schedule();
       retry = 0;
       PRINTF("do_dht scheduled\n");
       go_to_sleep(NULL);
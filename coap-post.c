@@ -22,6 +22,7 @@
 /* th-12 */
 #include "th-12.h"
 #include "dht.h"
+#include "msgbuf.h"
 
 /* with default values, coap retransmissions could take up to (2+4+8+16+32 = 62sec) */
 #define POST_INTERVAL (10 * CLOCK_SECOND)
@@ -29,6 +30,7 @@
 /* debug */
 #define DEBUG DEBUG_FULL
 #include "net/uip-debug.h"
+#include "tlog.h"
 
 #define REMOTE_PORT     UIP_HTONS(COAP_DEFAULT_PORT)
 
@@ -40,45 +42,33 @@ static dht_result_t dht_current;
 uip_ipaddr_t server_ipaddr;
 static rpl_dag_t *dag;
 
-char buf[256];
+#define BUF_SIZE 256
+char buf[BUF_SIZE];
 
 uint16_t create_dht_msg(dht_result_t *d, char *buf)
 {
-	rpl_dag_t *dag;
-	uint8_t n = 0;
+	struct msgbuf m;
+	uint16_t n;
 	rimeaddr_t *addr;
-	uint16_t frac_t, int_t;
-	char neg = ' ';
 
 	addr = &rimeaddr_node_addr;
 
-	if(d->t < 0) {
-	  neg = '-';
-	  int_t = (-1 * d->t)/10;
-	  frac_t = (-1 * d->t) % 10;
-	} else {
-	  neg = ' ';
-	  int_t = d->t/10;
-	  frac_t = d->t % 10;
+	/* {"eui":"ec473c4d12bdd1ce","t":" 22.1C","h":"18.3%","vb":"2678mV"} */
+	msgbuf_init(&m, buf, BUF_SIZE);
+	msgbuf_puts(&m, "{\"eui\":\"");
+	msgbuf_put_hex(&m, addr->u8, 8);
+	msgbuf_puts(&m, "\",\"t\":\"");
+	if (d->t >= 0) {
+		msgbuf_putc(&m, ' ');
 	}
-
-	n += sprintf(&(buf[n]),"{\"eui\":\"%02x%02x%02x%02x%02x%02x%02x%02x\",\"t\":\"%c%d.%dC\",\"h\":\"%d.%d%%\",\"vb\":\"%dmV\"}",
-		     addr->u8[0],
-		     addr->u8[1],
-		     addr->u8[2],
-		     addr->u8[3],
-		     addr->u8[4],
-		     addr->u8[5],
-		     addr->u8[6],
-		     addr->u8[7],
-		     neg,
-		     int_t,
-		     frac_t,
-		     d->rh / 10,
-		     d->rh % 10,
-		     adc_vbatt
-		);
-	buf[n] = 0;
+	msgbuf_put_fixed(&m, d->t, 1);
+	msgbuf_puts(&m, "C\",\"h\":\"");
+	msgbuf_put_fixed(&m, d->rh, 1);
+	msgbuf_puts(&m, "%\",\"vb\":\"");
+	msgbuf_put_uint(&m, adc_vbatt);
+	msgbuf_puts(&m, "mV\"}");
+
+	n = msgbuf_finish(&m);
 	PRINTF("buf: %s\n", buf);
 	return n;
 }
@@ -0,0 +1,193 @@
+/* Streaming decoder for the DHT22 pulse train */
+
+/* The sensor answers a start request with an 80us low, an 80us high, and */
+/* then 40 bits. Each bit is a 50us low followed by a high whose width */
+/* encodes the value: 26-28us for a 0 and 70us for a 1. */
+
+/* The decoder is called for every edge and packs each bit as soon as its */
+/* falling edge arrives, so the result is ready the moment the last bit lands. */
+
+/* The sensor's timing drifts with temperature and supply voltage, so the */
+/* 0/1 threshold is not fixed. It is scaled from the width of the 80us */
+/* response pulse of each read. Once the frame is in, the threshold is */
+/* refined from the two clusters of pulse widths and the bits are repacked */
+/* if that is what makes the checksum pass. */
+
+#include "dht-decode.h"
+
+/* number of 2-means iterations when refining the threshold */
+#define REFINE_PASSES 4
+
+static uint8_t checksum_ok(const uint8_t *dht)
+{
+	return dht[4] == (uint8_t)(dht[0] + dht[1] + dht[2] + dht[3]);
+}
+
+static void pack(const uint8_t *width, uint8_t thresh, uint8_t *dht)
+{
+	uint8_t i;
+
+	for (i = 0; i < DHT_BYTES; i++) {
+		dht[i] = 0;
+	}
+	for (i = 0; i < DHT_BITS; i++) {
+		dht[i / 8] <<= 1;
+		if (width[i] >= thresh) {
+			dht[i / 8] |= 1;
+		}
+	}
+}
+
+void dht_decode_init(struct dht_decoder *dec)
+{
+	uint8_t i;
+
+	for (i = 0; i < DHT_BYTES; i++) {
+		dec->dht[i] = 0;
+	}
+	dec->nbits = 0;
+	dec->rise_ok = 0;
+	dec->fall_ok = 0;
+	dec->low = 0;
+	dec->preamble = 0;
+	dec->thresh = 0;
+	dec->conf = 0;
+	dec->state = DHT_STATE_PREAMBLE;
+}
+
+int dht_decode_edge(struct dht_decoder *dec, uint8_t level, uint16_t capt)
+{
+	uint16_t width;
+
+	if (dec->state == DHT_STATE_IDLE || dec->state == DHT_STATE_DONE) {
+		return DHT_DECODE_MORE;
+	}
+
+	if (level) {
+		/* rising edge: measure the low pulse that just ended */
+		dec->low = 0;
+		if (dec->fall_ok) {
+			width = (uint16_t)(capt - dec->fall);
+			dec->low = (width > 0xff) ? 0xff : width;
+		}
+		dec->fall_ok = 0;
+		dec->rise = capt;
+		dec->rise_ok = 1;
+		return DHT_DECODE_MORE;
+	}
+
+	/* falling edge */
+	dec->fall = capt;
+	dec->fall_ok = 1;
+	if (!dec->rise_ok) {
+		return DHT_DECODE_MORE;
+	}
+	dec->rise_ok = 0;
+	width = (uint16_t)(capt - dec->rise);
+
+	if (dec->state == DHT_STATE_PREAMBLE) {
+		/* the response is a long high after a long low */
+		/* this skips the host release pulse, the idle line */
+		/* and any bit whose 50us low was captured */
+		if (width >= DHT_PREAMBLE_MIN && width <= DHT_PULSE_MAX &&
+		    (dec->low == 0 || dec->low >= DHT_PREAMBLE_MIN)) {
+			dec->preamble = width;
+			dec->thresh = (dec->preamble * DHT_THRESH_SCALE) >> 8;
+			dec->state = DHT_STATE_DATA;
+		}
+		return DHT_DECODE_MORE;
+	}
+
+	/* threshold the pulse into a bit and pack it */
+	dec->width[dec->nbits] = (width > 0xff) ? 0xff : width;
+	dec->dht[dec->nbits / 8] <<= 1;
+	if (width >= dec->thresh) {
+		dec->dht[dec->nbits / 8] |= 1;
+	}
+
+	if (++dec->nbits >= DHT_BITS) {
+		dec->state = DHT_STATE_DONE;
+		return DHT_DECODE_DONE;
+	}
+
+	return DHT_DECODE_MORE;
+}
+
+void dht_decode_finish(struct dht_decoder *dec)
+{
+	uint8_t i, pass;
+	uint8_t thresh, margin, half;
+	uint16_t sum0, sum1, n0, n1;
+	uint16_t m0 = 0, m1 = 0;
+	uint8_t dht[DHT_BYTES];
+
+	if (dec->state != DHT_STATE_DONE) {
+		dec->conf = 0;
+		return;
+	}
+
+	/* 2-means on the pulse widths, starting from the preamble threshold */
+	thresh = dec->thresh;
+	for (pass = 0; pass < REFINE_PASSES; pass++) {
+		sum0 = sum1 = n0 = n1 = 0;
+		for (i = 0; i < DHT_BITS; i++) {
+			if (dec->width[i] >= thresh) {
+				sum1 += dec->width[i]; n1++;
+			} else {
+				sum0 += dec->width[i]; n0++;
+			}
+		}
+		if (n0 == 0 || n1 == 0) {
+			break;
+		}
+		m0 = sum0 / n0;
+		m1 = sum1 / n1;
+		if ((uint8_t)((m0 + m1) / 2) == thresh) {
+			break;
+		}
+		thresh = (m0 + m1) / 2;
+	}
+
+	if (n0 == 0 || n1 == 0) {
+		/* one cluster is empty: fall back to the nominal pulse widths */
+		m0 = (dec->preamble * 27) / 80;
+		m1 = (dec->preamble * 70) / 80;
+		thresh = dec->thresh;
+	}
+
+	/* prefer the refined threshold, keep the streamed bits if only they pass */
+	if (thresh != dec->thresh) {
+		pack(dec->width, thresh, dht);
+		if (checksum_ok(dht) || !checksum_ok(dec->dht)) {
+			for (i = 0; i < DHT_BYTES; i++) {
+				dec->dht[i] = dht[i];
+			}
+			dec->thresh = thresh;
+		}
+	}
+
+	/* confidence: how close the worst pulse came to the threshold */
+	/* relative to half the distance between the two clusters */
+	half = (m1 > m0) ? (m1 - m0) / 2 : 0;
+	margin = 0xff;
+	for (i = 0; i < DHT_BITS; i++) {
+		uint8_t d;
+		d = (dec->width[i] >= dec->thresh) ?
+			dec->width[i] - dec->thresh : dec->thresh - dec->width[i];
+		if (d < margin) {
+			margin = d;
+		}
+	}
+	if (half == 0) {
+		dec->conf = 0;
+	} else if (margin >= half) {
+		dec->conf = 100;
+	} else {
+		dec->conf = ((uint16_t)margin * 100) / half;
+	}
+}
+
+int dht_decode_ok(const struct dht_decoder *dec)
+{
+	return (dec->state == DHT_STATE_DONE) && checksum_ok(dec->dht);
+}
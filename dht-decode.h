@@ -0,0 +1,61 @@
+#ifndef __DHT_DECODE_H__
+#define __DHT_DECODE_H__
+
+#include <stdint.h>
+
+/* streaming decoder for the DHT22 pulse train */
+/* fed one edge at a time from tmr1_isr() */
+/* has no hardware dependencies so recorded edge timestamps can be replayed through it on a host */
+
+#define DHT_BYTES 5                /* number of bytes returned by dht */
+#define DHT_BITS (DHT_BYTES * 8)   /* number of bits returned by dht */
+
+/* pulse widths are in TMR1 ticks: 24MHz / 16 = 1.5 ticks per us */
+#define DHT_PREAMBLE_MIN 90        /* the dht answers with an 80us low and an 80us high before the first bit */
+#define DHT_PULSE_MAX 300          /* anything longer is the idle line, not part of a frame */
+
+/* a 0 is 26-28us and a 1 is 70us, the midpoint is 0.606 of the 80us preamble */
+#define DHT_THRESH_SCALE 155       /* threshold = preamble * DHT_THRESH_SCALE / 256 */
+
+enum {
+	DHT_STATE_IDLE,            /* not reading, ignore edges */
+	DHT_STATE_PREAMBLE,        /* waiting for the 80us response pulse */
+	DHT_STATE_DATA,            /* packing data bits */
+	DHT_STATE_DONE,            /* 40 bits received */
+};
+
+enum {
+	DHT_DECODE_MORE,           /* frame not complete yet */
+	DHT_DECODE_DONE,           /* this edge completed the frame */
+};
+
+struct dht_decoder {
+	uint16_t rise;             /* capture time of the last rising edge */
+	uint16_t fall;             /* capture time of the last falling edge */
+	uint16_t preamble;         /* width of the response pulse, up to DHT_PULSE_MAX */
+	uint8_t rise_ok;           /* rise holds a valid time */
+	uint8_t fall_ok;           /* fall holds a valid time */
+	uint8_t low;               /* width of the last low pulse, 0 if unknown */
+	uint8_t state;             /* one of DHT_STATE_* */
+	uint8_t nbits;             /* number of bits packed so far */
+	uint8_t thresh;            /* 0/1 threshold for this read */
+	uint8_t conf;              /* classifier confidence 0-100, set by dht_decode_finish() */
+	uint8_t width[DHT_BITS];   /* high pulse widths, kept to refine the threshold */
+	uint8_t dht[DHT_BYTES];    /* [humid hi, humid lo, temp hi, temp lo, checksum] */
+};
+
+/* reset the decoder and start looking for a new frame */
+void dht_decode_init(struct dht_decoder *dec);
+
+/* feed one edge: level is the pin level after the edge, capt the capture time */
+/* returns DHT_DECODE_DONE exactly once, on the edge that completes the 40th bit */
+int dht_decode_edge(struct dht_decoder *dec, uint8_t level, uint16_t capt);
+
+/* refine the threshold from the pulse width distribution and compute the confidence */
+/* call once the frame is done, outside of interrupt context */
+void dht_decode_finish(struct dht_decoder *dec);
+
+/* 1 if a full frame was received and the checksum matches */
+int dht_decode_ok(const struct dht_decoder *dec);
+
+#endif /*__DHT_DECODE_H__*/
@@ -11,6 +11,9 @@
 #include "contiki.h"
 #include "th-12.h"
 #include "dht.h"
+#include "dht-decode.h"
+#include "energy.h"
+#include "prof.h"
 
 #include "mc1322x.h"
 
@@ -22,32 +25,31 @@
 #define setdo(x) GPIO->PAD_DIR_SET.x=1
 #define setdi(x) GPIO->PAD_DIR_RESET.x=1
 
-#define MAX_SAMPLES 64
-uint16_t dht_time[MAX_SAMPLES]; /* dht11 returns 40 pulses, allocate a little extra just in case */
-uint8_t dht_idx;                /* current index into the results buffer */
+/* decoder state, written by tmr1_isr() as edges arrive */
+static struct dht_decoder dht_dec;
 
-#define DHT_BYTES 5             /* number of bytes returned by dht */
-#define DHT_BITS DHT_BYTES * 8  /* number of bits returned by dht */
-#define DHT_THRESH 83           /* threshold pulse width between high and low value */
-uint8_t dht[DHT_BYTES];
+/* how long to wait for the dht to answer before giving up */
+/* a full frame takes about 5ms */
+#define DHT_TIMEOUT (0.05 * CLOCK_SECOND)
 
 /* capture both rising and falling edges */
 /* toggle IPS accordingly so that we get an interrupt on each edge (sometime after the capture) */
-/* we save the time on the rising edge */
-/* and compute the difference after the falling edge */ 
+/* each edge is handed to the decoder which packs a bit on every falling edge */
+/* read_dht is polled as soon as the last bit lands */
 
 void tmr1_isr(void) {
 	if(TMR1->SCTRLbits.IEF == 1) {
+		prof_mark(PROF_EDGE);
 		if ( GPIO->DATA.TMR1 == 1) {
 			/* rising edge */
 			TMR1->SCTRLbits.IPS = 1; /* pin is high, trigger interrupt on falling edge */
-			dht_time[dht_idx] = *TMR1_CAPT; /* save rising edge time */
+			dht_decode_edge(&dht_dec, 1, *TMR1_CAPT);
 		} else {
 			/* falling edge */			
 			TMR1->SCTRLbits.IPS = 0; /* pin is low, trigger interrupt on rising edge */
-			/* compute the delta T and increment the pointer */
-			dht_time[dht_idx] = (uint16_t)(*TMR1_CAPT - dht_time[dht_idx]);
-			if(dht_idx++ >= MAX_SAMPLES) { dht_idx = 0; }
+			if (dht_decode_edge(&dht_dec, 0, *TMR1_CAPT) == DHT_DECODE_DONE) {
+				process_poll(&read_dht);
+			}
 		}
 	}
 	TMR1->SCTRLbits.IEF = 0;
@@ -90,13 +92,20 @@ void tmr1_init(void) {
 }
 
 /* signals the dht to send data back */
-/* waits for the result */
+/* waits for the decoder to finish or time out */
 /* posts a dht_done event with a dht result struct in data */
 
 struct etimer et_dht;
 
 void (*dht_result)(dht_result_t d);
 
+/* when the sensor was last powered on */
+static clock_time_t dht_powered;
+
+clock_time_t dht_power_time(void) {
+	return dht_powered;
+}
+
 void register_dht_result( void (*dht_result_cb) ) {
 	dht_result = dht_result_cb;
 }
@@ -105,101 +114,58 @@ PROCESS(read_dht, "read dht");
 PROCESS_THREAD(read_dht, ev, data)
 {
 	dht_result_t d;
-	uint8_t bit_offset;
+	uint8_t *dht;
 	PROCESS_BEGIN();
 	
 	PRINTF("pulling low to start dht\n\r");
-	dht_idx = 0;
+	dht_decode_init(&dht_dec);
 
 	/* keep pin low for at least 18ms */
 	gpio_reset(TMR1);
 	etimer_set(&et_dht, 0.01 * CLOCK_SECOND);
-	while (!etimer_expired(&et_dht)) { PROCESS_PAUSE(); }
-
-	/* pull high */
-	/* PRINTF("pulling high\n\r"); */
-	/* gpio_set(TMR1); */
-	/* etimer_set(&et_dht, 0.01 * CLOCK_SECOND); */
-	/* while (!etimer_expired(&et_dht)) { PROCESS_PAUSE(); } */
+	PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et_dht));
 
 	PRINTF("set high impedance to start listening\n\r");
 	DHT_PU();
 
-	/* wait for the DHT to finish */
-	etimer_set(&et_dht, 0.05 * CLOCK_SECOND);
-	while (!etimer_expired(&et_dht)) { PROCESS_PAUSE(); }
+	/* the isr polls us when the last bit is in */
+	etimer_set(&et_dht, DHT_TIMEOUT);
+	PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || etimer_expired(&et_dht));
+	etimer_stop(&et_dht);
 	
 	PRINTF("transmission over, pulling high again\n\r");
 	DHT_OUT();
 	gpio_set(TMR1);
-	PRINTF("data:  ");
-	{
-		uint8_t i;
-		uint8_t val;
-
-		/* initialize the dht results */
-		for (i = 0; i < DHT_BYTES; i++) {
-			dht[i] = 0;
-		}
 
-#ifdef DEBUG_FULL
-		/* print the raw timing data */
-		for (i = 0; i < MAX_SAMPLES; i ++) {
-			PRINTF("%d ", dht_time[i]);					
-		}
-		PRINTF("\n\r");
-#endif
-
-		/* find the first pulse */
-		/* while running data looks like: data: 55400 122 40 ... */
-		/* on power up though, we get: data:  122 40 40 40 */
-		if(dht_time[0] > 5000) {
-			bit_offset = 2;
-		} else {
-			bit_offset = 1;
-		}
+	dht_decode_finish(&dht_dec);
+	prof_mark(PROF_DECODED);
+	d.conf = dht_dec.conf;
+
+	dht = dht_dec.dht;
+	PRINTF("bits: %d preamble: %d thresh: %d conf: %d\n\r", dht_dec.nbits, dht_dec.preamble, dht_dec.thresh, dht_dec.conf);
+	PRINTF("%02x %02x %02x %02x %02x\n\r", dht[0], dht[1], dht[2], dht[3], dht[4]);
+	PRINTF("sum = %04x\n\r", dht[0] + dht[1] + dht[2] + dht[3]);
 
-		/* convert pulse width encoded data in to bits */
-		/* and pack them into bytes */
-		for (i = bit_offset; i < DHT_BITS + bit_offset; i ++) {
-#ifdef DEBUG_FULL
-			/* print packed bytes */
-			if(((i-bit_offset) % 8) == 0 && (i-bit_offset > 7)) { PRINTF(" = 0x%02x\n\r", dht[((i-bit_offset)/8) - 1]); }
-#endif
-			
-			/* threshold times into bits */
-			if (dht_time[i] < DHT_THRESH) { val = 0; } else { val = 1; } 
-
-			PRINTF("%d", val);
-
-			/* pack */
-			dht[(i-bit_offset)/8] <<= 1;
-			dht[(i-bit_offset)/8] |= val;
-		}				
-		PRINTF(" = 0x%02x\n\r", dht[4]);
-		PRINTF("%02x %02x %02x %02x %02x\n\r", dht[0], dht[1], dht[2], dht[3], dht[4]);
-		PRINTF("sum = %04x\n\r", dht[0] + dht[1] + dht[2] + dht[3]);
-		
-		if( dht_result && (dht[4] == (uint8_t)(dht[0] + dht[1] + dht[2] + dht[3]))) { 
-		  int16_t temp;
-		  uint16_t t;
-		  d.ok = 1;
-		  d.rh = dht[0] << 8 | dht[1];
-
-		  t = (dht[2] & 0x7f) << 8 | dht[3];
-		  if (dht[2] & 0x80) {
-		    temp = -1 * t;
-		  } else {
-		    temp = t;
-		  }
-		  d.t = temp;
-		  dht_result(d);
+	if (dht_decode_ok(&dht_dec)) {
+		int16_t temp;
+		uint16_t t;
+		d.ok = 1;
+		d.rh = dht[0] << 8 | dht[1];
+
+		t = (dht[2] & 0x7f) << 8 | dht[3];
+		if (dht[2] & 0x80) {
+			temp = -1 * t;
 		} else {
-			d.ok = 0;
-			dht_result(d);
+			temp = t;
 		}
+		d.t = temp;
+	} else {
+		d.ok = 0;
+	}
+	dht_dec.state = DHT_STATE_IDLE;
 
-		PROCESS_EXIT();
+	if (dht_result) {
+		dht_result(d);
 	}
 	
 	PROCESS_END();
@@ -212,6 +178,8 @@ void dht_init(void)
 	setdo(KBI1);
 	GPIO->FUNC_SEL.KBI1=3;
 	gpio_set(KBI1);
+	dht_powered = clock_time();
+	energy_on(ENERGY_SENSOR);
 
 	/* set data pin */
 	setdo(TMR1);
@@ -226,6 +194,7 @@ void dht_uninit(void)
 {
 	CRM->WU_CNTLbits.EXT_OUT_POL = 0; /* drive KBI0-3 low during sleep */
 	gpio_reset(KBI1);
+	energy_off(ENERGY_SENSOR);
 	setdo(TMR1);
 	gpio_set(TMR1);
 }
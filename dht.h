@@ -19,12 +19,16 @@ typedef struct dht_result {
 	uint16_t rh; /* relative humidity in % * 10 */
 	int16_t t;   /* temp in C * 10 */
 	uint8_t ok;  /* equals 1 if checksum was ok */
+	uint8_t conf; /* bit classifier confidence 0-100 */
 } dht_result_t;
 
 PROCESS_NAME(read_dht);
 
 void dht_init(void);
 
+/* clock time of the last dht_init(): the sensor needs to warm up after this */
+clock_time_t dht_power_time(void);
+
 /* register a function to be called when the dht has a result */
 /* the callback takes a dht_result_t */
 /* void (*dht_result)(dht_result_t d); */
@@ -0,0 +1,98 @@
+/* power state accounting, see energy.h */
+
+#include "contiki.h"
+#include "mc1322x.h"
+
+#include "platform_stats.h"
+#include "energy.h"
+#if TH12MAC
+#include "th12mac.h"
+#endif
+
+static uint64_t total[ENERGY_METERS];
+static uint32_t since[ENERGY_METERS];
+static uint8_t running;
+
+/* the rtc count is 32 bits, uptime is carried forward on every call */
+/* a sleep is at most one post interval so it can't wrap in between */
+static uint64_t uptime;
+static uint32_t last;
+
+static uint32_t now(void)
+{
+	uint32_t t = CRM->RTC_COUNT;
+
+	uptime += t - last;
+	last = t;
+	return t;
+}
+
+static uint64_t to_ms(uint64_t ticks)
+{
+	return ticks * 1000 / rtc_freq;
+}
+
+void energy_init(void)
+{
+	uint8_t m;
+
+	for (m = 0; m < ENERGY_METERS; m++) {
+		total[m] = 0;
+	}
+	running = 0;
+	uptime = 0;
+	last = CRM->RTC_COUNT;
+	energy_on(ENERGY_RADIO);
+	energy_on(ENERGY_SENSOR);
+}
+
+void energy_on(uint8_t meter)
+{
+	uint32_t t = now();
+
+	if (!(running & (1 << meter))) {
+		since[meter] = t;
+		running |= 1 << meter;
+	}
+}
+
+void energy_off(uint8_t meter)
+{
+	uint32_t t = now();
+
+	if (running & (1 << meter)) {
+		total[meter] += t - since[meter];
+		running &= ~(1 << meter);
+	}
+}
+
+uint64_t energy_ms(uint8_t meter)
+{
+	uint32_t t = now();
+	uint64_t ticks = total[meter];
+
+	if (running & (1 << meter)) {
+		ticks += t - since[meter];
+	}
+	return to_ms(ticks);
+}
+
+uint64_t energy_uptime_ms(void)
+{
+	now();
+	return to_ms(uptime);
+}
+
+uint64_t energy_idle_ms(void)
+{
+	return to_ms(idle_rtc_total);
+}
+
+uint64_t energy_tx_ms(void)
+{
+#if TH12MAC
+	return to_ms(th12mac_tx_rtc);
+#else
+	return 0;
+#endif
+}
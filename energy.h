@@ -0,0 +1,37 @@
+#ifndef __ENERGY_H__
+#define __ENERGY_H__
+
+#include <stdint.h>
+
+/* where the battery goes: time spent in each power state since boot */
+/* counted in rtc ticks, which keep running in deep sleep, and kept in */
+/* 64 bits so nothing wraps. Meters can overlap: the radio, sensor and */
+/* flash draw on top of whatever the MCU is doing */
+
+enum {
+	ENERGY_SLEEP,               /* hibernating between posts */
+	ENERGY_RADIO,               /* radio on, receiving or sending */
+	ENERGY_SENSOR,              /* sensor powered */
+	ENERGY_FLASH,               /* nvm erase or program */
+	ENERGY_METERS,
+};
+
+/* the radio and sensor are on at boot, so are their meters */
+void energy_init(void);
+
+void energy_on(uint8_t meter);
+void energy_off(uint8_t meter);
+
+/* ms the meter has been on, including the current stretch */
+uint64_t energy_ms(uint8_t meter);
+
+/* ms since energy_init() */
+uint64_t energy_uptime_ms(void);
+
+/* ms the MCU dozed in the idle loop, from the platform's counter */
+uint64_t energy_idle_ms(void);
+
+/* ms the radio spent sending, 0 if the MAC doesn't count it */
+uint64_t energy_tx_ms(void);
+
+#endif /* __ENERGY_H__ */
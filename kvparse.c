@@ -0,0 +1,212 @@
+/* flat JSON and CBOR map parsers, see kvparse.h */
+
+#include <string.h>
+
+#include "kvparse.h"
+#include "msgbuf.h"
+
+struct in {
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+static void skip_ws(struct in *in)
+{
+	while (in->p < in->end &&
+	       (*in->p == ' ' || *in->p == '\t' || *in->p == '\r' || *in->p == '\n')) {
+		in->p++;
+	}
+}
+
+/* a JSON string without escapes, returns its length or -1 */
+static int json_string(struct in *in, const char **s)
+{
+	const uint8_t *start;
+
+	if (in->p >= in->end || *in->p != '"') {
+		return -1;
+	}
+	start = ++in->p;
+	while (in->p < in->end && *in->p != '"') {
+		if (*in->p == '\\') {
+			return -1;
+		}
+		in->p++;
+	}
+	if (in->p >= in->end) {
+		return -1;
+	}
+	*s = (const char *)start;
+	return in->p++ - start;
+}
+
+/* a string, number or true/false as text in value */
+static int json_value(struct in *in, char *value)
+{
+	const char *s;
+	int n;
+
+	if (in->p < in->end && *in->p == '"') {
+		n = json_string(in, &s);
+	} else {
+		s = (const char *)in->p;
+		while (in->p < in->end && *in->p != ',' && *in->p != '}' &&
+		       *in->p != ' ' && *in->p != '\t' && *in->p != '\r' && *in->p != '\n') {
+			in->p++;
+		}
+		n = (const char *)in->p - s;
+		if (n == 4 && strncmp(s, "true", 4) == 0) {
+			s = "1";
+			n = 1;
+		} else if (n == 5 && strncmp(s, "false", 5) == 0) {
+			s = "0";
+			n = 1;
+		} else if (n == 0 || *s == '{' || *s == '[') {
+			return -1;
+		}
+	}
+	if (n < 0 || n >= KV_VALUE_MAX) {
+		return -1;
+	}
+	memcpy(value, s, n);
+	value[n] = 0;
+	return 0;
+}
+
+int kv_parse_json(const uint8_t *p, uint16_t len, kv_func_t f, void *ctx)
+{
+	struct in in = { p, p + len };
+	char value[KV_VALUE_MAX];
+	const char *key;
+	int keylen, r;
+
+	skip_ws(&in);
+	if (in.p >= in.end || *in.p++ != '{') {
+		return -1;
+	}
+	skip_ws(&in);
+	if (in.p < in.end && *in.p == '}') {
+		return 0;
+	}
+	while (1) {
+		skip_ws(&in);
+		keylen = json_string(&in, &key);
+		if (keylen < 0 || keylen > 255) {
+			return -1;
+		}
+		skip_ws(&in);
+		if (in.p >= in.end || *in.p++ != ':') {
+			return -1;
+		}
+		skip_ws(&in);
+		if (json_value(&in, value) < 0) {
+			return -1;
+		}
+		if ((r = f(key, keylen, value, ctx)) != 0) {
+			return r;
+		}
+		skip_ws(&in);
+		if (in.p >= in.end) {
+			return -1;
+		}
+		if (*in.p == '}') {
+			return 0;
+		}
+		if (*in.p++ != ',') {
+			return -1;
+		}
+	}
+}
+
+/* major type and argument of the next CBOR item, -1 if it isn't supported */
+static int cbor_head(struct in *in, uint8_t *major, uint32_t *arg)
+{
+	uint8_t ai, n;
+
+	if (in->p >= in->end) {
+		return -1;
+	}
+	*major = *in->p >> 5;
+	ai = *in->p++ & 0x1f;
+	if (ai < 24) {
+		*arg = ai;
+		return 0;
+	}
+	if (ai > 26) {
+		/* 8 byte arguments and indefinite lengths */
+		return -1;
+	}
+	n = 1 << (ai - 24);
+	if (in->end - in->p < n) {
+		return -1;
+	}
+	*arg = 0;
+	while (n--) {
+		*arg = (*arg << 8) | *in->p++;
+	}
+	return 0;
+}
+
+int kv_parse_cbor(const uint8_t *p, uint16_t len, kv_func_t f, void *ctx)
+{
+	struct in in = { p, p + len };
+	char value[KV_VALUE_MAX];
+	struct msgbuf m;
+	const char *key;
+	uint8_t major;
+	uint32_t npairs, arg, keylen;
+	int r;
+
+	if (cbor_head(&in, &major, &npairs) < 0 || major != 5) {
+		return -1;
+	}
+	while (npairs--) {
+		/* text key */
+		if (cbor_head(&in, &major, &keylen) < 0 || major != 3 ||
+		    keylen > 255 || (uint32_t)(in.end - in.p) < keylen) {
+			return -1;
+		}
+		key = (const char *)in.p;
+		in.p += keylen;
+
+		if (cbor_head(&in, &major, &arg) < 0) {
+			return -1;
+		}
+		switch (major) {
+		case 0:              /* unsigned, msgbuf converts it without a divide */
+			msgbuf_init(&m, value, sizeof(value));
+			msgbuf_put_uint(&m, arg);
+			msgbuf_finish(&m);
+			break;
+		case 3:              /* text */
+			if (arg >= KV_VALUE_MAX || (uint32_t)(in.end - in.p) < arg) {
+				return -1;
+			}
+			memcpy(value, in.p, arg);
+			value[arg] = 0;
+			in.p += arg;
+			break;
+		case 7:              /* false and true */
+			if (arg != 20 && arg != 21) {
+				return -1;
+			}
+			value[0] = (arg == 21) ? '1' : '0';
+			value[1] = 0;
+			break;
+		default:
+			return -1;
+		}
+		if ((r = f(key, keylen, value, ctx)) != 0) {
+			return r;
+		}
+	}
+	return 0;
+}
+
+int kv_parse(const uint8_t *p, uint16_t len, kv_func_t f, void *ctx)
+{
+	if (len > 0 && (p[0] & 0xe0) == 0xa0) {
+		return kv_parse_cbor(p, len, f, ctx);
+	}
+	return kv_parse_json(p, len, f, ctx);
+}
@@ -0,0 +1,24 @@
+#ifndef __KVPARSE_H__
+#define __KVPARSE_H__
+
+#include <stdint.h>
+
+/* parsers for a flat map of keys to scalar values, as JSON or CBOR */
+/* {"netloc":"sink.local","interval":300} or the same as a CBOR map */
+/* values are handed over as NUL terminated text: numbers in decimal */
+/* and true/false as 1/0. Nested values aren't supported */
+
+#define KV_VALUE_MAX 48            /* longest value, with the NUL */
+
+/* called for each pair, returns 0 to go on or anything else to stop */
+typedef int (*kv_func_t)(const char *key, uint8_t keylen, const char *value, void *ctx);
+
+/* return 0 if the whole map was parsed, -1 on a syntax error */
+/* or whatever non-zero value f returned */
+int kv_parse_json(const uint8_t *p, uint16_t len, kv_func_t f, void *ctx);
+int kv_parse_cbor(const uint8_t *p, uint16_t len, kv_func_t f, void *ctx);
+
+/* picks the parser from the first byte: '{' or a CBOR map */
+int kv_parse(const uint8_t *p, uint16_t len, kv_func_t f, void *ctx);
+
+#endif /* __KVPARSE_H__ */
@@ -0,0 +1,137 @@
+/* bounds-checked message writer, see msgbuf.h */
+
+#include "msgbuf.h"
+
+static const uint32_t pow10[] = {
+	1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1,
+};
+#define POW10_N (sizeof(pow10) / sizeof(pow10[0]))
+
+static const char hexdigit[] = "0123456789abcdef";
+
+void msgbuf_init(struct msgbuf *m, char *buf, uint16_t size)
+{
+	m->buf = buf;
+	m->len = 0;
+	m->size = size ? size - 1 : 0;
+	m->overflow = 0;
+}
+
+void msgbuf_putc(struct msgbuf *m, char c)
+{
+	if (m->len < m->size) {
+		m->buf[m->len++] = c;
+	} else {
+		m->overflow = 1;
+	}
+}
+
+void msgbuf_puts(struct msgbuf *m, const char *s)
+{
+	while (*s) {
+		msgbuf_putc(m, *s++);
+	}
+}
+
+/* at least min digits, by repeated subtraction since the arm7 has no divide */
+static void put_digits(struct msgbuf *m, uint32_t v, uint8_t min)
+{
+	uint8_t i, started = 0;
+	char d;
+
+	for (i = 0; i < POW10_N; i++) {
+		d = '0';
+		while (v >= pow10[i]) {
+			v -= pow10[i];
+			d++;
+		}
+		if (d != '0' || started || POW10_N - i <= min) {
+			msgbuf_putc(m, d);
+			started = 1;
+		}
+	}
+}
+
+void msgbuf_put_uint(struct msgbuf *m, uint32_t v)
+{
+	put_digits(m, v, 1);
+}
+
+void msgbuf_put_int(struct msgbuf *m, int32_t v)
+{
+	if (v < 0) {
+		msgbuf_putc(m, '-');
+		put_digits(m, -(uint32_t)v, 1);
+	} else {
+		put_digits(m, v, 1);
+	}
+}
+
+void msgbuf_put_fixed(struct msgbuf *m, int32_t v, uint8_t decimals)
+{
+	uint32_t u, ipart;
+	uint8_t i;
+
+	if (decimals == 0 || decimals >= POW10_N) {
+		msgbuf_put_int(m, v);
+		return;
+	}
+
+	if (v < 0) {
+		msgbuf_putc(m, '-');
+		u = -(uint32_t)v;
+	} else {
+		u = v;
+	}
+
+	/* split at the decimal point */
+	ipart = 0;
+	while (u >= pow10[POW10_N - 1 - decimals]) {
+		u -= pow10[POW10_N - 1 - decimals];
+		ipart++;
+	}
+	put_digits(m, ipart, 1);
+	msgbuf_putc(m, '.');
+	for (i = decimals; i > 0; i--) {
+		char d = '0';
+		while (u >= pow10[POW10_N - i]) {
+			u -= pow10[POW10_N - i];
+			d++;
+		}
+		msgbuf_putc(m, d);
+	}
+}
+
+void msgbuf_put_hex(struct msgbuf *m, const uint8_t *bytes, uint8_t n)
+{
+	while (n--) {
+		msgbuf_putc(m, hexdigit[*bytes >> 4]);
+		msgbuf_putc(m, hexdigit[*bytes & 0xf]);
+		bytes++;
+	}
+}
+
+void msgbuf_put_hex16(struct msgbuf *m, uint16_t v)
+{
+	int8_t shift;
+	uint8_t started = 0;
+
+	for (shift = 12; shift >= 0; shift -= 4) {
+		uint8_t d = (v >> shift) & 0xf;
+		if (d || started || shift == 0) {
+			msgbuf_putc(m, hexdigit[d]);
+			started = 1;
+		}
+	}
+}
+
+uint16_t msgbuf_len(struct msgbuf *m)
+{
+	return m->overflow ? 0 : m->len;
+}
+
+uint16_t msgbuf_finish(struct msgbuf *m)
+{
+	m->buf[m->len] = 0;
+	return msgbuf_len(m);
+}
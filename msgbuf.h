@@ -0,0 +1,41 @@
+#ifndef __MSGBUF_H__
+#define __MSGBUF_H__
+
+#include <stdint.h>
+
+/* bounds-checked message writer for post payloads */
+/* replaces sprintf in the payload builders: no formatted i/o code is */
+/* linked in and the decimal conversion needs no division */
+/* writes stop at the end of the buffer and set overflow */
+
+struct msgbuf {
+	char *buf;
+	uint16_t len;
+	uint16_t size;     /* usable bytes, one is kept back for the terminator */
+	uint8_t overflow;
+};
+
+/* size is the full size of buf and must be at least 1 */
+void msgbuf_init(struct msgbuf *m, char *buf, uint16_t size);
+
+void msgbuf_putc(struct msgbuf *m, char c);
+void msgbuf_puts(struct msgbuf *m, const char *s);
+
+/* decimal integers */
+void msgbuf_put_uint(struct msgbuf *m, uint32_t v);
+void msgbuf_put_int(struct msgbuf *m, int32_t v);
+
+/* fixed-point decimal: v / 10^decimals, e.g. (221, 1) is 22.1 and (-5, 1) is -0.5 */
+void msgbuf_put_fixed(struct msgbuf *m, int32_t v, uint8_t decimals);
+
+/* lowercase hex: n bytes with two digits each, or a 16 bit word without leading zeros */
+void msgbuf_put_hex(struct msgbuf *m, const uint8_t *bytes, uint8_t n);
+void msgbuf_put_hex16(struct msgbuf *m, uint16_t v);
+
+/* length written so far, 0 if anything didn't fit */
+uint16_t msgbuf_len(struct msgbuf *m);
+
+/* nul terminate and return the length, 0 if anything didn't fit */
+uint16_t msgbuf_finish(struct msgbuf *m);
+
+#endif /* __MSGBUF_H__ */
@@ -0,0 +1,197 @@
+/* post cycle decisions, see post-cycle.h */
+
+#include <string.h>
+
+#include "post-cycle.h"
+#include "th12-post.h"
+
+/* a sink check is a CON post plus a fresh resolv of the sink. The number */
+/* of wakes between checks doubles after every good check, up to */
+/* posts_per_check, and drops back to 1 as soon as a post fails to reach */
+/* the parent or a check fails. NON posts that stop getting answers halve it */
+/* so the failure is confirmed sooner */
+
+void post_cycle_init(struct post_cycle *c)
+{
+	struct post_cycle_cfg cfg = c->cfg;
+
+	memset(c, 0, sizeof(*c));
+	c->cfg = cfg;
+	c->con_interval = 1;
+}
+
+void post_cycle_wake(struct post_cycle *c)
+{
+	c->wakes_since_con++;
+}
+
+uint8_t post_cycle_check_due(struct post_cycle *c, int8_t resolv_ok)
+{
+	return !resolv_ok || c->wakes_since_con >= c->con_interval;
+}
+
+void post_cycle_probe(struct post_cycle *c, uint16_t interval)
+{
+	if (interval < c->con_interval) {
+		c->con_interval = interval;
+		c->con_probes++;
+	}
+}
+
+void post_cycle_check_result(struct post_cycle *c, uint8_t ok)
+{
+	if (ok) {
+		if (c->con_interval < c->cfg.posts_per_check) {
+			c->con_interval <<= 1;
+		}
+		if (c->con_interval > c->cfg.posts_per_check) {
+			c->con_interval = c->cfg.posts_per_check;
+		}
+	} else {
+		c->cons_failed++;
+		c->con_interval = 1;
+	}
+}
+
+void post_cycle_failed(struct post_cycle *c)
+{
+	c->sink_checks_failed++;
+}
+
+uint8_t post_cycle_reboot_due(struct post_cycle *c)
+{
+	return c->sink_checks_failed >= c->cfg.max_post_fails;
+}
+
+/* report by exception */
+
+static uint8_t deadband_on(struct post_cycle *c)
+{
+	return c->cfg.deadband_t != 0 || c->cfg.deadband_rh != 0;
+}
+
+/* nothing has been posted for the heartbeat interval */
+static uint8_t heartbeat_due(struct post_cycle *c)
+{
+	return clock_time() - c->last_post >= (clock_time_t)c->cfg.heartbeat * CLOCK_SECOND;
+}
+
+/* the reading hasn't moved out of the deadband since the last report */
+static uint8_t in_deadband(struct post_cycle *c, int16_t t, uint16_t rh)
+{
+	int16_t dt = t - c->report_t;
+	int16_t drh = rh - c->report_rh;
+
+	if (!deadband_on(c) || !c->have_report) {
+		return 0;
+	}
+	if (dt < 0) { dt = -dt; }
+	if (drh < 0) { drh = -drh; }
+	/* a deadband of 0 leaves that quantity out, it doesn't mean "any change" */
+	return (c->cfg.deadband_t == 0 || dt <= c->cfg.deadband_t) &&
+	       (c->cfg.deadband_rh == 0 || drh <= c->cfg.deadband_rh);
+}
+
+uint8_t post_cycle_likely(struct post_cycle *c, int8_t resolv_ok, uint8_t batched)
+{
+	if (post_cycle_check_due(c, resolv_ok) || heartbeat_due(c)) {
+		return 1;
+	}
+	/* the reading decides, the caller turns the radio on if it's needed */
+	if (deadband_on(c)) {
+		return 0;
+	}
+	return batched + 1 >= c->cfg.batch_size;
+}
+
+uint8_t post_cycle_reading(struct post_cycle *c, int16_t t, uint16_t rh, uint8_t batched, uint8_t check)
+{
+	if (!check && in_deadband(c, t, rh) && !heartbeat_due(c)) {
+		c->suppressed++;
+		return POST_CYCLE_SUPPRESS;
+	}
+	c->report_t = t;
+	c->report_rh = rh;
+	c->have_report = 1;
+
+	/* the batch is a ring, a full one drops its oldest reading */
+	if (batched < BATCH_MAX) {
+		batched++;
+	}
+	if (!check && batched < c->cfg.batch_size && !heartbeat_due(c)) {
+		return POST_CYCLE_BATCH;
+	}
+	return POST_CYCLE_POST;
+}
+
+/* posting */
+
+/* a NON is going out, count the last one as unanswered if its answer was waited for */
+static void non_sent(struct post_cycle *c)
+{
+	if (c->non_pending && c->non_answers_seen) {
+		if (++c->non_unanswered >= NON_UNANSWERED_MAX) {
+			c->non_unanswered = 0;
+			post_cycle_probe(c, c->con_interval > 1 ? c->con_interval >> 1 : 1);
+		}
+	}
+	c->non_pending = 1;
+}
+
+void post_cycle_send(struct post_cycle *c, uint8_t con, uint8_t resend)
+{
+	if (!resend) {
+		c->last_post = clock_time();
+		c->tx_tries = 0;
+	}
+	if (con) {
+		c->non_pending = 0;
+		c->wakes_since_con = 0;
+		c->cons_sent++;
+		c->drains_left = LOG_DRAIN_POSTS;
+	} else {
+		non_sent(c);
+	}
+}
+
+void post_cycle_answered(struct post_cycle *c, uint8_t ok)
+{
+	/* only NON posts leave non_pending set */
+	if (c->non_pending) {
+		c->non_pending = 0;
+		c->non_unanswered = 0;
+		c->non_answers_seen = 1;
+	}
+	if (ok) {
+		c->sink_checks_failed = 0;
+	}
+}
+
+uint8_t post_cycle_tx(struct post_cycle *c, uint8_t acked, uint8_t listen)
+{
+	if (acked) {
+		if (listen) {
+			return POST_CYCLE_LISTEN;
+		}
+		/* nobody waits for the answer, so it can't go missing */
+		c->non_pending = 0;
+		return POST_CYCLE_SLEEP;
+	}
+	if (c->tx_tries < POST_TX_RETRIES) {
+		c->tx_tries++;
+		return POST_CYCLE_RESEND;
+	}
+	/* make the next wake do a sink check */
+	post_cycle_probe(c, 1);
+	return POST_CYCLE_GIVE_UP;
+}
+
+uint8_t post_cycle_drain(struct post_cycle *c, uint16_t stored)
+{
+	if (c->drains_left > 0 && stored > 0) {
+		c->drains_left--;
+		return 1;
+	}
+	c->drains_left = 0;
+	return 0;
+}
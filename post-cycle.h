@@ -0,0 +1,108 @@
+#ifndef __POST_CYCLE_H__
+#define __POST_CYCLE_H__
+
+#include <stdint.h>
+
+#include "contiki.h"
+
+/* the decisions of the post cycle in coap-post-sleep.c: when a wake */
+/* does a sink check, whether a reading is posted, batched or dropped */
+/* by the deadband, what follows a NON the parent didn't ACK, how many */
+/* stored readings go after a good check and when to reboot */
+/* tools/sim/fleetsim.c links this too, so the fleet bench runs the */
+/* same policy as the firmware. The I/O around it is the caller's */
+/* times are in clock ticks, taken from clock_time() */
+
+/* the config the cycle reads, a copy of the fields of TH12Config */
+struct post_cycle_cfg {
+	uint16_t posts_per_check;  /* most wakes between sink checks */
+	uint16_t max_post_fails;   /* failed checks before a reboot */
+	uint16_t batch_size;       /* readings per post */
+	uint16_t deadband_t;       /* 0.1C, 0 to ignore temperature */
+	uint16_t deadband_rh;      /* 0.1%, 0 to ignore humidity */
+	uint16_t heartbeat;        /* most seconds between posts when in the deadband */
+};
+
+struct post_cycle {
+	struct post_cycle_cfg cfg;
+
+	/* sink check scheduling, see post-cycle.c */
+	uint16_t con_interval;     /* wakes between sink checks */
+	uint16_t wakes_since_con;
+	uint8_t non_answers_seen;  /* the sink answers NONs, so a missing answer means something */
+	uint8_t non_pending;       /* a NON is out and its answer is waited for */
+	uint8_t non_unanswered;    /* NONs in a row whose answer didn't come */
+	uint8_t sink_checks_failed;
+	uint8_t tx_tries;          /* times the post was sent again for lack of an ACK */
+	uint8_t drains_left;       /* stored reading posts left after this check */
+
+	/* report by exception: the last reading that went into a batch */
+	int16_t report_t;
+	uint16_t report_rh;
+	uint8_t have_report;
+	clock_time_t last_post;    /* when the last post went out */
+
+	/* for comparing policies: readings dropped by the deadband, checks */
+	/* sent, checks that failed and how many times a failure signal */
+	/* brought a check forward */
+	uint16_t suppressed;
+	uint16_t cons_sent, cons_failed, con_probes;
+};
+
+/* what to do with a reading, from post_cycle_reading() */
+enum {
+	POST_CYCLE_SUPPRESS,       /* in the deadband, drop it */
+	POST_CYCLE_BATCH,          /* add it to the batch and sleep */
+	POST_CYCLE_POST,           /* add it to the batch and post the batch */
+};
+
+/* what follows a NON post, from post_cycle_tx() */
+enum {
+	POST_CYCLE_SLEEP,          /* the parent has it */
+	POST_CYCLE_LISTEN,         /* the parent has it, wait for the sink's answer */
+	POST_CYCLE_RESEND,         /* send the same post again */
+	POST_CYCLE_GIVE_UP,        /* keep the readings and check the sink on the next wake */
+};
+
+/* power up: check the sink on the first wake, keeps cfg */
+void post_cycle_init(struct post_cycle *c);
+
+/* a new wake, not a sensor retry */
+void post_cycle_wake(struct post_cycle *c);
+
+/* this wake should check the sink, resolv_ok is 0 if the sink has no address yet */
+uint8_t post_cycle_check_due(struct post_cycle *c, int8_t resolv_ok);
+
+/* this wake will probably post, so the radio can come up while the sensor warms */
+/* batched is the number of readings waiting */
+uint8_t post_cycle_likely(struct post_cycle *c, int8_t resolv_ok, uint8_t batched);
+
+/* a good reading, check is set if this wake does a sink check, which always posts */
+uint8_t post_cycle_reading(struct post_cycle *c, int16_t t, uint16_t rh, uint8_t batched, uint8_t check);
+
+/* a post is going out, con for a sink check, resend for a NON sent again */
+void post_cycle_send(struct post_cycle *c, uint8_t con, uint8_t resend);
+
+/* the sink answered a NON or a CON, ok if the answer had a payload */
+void post_cycle_answered(struct post_cycle *c, uint8_t ok);
+
+/* a NON post left the MAC, acked if the parent ACKed every frame */
+/* listen if the caller has a reason to hear the sink's answer */
+uint8_t post_cycle_tx(struct post_cycle *c, uint8_t acked, uint8_t listen);
+
+/* a sink check finished, ok if the sink answered */
+void post_cycle_check_result(struct post_cycle *c, uint8_t ok);
+
+/* something looks wrong, check the sink within interval wakes */
+void post_cycle_probe(struct post_cycle *c, uint16_t interval);
+
+/* a post didn't reach the sink, or the sink's name didn't resolve */
+void post_cycle_failed(struct post_cycle *c);
+
+/* after a good check: 1 if another post of stored readings should go */
+uint8_t post_cycle_drain(struct post_cycle *c, uint16_t stored);
+
+/* too many failed checks, the node should reboot */
+uint8_t post_cycle_reboot_due(struct post_cycle *c);
+
+#endif /* __POST_CYCLE_H__ */
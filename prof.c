@@ -0,0 +1,86 @@
+/* wake cycle profiler, see prof.h */
+
+#include "contiki.h"
+#include "mc1322x.h"
+
+#include "prof.h"
+
+#define PROF_VERSION 1
+
+struct cycle {
+	uint32_t start;              /* rtc count at PROF_WAKE */
+	uint16_t n;
+	uint16_t at[PROF_POINTS];
+};
+
+static struct cycle ring[PROF_CYCLES];
+static uint8_t head;                 /* the current cycle */
+static uint8_t count;
+static uint16_t cycles;
+
+void prof_start(void)
+{
+	uint8_t p;
+
+	if (count > 0) {
+		head = (head + 1) % PROF_CYCLES;
+	}
+	if (count < PROF_CYCLES) {
+		count++;
+	}
+	ring[head].start = CRM->RTC_COUNT;
+	ring[head].n = cycles++;
+	for (p = 0; p < PROF_POINTS; p++) {
+		ring[head].at[p] = PROF_NONE;
+	}
+	ring[head].at[PROF_WAKE] = 0;
+}
+
+void prof_wake(void)
+{
+	struct cycle *c = &ring[head];
+
+	if (count == 0 || c->at[PROF_POST] != PROF_NONE || c->at[PROF_SLEEP] != PROF_NONE) {
+		prof_start();
+	}
+}
+
+void prof_mark(uint8_t point)
+{
+	struct cycle *c = &ring[head];
+	uint32_t ms;
+
+	if (count == 0 || c->at[point] != PROF_NONE) {
+		return;
+	}
+	ms = (uint64_t)(CRM->RTC_COUNT - c->start) * 1000 / rtc_freq;
+	c->at[point] = (ms > PROF_MAX) ? PROF_MAX : ms;
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+	*p++ = v >> 8;
+	*p++ = v;
+	return p;
+}
+
+uint16_t prof_export(uint8_t *buf, uint16_t size)
+{
+	uint8_t *p = buf;
+	uint8_t i, k, pt;
+
+	if (size < 3 + (uint16_t)count * (2 + 2 * PROF_POINTS)) {
+		return 0;
+	}
+	*p++ = PROF_VERSION;
+	*p++ = PROF_POINTS;
+	*p++ = count;
+	for (i = 0; i < count; i++) {
+		k = (head + PROF_CYCLES + 1 - count + i) % PROF_CYCLES;
+		p = put16(p, ring[k].n);
+		for (pt = 0; pt < PROF_POINTS; pt++) {
+			p = put16(p, ring[k].at[pt]);
+		}
+	}
+	return p - buf;
+}
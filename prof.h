@@ -0,0 +1,43 @@
+#ifndef __PROF_H__
+#define __PROF_H__
+
+#include <stdint.h>
+
+/* where a wake cycle's time goes: the ms from the start of each cycle */
+/* to a few points on the hot path, for the last PROF_CYCLES cycles */
+/* a cycle starts when the node resumes from sleep, or when the post */
+/* timer fires and the last cycle already posted or slept */
+
+#define PROF_CYCLES 16
+#define PROF_NONE 0xffff             /* point not reached this cycle */
+#define PROF_MAX 0xfffe              /* later points saturate here */
+
+enum {
+	PROF_WAKE,                   /* resumed or post timer, always 0 */
+	PROF_DHT_INIT,               /* sensor powered after sleep */
+	PROF_EDGE,                   /* first edge from the sensor */
+	PROF_DECODED,                /* reading decoded */
+	PROF_ADC,                    /* battery measured */
+	PROF_DAG,                    /* resolv_sink has a DAG */
+	PROF_RESOLVED,               /* sink address known */
+	PROF_POST,                   /* post handed to the stack */
+	PROF_RESPONSE,               /* parent ACK or sink response */
+	PROF_SLEEP,                  /* going to sleep */
+	PROF_POINTS,
+};
+
+/* open a new cycle */
+void prof_start(void);
+
+/* open a new cycle unless this one hasn't posted or slept yet */
+void prof_wake(void);
+
+/* the first time a point is reached in this cycle, safe in interrupts */
+void prof_mark(uint8_t point);
+
+/* the ring as binary, oldest cycle first, returns the length */
+/* version, points, cycles, then per cycle a 16 bit cycle number and */
+/* a 16 bit ms value per point, all big endian */
+uint16_t prof_export(uint8_t *buf, uint16_t size);
+
+#endif /* __PROF_H__ */
@@ -0,0 +1,199 @@
+/* store-and-forward log of readings, see readlog.h */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "mc1322x.h"
+#include "config.h"
+
+#include "readlog.h"
+#include "energy.h"
+
+#define PAGE_SIZE FLASH_PAGE_SIZE
+
+/* record state byte, only ever programmed from 1s to 0s */
+#define LOG_EMPTY 0xff
+#define LOG_VALID 0x7f
+#define LOG_SENT  0x00
+
+struct flash_rec {
+	uint32_t time;
+	int16_t t;
+	uint16_t rh;
+	uint8_t state;
+	uint8_t pad[3];
+};
+typedef char flash_rec_is_readlog_rec_size[(sizeof(struct flash_rec) == READLOG_REC_SIZE) ? 1 : -1];
+
+#define PER_PAGE (PAGE_SIZE / READLOG_REC_SIZE)
+#define SLOTS READLOG_SLOTS
+
+/* oldest unsent slot, next free slot and unsent records in flash */
+static uint16_t tail, head, stored;
+/* records waiting to be programmed */
+static struct flash_rec ram[READLOG_BUF];
+static uint8_t nram;
+/* readlog_now() at boot */
+static uint32_t base;
+
+static uint32_t slot_addr(uint16_t slot)
+{
+	return READLOG_PAGE + (slot / PER_PAGE) * PAGE_SIZE +
+		(slot % PER_PAGE) * sizeof(struct flash_rec);
+}
+
+static void slot_read(uint16_t slot, struct flash_rec *f)
+{
+	nvm_read(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype, f,
+		 slot_addr(slot), sizeof(struct flash_rec));
+}
+
+static void slot_mark(uint16_t slot, uint8_t state)
+{
+	energy_on(ENERGY_FLASH);
+	nvm_write(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype, &state,
+		  slot_addr(slot) + offsetof(struct flash_rec, state), 1);
+	energy_off(ENERGY_FLASH);
+}
+
+static uint16_t next(uint16_t slot)
+{
+	return (slot + 1 == SLOTS) ? 0 : slot + 1;
+}
+
+void readlog_init(void)
+{
+	struct flash_rec f;
+	uint32_t newest = 0, oldest = 0xffffffff;
+	uint8_t any = 0;
+	uint16_t slot;
+
+	/* times only go up, so the oldest valid record is the tail and */
+	/* the slot after the newest written one is the head */
+	tail = head = stored = 0;
+	for (slot = 0; slot < SLOTS; slot++) {
+		slot_read(slot, &f);
+		if (f.state == LOG_EMPTY) {
+			continue;
+		}
+		if (!any || f.time >= newest) {
+			newest = f.time;
+			head = next(slot);
+		}
+		any = 1;
+		if (f.state == LOG_VALID) {
+			stored++;
+			if (f.time < oldest) {
+				oldest = f.time;
+				tail = slot;
+			}
+		}
+	}
+	if (stored == 0) {
+		tail = head;
+	}
+	nram = 0;
+	base = any ? newest + 1 : 0;
+}
+
+uint32_t readlog_now(void)
+{
+	return base + clock_seconds();
+}
+
+void readlog_put(const struct readlog_rec *r)
+{
+	struct flash_rec *f = &ram[nram++];
+
+	f->time = r->time;
+	f->t = r->t;
+	f->rh = r->rh;
+	f->state = LOG_VALID;
+	memset(f->pad, 0xff, sizeof(f->pad));
+	if (nram == READLOG_BUF) {
+		readlog_flush();
+	}
+}
+
+void readlog_flush(void)
+{
+	uint8_t i = 0, n;
+
+	while (i < nram) {
+		/* starting a page: erase it, dropping the oldest records if the log is full */
+		if (head % PER_PAGE == 0) {
+			uint16_t page = head / PER_PAGE;
+			while (stored > 0 && tail / PER_PAGE == page) {
+				tail = next(tail);
+				stored--;
+			}
+			if (stored == 0) {
+				tail = head;
+			}
+			energy_on(ENERGY_FLASH);
+			nvm_erase(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype,
+				  1 << (slot_addr(head) / PAGE_SIZE));
+			energy_off(ENERGY_FLASH);
+		}
+		/* as many as fit in the rest of this page in one program */
+		n = nram - i;
+		if (n > PER_PAGE - head % PER_PAGE) {
+			n = PER_PAGE - head % PER_PAGE;
+		}
+		energy_on(ENERGY_FLASH);
+		nvm_write(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype, &ram[i],
+			  slot_addr(head), n * sizeof(struct flash_rec));
+		energy_off(ENERGY_FLASH);
+		head = (head + n) % SLOTS;
+		stored += n;
+		i += n;
+	}
+	nram = 0;
+}
+
+uint16_t readlog_count(void)
+{
+	return stored + nram;
+}
+
+uint8_t readlog_peek(struct readlog_rec *r, uint8_t max)
+{
+	struct flash_rec f;
+	uint16_t slot = tail;
+	uint8_t n = 0, i;
+
+	for (i = 0; n < max && i < stored; i++, n++) {
+		slot_read(slot, &f);
+		r[n].time = f.time;
+		r[n].t = f.t;
+		r[n].rh = f.rh;
+		slot = next(slot);
+	}
+	for (i = 0; n < max && i < nram; i++, n++) {
+		r[n].time = ram[i].time;
+		r[n].t = ram[i].t;
+		r[n].rh = ram[i].rh;
+	}
+	return n;
+}
+
+void readlog_consume(uint8_t n)
+{
+	while (n > 0 && stored > 0) {
+		slot_mark(tail, LOG_SENT);
+		tail = next(tail);
+		stored--;
+		n--;
+	}
+	if (n > 0) {
+		if (n > nram) {
+			n = nram;
+		}
+		memmove(ram, &ram[n], (nram - n) * sizeof(struct flash_rec));
+		nram -= n;
+	}
+	if (stored == 0) {
+		tail = head;
+	}
+}
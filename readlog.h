@@ -0,0 +1,47 @@
+#ifndef __READLOG_H__
+#define __READLOG_H__
+
+#include <stdint.h>
+
+#include "th12-flash.h"
+
+/* store-and-forward log of readings that couldn't be delivered */
+/* a circular log over READLOG_PAGES nvm pages. Records are buffered in RAM */
+/* and programmed READLOG_BUF at a time, each record has a state byte that */
+/* is programmed again (without an erase) when the record has been sent */
+
+/* READLOG_PAGE and READLOG_PAGES are in th12-flash.h */
+#define READLOG_BUF 8                /* records buffered in RAM per flash program */
+#define READLOG_REC_SIZE 12          /* bytes per record in flash, with its state byte */
+/* records in the log's pages, a full log drops its oldest page of them */
+#define READLOG_SLOTS (READLOG_PAGES * (FLASH_PAGE_SIZE / READLOG_REC_SIZE))
+
+struct readlog_rec {
+	uint32_t time;               /* readlog_now() when the reading was taken */
+	int16_t t;
+	uint16_t rh;
+};
+
+/* find the log in flash, call once at boot after the nvm type is known */
+void readlog_init(void);
+
+/* seconds that keep counting across reboots: the time of the newest */
+/* record in flash at boot plus the uptime. Downtime isn't counted */
+uint32_t readlog_now(void);
+
+/* add a record, it goes to flash once READLOG_BUF have been added */
+void readlog_put(const struct readlog_rec *r);
+
+/* program any buffered records now, e.g. before a reboot */
+void readlog_flush(void);
+
+/* records not yet sent, in flash and in RAM */
+uint16_t readlog_count(void);
+
+/* copy up to max of the oldest records, returns how many */
+uint8_t readlog_peek(struct readlog_rec *r, uint8_t max);
+
+/* the n oldest records have been delivered */
+void readlog_consume(uint8_t n);
+
+#endif /* __READLOG_H__ */
@@ -0,0 +1,261 @@
+/* append-only record store, see recstore.h */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "mc1322x.h"
+#include "config.h"
+
+#include "recstore.h"
+#include "energy.h"
+
+#define PAGE_SIZE FLASH_PAGE_SIZE
+#define PAGE_MAGIC 0x54524543        /* "TREC" */
+
+struct page_hdr {
+	uint32_t magic;
+	uint32_t seq;                /* goes up by one each page switch */
+};
+
+/* key 0xff is erased flash: the end of the records in a page */
+struct rec_hdr {
+	uint8_t key;
+	uint8_t pad;
+	uint16_t len;
+	uint16_t crc;                /* over the key, len and data */
+	uint16_t pad2;
+};
+
+/* records start on a 4 byte boundary */
+#define ALIGN(n) (((n) + 3) & ~3)
+
+static uint8_t active;                       /* page being appended to */
+static uint32_t active_seq;
+static uint16_t next_off;                    /* where the next record goes in it */
+static uint8_t formatted;
+static uint32_t where[RECSTORE_KEYS];        /* address of the newest record, 0 if none */
+/* the record being written, or being copied during a page switch */
+static uint8_t buf[sizeof(struct rec_hdr) + RECSTORE_MAX];
+
+static uint32_t page_addr(uint8_t page)
+{
+	return RECSTORE_PAGE + (uint32_t)page * PAGE_SIZE;
+}
+
+static void flash_read(uint32_t addr, void *dst, uint16_t n)
+{
+	nvm_read(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype, dst, addr, n);
+}
+
+static void flash_write(uint32_t addr, void *src, uint16_t n)
+{
+	energy_on(ENERGY_FLASH);
+	nvm_write(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype, src, addr, n);
+	energy_off(ENERGY_FLASH);
+}
+
+static uint16_t crc16(uint16_t crc, const uint8_t *p, uint16_t n)
+{
+	uint8_t i;
+
+	while (n--) {
+		crc ^= (uint16_t)*p++ << 8;
+		for (i = 0; i < 8; i++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static uint16_t rec_crc(const struct rec_hdr *h, const uint8_t *data)
+{
+	uint16_t crc = crc16(0xffff, &h->key, 1);
+	crc = crc16(crc, (const uint8_t *)&h->len, sizeof(h->len));
+	return crc16(crc, data, h->len);
+}
+
+/* walk the records of a page, remembering the good ones */
+/* returns the offset after the last record */
+static uint16_t scan_page(uint8_t page)
+{
+	struct rec_hdr h;
+	uint16_t off = sizeof(struct page_hdr);
+
+	while (off + sizeof(h) <= PAGE_SIZE) {
+		flash_read(page_addr(page) + off, &h, sizeof(h));
+		if (h.key == 0xff) {
+			break;
+		}
+		if (h.len > RECSTORE_MAX || off + sizeof(h) + h.len > PAGE_SIZE) {
+			/* a torn header, nothing after it can be trusted */
+			return PAGE_SIZE;
+		}
+		flash_read(page_addr(page) + off + sizeof(h), buf, h.len);
+		if (h.key < RECSTORE_KEYS && h.crc == rec_crc(&h, buf)) {
+			where[h.key] = page_addr(page) + off;
+		}
+		off += ALIGN(sizeof(h) + h.len);
+	}
+	return off;
+}
+
+/* append a record, hdr and data, to the active page */
+static void append(uint8_t *rec)
+{
+	struct rec_hdr *h = (struct rec_hdr *)rec;
+	uint32_t addr = page_addr(active) + next_off;
+
+	flash_write(addr, rec, sizeof(struct rec_hdr) + h->len);
+	where[h->key] = addr;
+	next_off += ALIGN(sizeof(struct rec_hdr) + h->len);
+}
+
+/* copy the newest record of key to the active page through buf */
+/* returns 0 if it doesn't fit */
+static int copy(uint8_t key)
+{
+	struct rec_hdr *h = (struct rec_hdr *)buf;
+
+	flash_read(where[key], h, sizeof(*h));
+	if (h->key != key || h->len > RECSTORE_MAX) {
+		return 1;
+	}
+	if (next_off + ALIGN(sizeof(*h) + h->len) > PAGE_SIZE) {
+		return 0;
+	}
+	flash_read(where[key] + sizeof(*h), buf + sizeof(*h), h->len);
+	if (h->crc == rec_crc(h, buf + sizeof(*h))) {
+		append(buf);
+	}
+	return 1;
+}
+
+/* erase the next page and copy the newest records there, except skip's */
+/* the page being left keeps every record until the next switch, by */
+/* which time recstore_init() has made sure they were all copied over */
+static void switch_page(uint8_t skip)
+{
+	struct page_hdr ph;
+	uint8_t k;
+
+	active = formatted ? (active + 1) % RECSTORE_PAGES : 0;
+	active_seq++;
+	energy_on(ENERGY_FLASH);
+	nvm_erase(gNvmInternalInterface_c, mc1322x_config.flags.nvmtype,
+		  1 << (page_addr(active) / PAGE_SIZE));
+	energy_off(ENERGY_FLASH);
+	/* the magic goes last, so a page that has it has its whole seq */
+	ph.magic = PAGE_MAGIC;
+	ph.seq = active_seq;
+	flash_write(page_addr(active) + offsetof(struct page_hdr, seq), &ph.seq, sizeof(ph.seq));
+	flash_write(page_addr(active), &ph.magic, sizeof(ph.magic));
+	next_off = sizeof(ph);
+
+	for (k = 0; k < RECSTORE_KEYS; k++) {
+		if (k != skip && where[k] != 0) {
+			copy(k);
+		}
+	}
+	formatted = 1;
+}
+
+static int in_active(uint32_t addr)
+{
+	return addr >= page_addr(active) && addr < page_addr(active) + PAGE_SIZE;
+}
+
+int recstore_init(void)
+{
+	struct page_hdr ph[RECSTORE_PAGES];
+	uint8_t order[RECSTORE_PAGES];
+	uint8_t n = 0, i, j, k;
+
+	memset(where, 0, sizeof(where));
+	formatted = 0;
+	active = 0;
+	active_seq = 0;
+	next_off = PAGE_SIZE;
+
+	/* the formatted pages, oldest first */
+	for (i = 0; i < RECSTORE_PAGES; i++) {
+		flash_read(page_addr(i), &ph[i], sizeof(struct page_hdr));
+		if (ph[i].magic != PAGE_MAGIC) {
+			continue;
+		}
+		for (j = n; j > 0 && ph[order[j - 1]].seq > ph[i].seq; j--) {
+			order[j] = order[j - 1];
+		}
+		order[j] = i;
+		n++;
+	}
+
+	for (i = 0; i < n; i++) {
+		active = order[i];
+		active_seq = ph[active].seq;
+		next_off = scan_page(active);
+	}
+	formatted = (n > 0);
+
+	/* a key whose newest record isn't in the active page means a page */
+	/* switch was cut short. The older page still has those records, so */
+	/* finish copying them before there are any writes, or the next */
+	/* switch would erase the only copy */
+	for (k = 0; k < RECSTORE_KEYS; k++) {
+		if (where[k] == 0 || in_active(where[k])) {
+			continue;
+		}
+		if (!copy(k)) {
+			/* a torn record left no room: everything in the active page */
+			/* is a copy, so go back to the older page and switch again */
+			memset(where, 0, sizeof(where));
+			for (i = 0; i + 1 < n; i++) {
+				active = order[i];
+				active_seq = ph[active].seq;
+				next_off = scan_page(active);
+			}
+			switch_page(RECSTORE_KEYS);
+			break;
+		}
+	}
+	return formatted;
+}
+
+int recstore_read(uint8_t key, void *data, uint16_t max)
+{
+	struct rec_hdr h;
+
+	if (key >= RECSTORE_KEYS || where[key] == 0) {
+		return -1;
+	}
+	flash_read(where[key], &h, sizeof(h));
+	if (h.len > RECSTORE_MAX) {
+		return -1;
+	}
+	if (h.len < max) {
+		max = h.len;
+	}
+	flash_read(where[key] + sizeof(h), data, max);
+	return h.len;
+}
+
+int recstore_write(uint8_t key, const void *data, uint16_t len)
+{
+	struct rec_hdr *h = (struct rec_hdr *)buf;
+
+	if (key >= RECSTORE_KEYS || len > RECSTORE_MAX) {
+		return -1;
+	}
+	if (!formatted || next_off + ALIGN(sizeof(struct rec_hdr) + len) > PAGE_SIZE) {
+		switch_page(key);
+	}
+
+	h->key = key;
+	h->pad = 0xff;
+	h->len = len;
+	h->pad2 = 0xffff;
+	memcpy(buf + sizeof(struct rec_hdr), data, len);
+	h->crc = rec_crc(h, buf + sizeof(struct rec_hdr));
+	append(buf);
+	return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef __RECSTORE_H__
+#define __RECSTORE_H__
+
+#include <stdint.h>
+
+#include "th12-flash.h"
+
+/* append-only record store for small blobs that change now and then */
+/* a write appends a CRC protected record to the active page, one program */
+/* and no erase. When the page is full the next page is erased and the */
+/* newest record of every key is copied over. The newest good record of a */
+/* key wins, so a write that's cut short leaves the previous one in place. */
+/* A page switch that's cut short is finished by the next recstore_init() */
+
+/* RECSTORE_PAGE and RECSTORE_PAGES are in th12-flash.h */
+#define RECSTORE_KEYS 4              /* keys are 0 to RECSTORE_KEYS - 1 */
+#define RECSTORE_MAX 256             /* largest record */
+
+/* scan the pages, call once at boot after the nvm type is known */
+/* returns 0 if no page has ever been formatted */
+int recstore_init(void);
+
+/* copy the newest record for key into data, returns its length or -1 if there is none */
+/* a record longer than max is cut to max */
+int recstore_read(uint8_t key, void *data, uint16_t max);
+
+/* append a record for key, returns 0 on success */
+int recstore_write(uint8_t key, const void *data, uint16_t len);
+
+#endif /* __RECSTORE_H__ */
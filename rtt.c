@@ -0,0 +1,93 @@
+/* CoCoA retransmission timeout estimator, see rtt.h */
+
+#include "rtt.h"
+
+/* rto = srtt + K * rttvar, rttvar is at least one tick */
+static const uint8_t k[2] = { 4, 1 };
+
+static uint16_t clamp(uint32_t rto)
+{
+	if (rto < RTT_MIN) {
+		return RTT_MIN;
+	}
+	if (rto > RTT_MAX) {
+		return RTT_MAX;
+	}
+	return rto;
+}
+
+void rtt_init(struct rtt *r)
+{
+	r->rto = RTT_INITIAL;
+	r->valid[RTT_STRONG] = r->valid[RTT_WEAK] = 0;
+	r->updated = clock_time();
+}
+
+void rtt_sample(struct rtt *r, clock_time_t rtt, uint8_t retransmissions)
+{
+	uint8_t e = retransmissions ? RTT_WEAK : RTT_STRONG;
+	int32_t m, err;
+	uint32_t var, est;
+
+	if (retransmissions > RTT_WEAK_MAX_RETRANSMIT) {
+		return;
+	}
+	if (rtt > RTT_MAX) {
+		rtt = RTT_MAX;
+	}
+	m = (int32_t)rtt << 3;
+
+	/* RFC 6298 smoothing, the same for both estimators */
+	if (!r->valid[e]) {
+		r->srtt[e] = m;
+		r->rttvar[e] = m >> 1;
+		r->valid[e] = 1;
+	} else {
+		err = m - r->srtt[e];
+		if (err < 0) {
+			err = -err;
+		}
+		r->rttvar[e] += (err - (int32_t)r->rttvar[e]) / 4;
+		r->srtt[e] += (m - (int32_t)r->srtt[e]) / 8;
+	}
+
+	var = (uint32_t)k[e] * r->rttvar[e];
+	if (var < (1 << 3)) {
+		var = 1 << 3;
+	}
+	est = (r->srtt[e] + var) >> 3;
+
+	/* the strong estimate pulls harder than the weak one */
+	if (e == RTT_STRONG) {
+		r->rto = clamp(((uint32_t)r->rto + est) / 2);
+	} else {
+		r->rto = clamp((3 * (uint32_t)r->rto + est) / 4);
+	}
+	r->updated = clock_time();
+}
+
+uint16_t rtt_rto(struct rtt *r)
+{
+	clock_time_t age = clock_time() - r->updated;
+
+	/* drift back towards the default when the estimate is old */
+	if (r->rto < CLOCK_SECOND && age > 16 * (clock_time_t)r->rto) {
+		r->rto = (CLOCK_SECOND + 2 * (uint32_t)r->rto) / 3;
+		r->updated = clock_time();
+	} else if (r->rto > 3 * CLOCK_SECOND && age > 4 * (clock_time_t)r->rto) {
+		r->rto = (2 * CLOCK_SECOND + (uint32_t)r->rto) / 2;
+		r->updated = clock_time();
+	}
+	return r->rto;
+}
+
+uint16_t rtt_backoff(uint16_t rto)
+{
+	if (rto < CLOCK_SECOND) {
+		return clamp(3 * (uint32_t)rto);
+	}
+	if (rto > 3 * CLOCK_SECOND) {
+		return clamp(3 * (uint32_t)rto / 2);
+	}
+	return clamp(2 * (uint32_t)rto);
+}
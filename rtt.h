@@ -0,0 +1,45 @@
+#ifndef __RTT_H__
+#define __RTT_H__
+
+#include <stdint.h>
+
+#include "contiki.h"
+
+/* CoCoA style retransmission timeout estimator for one destination */
+/* (draft-ietf-core-cocoa): a strong estimator fed by exchanges that */
+/* weren't retransmitted and a weak one fed by exchanges that needed */
+/* one or two retransmissions, both folded into one RTO */
+/* all times are in clock ticks */
+
+#define RTT_INITIAL (2 * CLOCK_SECOND)  /* RTO before any measurement */
+#define RTT_MIN (CLOCK_SECOND / 10)
+#define RTT_MAX (32 * CLOCK_SECOND)
+#define RTT_WEAK_MAX_RETRANSMIT 2       /* samples with more retransmissions are dropped */
+
+enum {
+	RTT_STRONG,
+	RTT_WEAK,
+};
+
+struct rtt {
+	uint16_t rto;              /* current estimate */
+	uint16_t srtt[2];          /* smoothed rtt << 3, per estimator */
+	uint16_t rttvar[2];        /* rtt variation << 3, per estimator */
+	uint8_t valid[2];          /* the estimator has had a sample */
+	clock_time_t updated;      /* when rto last changed */
+};
+
+/* forget everything and go back to RTT_INITIAL */
+void rtt_init(struct rtt *r);
+
+/* a response arrived rtt ticks after the first transmission */
+void rtt_sample(struct rtt *r, clock_time_t rtt, uint8_t retransmissions);
+
+/* the timeout for a new exchange, ages estimates that haven't been updated in a while */
+uint16_t rtt_rto(struct rtt *r);
+
+/* the next timeout after a retransmission: the variable backoff factor */
+/* is 3 for short timeouts, 2 in between and 1.5 for long ones */
+uint16_t rtt_backoff(uint16_t rto);
+
+#endif /* __RTT_H__ */
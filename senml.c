@@ -0,0 +1,103 @@
+/* minimal SenML-CBOR encoder, see senml.h */
+
+#include <string.h>
+
+#include "senml.h"
+
+/* CBOR major types */
+#define CBOR_UINT  0x00
+#define CBOR_NINT  0x20
+#define CBOR_TEXT  0x60
+#define CBOR_ARRAY 0x80
+#define CBOR_MAP   0xa0
+#define CBOR_TAG   0xc0
+
+/* SenML labels */
+#define SENML_NAME   0
+#define SENML_VALUE  2
+#define SENML_STRING 3
+#define SENML_TIME   6
+
+/* CBOR tag for decimal fractions */
+#define CBOR_TAG_DECIMAL 4
+
+/* major type and argument, using the shortest encoding */
+static void head(struct msgbuf *m, uint8_t major, uint32_t arg)
+{
+	if (arg < 24) {
+		msgbuf_putc(m, major | arg);
+	} else if (arg <= 0xff) {
+		msgbuf_putc(m, major | 24);
+		msgbuf_putc(m, arg);
+	} else if (arg <= 0xffff) {
+		msgbuf_putc(m, major | 25);
+		msgbuf_putc(m, arg >> 8);
+		msgbuf_putc(m, arg);
+	} else {
+		msgbuf_putc(m, major | 26);
+		msgbuf_putc(m, arg >> 24);
+		msgbuf_putc(m, arg >> 16);
+		msgbuf_putc(m, arg >> 8);
+		msgbuf_putc(m, arg);
+	}
+}
+
+static void integer(struct msgbuf *m, int32_t v)
+{
+	if (v < 0) {
+		head(m, CBOR_NINT, (uint32_t)(-1 - v));
+	} else {
+		head(m, CBOR_UINT, v);
+	}
+}
+
+static void text(struct msgbuf *m, const char *s)
+{
+	uint16_t n = strlen(s);
+
+	head(m, CBOR_TEXT, n);
+	while (n--) {
+		msgbuf_putc(m, *s++);
+	}
+}
+
+void senml_start(struct msgbuf *m, uint8_t nrecords)
+{
+	head(m, CBOR_ARRAY, nrecords);
+}
+
+static void decimal(struct msgbuf *m, int32_t mantissa, int8_t exponent)
+{
+	integer(m, SENML_VALUE);
+	head(m, CBOR_TAG, CBOR_TAG_DECIMAL);
+	head(m, CBOR_ARRAY, 2);
+	integer(m, exponent);
+	integer(m, mantissa);
+}
+
+void senml_decimal(struct msgbuf *m, const char *name, int32_t mantissa, int8_t exponent)
+{
+	head(m, CBOR_MAP, 2);
+	integer(m, SENML_NAME);
+	text(m, name);
+	decimal(m, mantissa, exponent);
+}
+
+void senml_decimal_at(struct msgbuf *m, const char *name, int32_t mantissa, int8_t exponent, int32_t time)
+{
+	head(m, CBOR_MAP, 3);
+	integer(m, SENML_NAME);
+	text(m, name);
+	decimal(m, mantissa, exponent);
+	integer(m, SENML_TIME);
+	integer(m, time);
+}
+
+void senml_string(struct msgbuf *m, const char *name, const char *value)
+{
+	head(m, CBOR_MAP, 2);
+	integer(m, SENML_NAME);
+	text(m, name);
+	integer(m, SENML_STRING);
+	text(m, value);
+}
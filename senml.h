@@ -0,0 +1,36 @@
+#ifndef __SENML_H__
+#define __SENML_H__
+
+#include <stdint.h>
+
+#include "msgbuf.h"
+
+/* minimal SenML-CBOR (RFC 8428) encoder for sensor posts */
+/* values are sent as CBOR decimal fractions (tag 4) so the fixed-point */
+/* integers from the sensor go out exactly, e.g. 22.1C is [-1, 221] */
+
+/* CoAP content-format for application/senml+cbor */
+#define SENML_CBOR_CONTENT_FORMAT 112
+
+/* worst case size of one record with a name of n chars and a 16-bit mantissa */
+/* map(2) n: text(n) v: 4([exp, mantissa]) */
+#define SENML_DECIMAL_MAX(n) (10 + (n))
+/* the same with a 32-bit time: t: time */
+#define SENML_DECIMAL_AT_MAX(n) (16 + (n))
+
+/* records are written into a msgbuf, use msgbuf_len() for the encoded length */
+
+/* start a pack of nrecords records */
+void senml_start(struct msgbuf *m, uint8_t nrecords);
+
+/* add a record with value mantissa * 10^exponent */
+void senml_decimal(struct msgbuf *m, const char *name, int32_t mantissa, int8_t exponent);
+
+/* add a record with value mantissa * 10^exponent taken at time */
+/* times under 2^28 are seconds relative to now, so use a negative age */
+void senml_decimal_at(struct msgbuf *m, const char *name, int32_t mantissa, int8_t exponent, int32_t time);
+
+/* add a record with a string value */
+void senml_string(struct msgbuf *m, const char *name, const char *value);
+
+#endif /* __SENML_H__ */
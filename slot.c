@@ -0,0 +1,31 @@
+/* EUI derived post slots, see slot.h */
+
+#include "slot.h"
+
+uint32_t slot_hash(const uint8_t *eui, uint8_t len)
+{
+	uint32_t h = 2166136261UL;
+
+	while (len--) {
+		h ^= *eui++;
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+uint32_t slot_wait(uint32_t now, uint16_t ticks, uint32_t hash, uint16_t interval, uint16_t second)
+{
+	uint32_t period, slot, phase, wait;
+
+	if (interval == 0) {
+		interval = 1;
+	}
+	period = (uint32_t)interval * second;
+	slot = hash % period;
+	phase = (now % interval) * second + ticks;
+	wait = (slot + period - phase) % period;
+	if (wait < period / 4) {
+		wait += period;
+	}
+	return wait;
+}
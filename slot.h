@@ -0,0 +1,20 @@
+#ifndef __SLOT_H__
+#define __SLOT_H__
+
+#include <stdint.h>
+
+/* post slots: each node posts at a fixed point in the post interval */
+/* derived from its EUI-64, so a fleet that powers up together */
+/* doesn't post in lockstep. The interval is counted from boot, or */
+/* from the sink's clock once the sink has sent a time */
+/* no contiki headers so tools/sim can build it on the host */
+
+/* FNV-1a over the EUI-64 */
+uint32_t slot_hash(const uint8_t *eui, uint8_t len);
+
+/* ticks from now until the node's next slot, at least a quarter */
+/* interval away so a late post doesn't bring the next one forward */
+/* now is in seconds plus ticks, interval in seconds and second is ticks per second */
+uint32_t slot_wait(uint32_t now, uint16_t ticks, uint32_t hash, uint16_t interval, uint16_t second);
+
+#endif /* __SLOT_H__ */
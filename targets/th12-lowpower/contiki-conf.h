@@ -113,7 +113,9 @@
 #if WITH_UIP6
 /* Network setup for IPv6 */
 #define NETSTACK_CONF_NETWORK sicslowpan_driver
-#define NETSTACK_CONF_MAC     nullmac_driver 
+/* nullmac plus a tx result hook so the app can sleep on the ACK */
+#define NETSTACK_CONF_MAC     th12mac_driver
+#define TH12MAC 1
 #define NETSTACK_CONF_RDC     nullrdc_driver
 #define NETSTACK_CONF_RADIO   contiki_maca_driver
 #define NETSTACK_CONF_FRAMER  framer_802154
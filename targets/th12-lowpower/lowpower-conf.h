@@ -19,4 +19,7 @@
 #define UART2_CONF_TX_BUFFERSIZE 32
 #define UART2_CONF_RX_BUFFERSIZE 32
 
+/* PRINTF goes to a RAM ring instead of blocking on UART1, see tlog.h */
+#define TLOG_CONF_ON 1
+
 #endif
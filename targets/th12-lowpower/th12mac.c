@@ -0,0 +1,82 @@
+/* nullmac that reports transmit results to the application, see th12mac.h */
+
+#include "net/mac/mac.h"
+#include "net/netstack.h"
+
+#include "mc1322x.h"
+
+#include "th12mac.h"
+
+static void (*tx_callback)(int status);
+
+uint64_t th12mac_tx_rtc;
+
+/* the callback and pointer from the layer above for the frame being sent */
+/* nullrdc calls back before it returns so one frame is in flight at a time */
+static mac_callback_t up_sent;
+static void *up_ptr;
+
+void
+th12mac_register_tx(void (*f)(int status))
+{
+  tx_callback = f;
+}
+
+static void
+packet_sent(void *ptr, int status, int transmissions)
+{
+  mac_call_sent_callback(up_sent, up_ptr, status, transmissions);
+  if(tx_callback != NULL) {
+    tx_callback(status);
+  }
+}
+
+static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  uint32_t start = CRM->RTC_COUNT;
+
+  up_sent = sent;
+  up_ptr = ptr;
+  NETSTACK_RDC.send(packet_sent, NULL);
+  th12mac_tx_rtc += CRM->RTC_COUNT - start;
+}
+
+static void
+packet_input(void)
+{
+  NETSTACK_NETWORK.input();
+}
+
+static int
+on(void)
+{
+  return NETSTACK_RDC.on();
+}
+
+static int
+off(int keep_radio_on)
+{
+  return NETSTACK_RDC.off(keep_radio_on);
+}
+
+static unsigned short
+channel_check_interval(void)
+{
+  return 0;
+}
+
+static void
+init(void)
+{
+}
+
+const struct mac_driver th12mac_driver = {
+  "th12mac",
+  init,
+  send_packet,
+  packet_input,
+  on,
+  off,
+  channel_check_interval,
+};
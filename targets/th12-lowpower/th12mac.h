@@ -0,0 +1,19 @@
+#ifndef TH12MAC_H
+#define TH12MAC_H
+
+#include "net/mac/mac.h"
+
+/* nullmac with a hook on transmit results */
+/* the radio does auto-ack in hardware so the status of each frame is known */
+/* as soon as nullrdc returns: MAC_TX_OK means the next hop ACKed it */
+
+extern const struct mac_driver th12mac_driver;
+
+/* called after every frame with the MAC_TX_ status, NULL to unregister */
+/* frames are sent from inside uip so don't do anything here that sends or sleeps */
+void th12mac_register_tx(void (*f)(int status));
+
+/* rtc ticks spent sending frames, including waiting for the ACK */
+extern uint64_t th12mac_tx_rtc;
+
+#endif
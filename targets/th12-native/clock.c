@@ -0,0 +1,120 @@
+/* virtual time for the native TH12 */
+
+/* time runs with the wall clock while the node is awake. Sleeping */
+/* skips ahead instantly, so a day of 5 minute posts runs in seconds */
+/* and clock_time(), clock_seconds() and the rtc agree on it */
+
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "contiki.h"
+#include "mc1322x.h"
+
+#include "sim.h"
+
+uint32_t rtc_freq = SIM_RTC_FREQ;
+
+static struct timespec start;
+static uint64_t slept_us;
+static struct sim_crm crm;
+
+void sim_clock_init(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &start);
+}
+
+uint64_t sim_clock_us(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)(now.tv_sec - start.tv_sec) * 1000000 +
+		(now.tv_nsec - start.tv_nsec) / 1000 + slept_us;
+}
+
+uint64_t sim_slept_us(void)
+{
+	return slept_us;
+}
+
+void clock_init(void)
+{
+	sim_clock_init();
+}
+
+clock_time_t clock_time(void)
+{
+	return sim_clock_us() * CLOCK_SECOND / 1000000;
+}
+
+unsigned long clock_seconds(void)
+{
+	return sim_clock_us() / 1000000;
+}
+
+void clock_delay(unsigned int i)
+{
+	(void)i;
+}
+
+void clock_wait(int i)
+{
+	clock_time_t t0 = clock_time();
+
+	while (clock_time() - t0 < (clock_time_t)i) {
+		usleep(1000);
+	}
+}
+
+void rtimer_arch_sleep(uint32_t ticks)
+{
+	slept_us += (uint64_t)ticks * 1000000 / rtc_freq;
+	/* timers that came due while asleep fire now */
+	etimer_request_poll();
+}
+
+struct sim_crm *sim_crm(void)
+{
+	crm.RTC_COUNT = sim_clock_us() * rtc_freq / 1000000;
+	return &crm;
+}
+
+/* the code spins after writing SW_RST, so a timer signal checks for it */
+static void reset_signal(int sig)
+{
+	(void)sig;
+	sim_reset_check();
+}
+
+void sim_reset_check(void)
+{
+	static const char msg[] = "software reset\n";
+
+	if (crm.SW_RST != 0x87651234) {
+		return;
+	}
+	/* only async signal safe calls from here */
+	write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+	execv("/proc/self/exe", sim.argv);
+	_exit(1);
+}
+
+void sim_reset_init(void)
+{
+	struct itimerval it;
+	sigset_t set;
+
+	/* exec keeps the signal mask, a reset from the handler left it blocked */
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigprocmask(SIG_UNBLOCK, &set, NULL);
+
+	signal(SIGALRM, reset_signal);
+	memset(&it, 0, sizeof(it));
+	it.it_interval.tv_usec = 50000;
+	it.it_value.tv_usec = 50000;
+	setitimer(ITIMER_REAL, &it, NULL);
+}
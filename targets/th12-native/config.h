@@ -0,0 +1,33 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+/* the mc1322x platform config, kept in the nvm file like on the flash */
+
+#include <stdint.h>
+
+#define MC1322X_CONFIG_PAGE 0x1E000
+#define MC1322X_CONFIG_MAGIC 0x1322
+#define MC1322X_CONFIG_VERSION 1
+
+struct FLAGS {
+	uint32_t demod:1;
+	uint32_t autoack:1;
+	uint32_t nvmtype:4;
+};
+
+typedef struct {
+	uint16_t magic;
+	uint16_t version;
+	uint64_t eui;
+	int32_t channel;                   /* 0 is channel 11 */
+	int32_t power;
+	struct FLAGS flags;
+} mc1322x_config_t;
+
+extern mc1322x_config_t mc1322x_config;
+
+void mc1322x_config_set_default(mc1322x_config_t *c);
+void mc1322x_config_restore(mc1322x_config_t *c);
+void mc1322x_config_save(mc1322x_config_t *c);
+
+#endif /* __CONFIG_H__ */
@@ -0,0 +1,137 @@
+/*
+ * Configuration for running the TH12 application as a Linux process
+ *
+ * The network and application settings follow targets/th12 so the
+ * same code paths run. The MC1322x peripherals are simulated, see
+ * mc1322x.h, and IPv6 goes over a tun interface instead of 802.15.4,
+ * see tun.c.
+ */
+
+#ifndef __CONTIKI_CONF_H__
+#define __CONTIKI_CONF_H__
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#define RESOLV_CONF_SUPPORTS_MDNS 0
+
+/* types the mc1322x cpu would provide */
+#define CC_CONF_REGISTER_ARGS          1
+#define CC_CONF_FUNCTION_POINTER_ARGS  1
+#define CC_CONF_FASTCALL
+#define CC_CONF_VA_ARGS                1
+#define CC_CONF_INLINE                 inline
+
+#define CCIF
+#define CLIF
+
+typedef unsigned long clock_time_t;
+typedef unsigned short uip_stats_t;
+
+typedef unsigned long rtimer_clock_t;
+#define RTIMER_CLOCK_LT(a,b)     ((signed long)((a)-(b)) < 0)
+
+/* Clock ticks per second, as on the hardware */
+#define CLOCK_CONF_SECOND 100
+
+/* rtc ticks per second of the simulated MC1322x rtc */
+#define SIM_RTC_FREQ 2000
+
+/* the flash the nvm file stands in for */
+#define SIM_NVM_SIZE 0x20000
+
+/* no console UART, stdout instead */
+#define dbg_putchar(x) putchar(x)
+
+#define USE_WDT 0
+
+/* start of conitki config. */
+#define PLATFORM_HAS_LEDS 0
+#define PLATFORM_HAS_BUTTON 0
+
+#define RIMEADDR_CONF_SIZE              8
+
+#if WITH_UIP6
+/* IPv6 over a tun interface, the rest of the stack is only initialized */
+#define NETSTACK_CONF_NETWORK tun_driver
+#define NETSTACK_CONF_MAC     nullmac_driver
+#define NETSTACK_CONF_RDC     nullrdc_driver
+#define NETSTACK_CONF_RADIO   nullradio_driver
+#define NETSTACK_CONF_FRAMER  framer_802154
+
+#define NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE      8
+#define RIME_CONF_NO_POLITE_ANNOUCEMENTS 0
+#define CXMAC_CONF_ANNOUNCEMENTS         0
+#define XMAC_CONF_ANNOUNCEMENTS          0
+#endif /* WITH_UIP6 */
+
+#define QUEUEBUF_CONF_NUM          16
+
+#define PACKETBUF_CONF_ATTRS_INLINE 1
+
+#ifndef RF_CHANNEL
+#define RF_CHANNEL              26
+#endif /* RF_CHANNEL */
+
+#define IEEE802154_CONF_PANID       0xABCD
+
+#define PROFILE_CONF_ON 0
+#define ENERGEST_CONF_ON 0
+
+#define WITH_ASCII 1
+
+#define PROCESS_CONF_NUMEVENTS 8
+#define PROCESS_CONF_STATS 1
+
+#ifdef WITH_UIP6
+
+#define UIP_CONF_LL_802154              1
+#define UIP_CONF_LLH_LEN                0
+
+#define UIP_CONF_ROUTER                 1
+#define UIP_CONF_IPV6_RPL               1
+
+#define UIP_CONF_DS6_NBR_NBU     30
+#define UIP_CONF_DS6_ROUTE_NBU   30
+
+#define UIP_CONF_ND6_SEND_RA		0
+#define UIP_CONF_ND6_REACHABLE_TIME     600000
+#define UIP_CONF_ND6_RETRANS_TIMER      10000
+
+#define UIP_CONF_IPV6                   1
+#define UIP_CONF_IPV6_QUEUE_PKT         0
+#define UIP_CONF_IPV6_CHECKS            1
+#define UIP_CONF_IPV6_REASSEMBLY        0
+#define UIP_CONF_NETIF_MAX_ADDRESSES    3
+#define UIP_CONF_ND6_MAX_PREFIXES       3
+#define UIP_CONF_ND6_MAX_NEIGHBORS      4
+#define UIP_CONF_ND6_MAX_DEFROUTERS     2
+#define UIP_CONF_IP_FORWARD             0
+#define UIP_CONF_BUFFER_SIZE		1300
+#endif /* WITH_UIP6 */
+
+#define UIP_CONF_ICMP_DEST_UNREACH 1
+
+#define UIP_CONF_DHCP_LIGHT
+#define UIP_CONF_LLH_LEN         0
+#define UIP_CONF_RECEIVE_WINDOW  48
+#define UIP_CONF_TCP_MSS         48
+#define UIP_CONF_MAX_CONNECTIONS 4
+#define UIP_CONF_MAX_LISTENPORTS 8
+#define UIP_CONF_UDP_CONNS       12
+#define UIP_CONF_FWCACHE_SIZE    30
+#define UIP_CONF_BROADCAST       1
+#define UIP_CONF_UDP             1
+#define UIP_CONF_UDP_CHECKSUMS   1
+#define UIP_CONF_PINGADDRCONF    0
+#define UIP_CONF_LOGGING         0
+
+#define UIP_CONF_TCP_SPLIT       0
+
+/* include the project config */
+/* PROJECT_CONF_H might be defined in the project Makefile */
+#ifdef PROJECT_CONF_H
+#include PROJECT_CONF_H
+#endif /* PROJECT_CONF_H */
+
+#endif /* __CONTIKI_CONF_H__ */
@@ -0,0 +1,263 @@
+/*
+ * The TH12 application as a Linux process
+ *
+ * Runs the same application sources as the hardware targets on
+ * simulated MC1322x peripherals: the dht answers from recorded or
+ * synthesized frames, the adc reads fixed voltages, the flash is a file
+ * and sleep skips ahead in virtual time. IPv6 goes over a tun interface
+ * and the node is the root of its own DAG, with the host on the other
+ * end of the tun as its default router and DNS server.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+/* contiki */
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/uip-debug.h"
+#include "net/rime/rimeaddr.h"
+#include "net/netstack.h"
+#include "net/rpl/rpl.h"
+#include "net/rpl/rpl-private.h" /* RPL_DEFAULT_INSTANCE */
+
+/* mc1322x */
+#include "mc1322x.h"
+#include "config.h"
+
+/* th12 */
+#include "platform_prints.h"
+#include "platform_stats.h"
+
+#include "sim.h"
+#include "tun.h"
+
+volatile uint32_t sched_runs;
+volatile uint32_t idle_rtc_ticks;
+volatile uint64_t idle_rtc_total;
+
+/* upper bound on a single wait, like the hardware's longest doze */
+#define IDLE_MAX_TICKS CLOCK_SECOND
+
+static uip_ipaddr_t prefix, router;
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -f file     nvm file standing in for the flash (th12.nvm)\n"
+		"  -e eui      EUI-64 in hex, default the one in the nvm file\n"
+		"  -t tun      tun interface (th12), - for no network\n"
+		"  -p prefix   /64 prefix of the node's DAG (fd00::)\n"
+		"  -r addr     the host's address on the tun, default route and DNS (fd00::1)\n"
+		"  -d file     recorded dht frames, default synthesized ones\n"
+		"  -T temp     synthesized temperature in C (21.5)\n"
+		"  -H humid    synthesized humidity in %% (45.0)\n"
+		"  -b mV       battery voltage (3000)\n"
+		"  -a chan=mV  voltage at another adc input\n",
+		prog);
+	exit(2);
+}
+
+static void
+options(int argc, char **argv)
+{
+	unsigned chan, mv;
+	int c;
+
+	sim.argv = argv;
+	sim.nvm = "th12.nvm";
+	sim.tun = "th12";
+	sim.t = 215;
+	sim.rh = 450;
+	sim.adc[0] = 3000 / 2;
+	uiplib_ipaddrconv("fd00::", &prefix);
+	uiplib_ipaddrconv("fd00::1", &router);
+
+	while ((c = getopt(argc, argv, "f:e:t:p:r:d:T:H:b:a:")) != -1) {
+		switch (c) {
+		case 'f':
+			sim.nvm = optarg;
+			break;
+		case 'e':
+			sim.eui = strtoull(optarg, NULL, 16);
+			break;
+		case 't':
+			sim.tun = strcmp(optarg, "-") ? optarg : NULL;
+			break;
+		case 'p':
+			if (!uiplib_ipaddrconv(optarg, &prefix)) {
+				usage(argv[0]);
+			}
+			break;
+		case 'r':
+			if (!uiplib_ipaddrconv(optarg, &router)) {
+				usage(argv[0]);
+			}
+			break;
+		case 'd':
+			sim.trace = optarg;
+			break;
+		case 'T':
+			sim.t = atof(optarg) * 10;
+			break;
+		case 'H':
+			sim.rh = atof(optarg) * 10;
+			break;
+		case 'b':
+			/* the battery goes to adc0 through a divider */
+			sim.adc[0] = atoi(optarg) / 2;
+			break;
+		case 'a':
+			if (sscanf(optarg, "%u=%u", &chan, &mv) != 2 || chan == 0 || chan >= SIM_ADC_CHANNELS) {
+				usage(argv[0]);
+			}
+			sim.adc[chan] = mv;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+}
+
+static void
+set_addresses(void)
+{
+	uint8_t i;
+
+	mc1322x_config_restore(&mc1322x_config);
+	if (sim.eui != 0 && sim.eui != mc1322x_config.eui) {
+		mc1322x_config.eui = sim.eui;
+		mc1322x_config_save(&mc1322x_config);
+	}
+	for (i = 0; i < sizeof(rimeaddr_node_addr.u8); i++) {
+		rimeaddr_node_addr.u8[i] = mc1322x_config.eui >> (56 - 8 * i);
+	}
+	rimeaddr_set_node_addr(&rimeaddr_node_addr);
+	memcpy(&uip_lladdr.addr, &rimeaddr_node_addr.u8, sizeof(uip_lladdr.addr));
+}
+
+/* the node is the root of its own DAG, so the application finds one */
+/* right away, and everything off the tun goes through the host */
+static void
+set_root(void)
+{
+	uip_ipaddr_t ipaddr;
+	rpl_dag_t *dag;
+
+	uip_ipaddr_copy(&ipaddr, &prefix);
+	uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+	uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+	dag = rpl_set_root(RPL_DEFAULT_INSTANCE, &ipaddr);
+	if (dag != NULL) {
+		rpl_set_prefix(dag, &prefix, 64);
+	}
+	uip_ds6_defrt_add(&router, 0);
+	resolv_conf(&router);
+
+	printf("address ");
+	uip_debug_ipaddr_print(&ipaddr);
+	printf(" via ");
+	uip_debug_ipaddr_print(&router);
+	printf("\n");
+}
+
+/* wait for the tun or the next timer */
+static void
+idle(void)
+{
+	clock_time_t now, ticks;
+	struct timeval tv;
+	uint64_t start, elapsed;
+	fd_set fds;
+	int fd;
+
+	now = clock_time();
+	ticks = IDLE_MAX_TICKS;
+	if (etimer_pending()) {
+		ticks = etimer_next_expiration_time() - now;
+		if ((long)ticks <= 0) {
+			etimer_request_poll();
+			return;
+		}
+		if (ticks > IDLE_MAX_TICKS) {
+			ticks = IDLE_MAX_TICKS;
+		}
+	}
+
+	tv.tv_sec = ticks / CLOCK_SECOND;
+	tv.tv_usec = (ticks % CLOCK_SECOND) * (1000000 / CLOCK_SECOND);
+	FD_ZERO(&fds);
+	fd = tun_fd();
+	if (fd >= 0) {
+		FD_SET(fd, &fds);
+	}
+
+	start = sim_clock_us();
+	if (select(fd + 1, &fds, NULL, NULL, &tv) < 0 && errno != EINTR) {
+		perror("select");
+	}
+	elapsed = (sim_clock_us() - start) * rtc_freq / 1000000;
+	idle_rtc_ticks += elapsed;
+	idle_rtc_total += elapsed;
+}
+
+int
+main(int argc, char **argv)
+{
+	options(argc, argv);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	clock_init();
+	sim_reset_init();
+	sim_nvm_init();
+	srand(getpid());
+
+	process_init();
+	process_start(&etimer_process, NULL);
+	ctimer_init();
+
+	set_addresses();
+
+#if WITH_UIP6
+	queuebuf_init();
+	NETSTACK_RDC.init();
+	NETSTACK_MAC.init();
+	NETSTACK_NETWORK.init();
+	print_netstack();
+	process_start(&tcpip_process, NULL);
+	set_root();
+	print_lladdrs();
+#endif /* endif WITH_UIP6 */
+
+	print_processes(autostart_processes);
+	autostart_start(autostart_processes);
+
+	/* Main scheduler loop */
+	while(1) {
+
+		sim_reset_check();
+		sim_dht_service();
+		tun_service();
+
+		if(etimer_pending() && !CLOCK_LT(clock_time(), etimer_next_expiration_time())) {
+			etimer_request_poll();
+		}
+
+		if(process_nevents() > 0) {
+			sched_runs++;
+			process_run();
+		} else {
+			idle();
+		}
+
+	}
+
+	return 0;
+}
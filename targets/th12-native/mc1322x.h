@@ -0,0 +1,126 @@
+#ifndef __MC1322X_H__
+#define __MC1322X_H__
+
+/* the parts of libmc1322x the TH12 application uses, simulated */
+/* registers are plain structs, sim.c acts on what the code writes */
+
+#include <stdint.h>
+
+/* clock and reset module */
+struct sim_crm {
+	volatile uint32_t RTC_COUNT;         /* refreshed on every CRM access */
+	volatile uint32_t SW_RST;            /* 0x87651234 restarts the process */
+	struct {
+		uint32_t EXT_OUT_POL;
+	} WU_CNTLbits;
+};
+struct sim_crm *sim_crm(void);
+#define CRM (sim_crm())
+
+extern uint32_t rtc_freq;
+
+/* sleep for ticks of the rtc, in virtual time */
+void rtimer_arch_sleep(uint32_t ticks);
+
+/* gpio, only the pins the TH12 uses */
+struct sim_pins {
+	uint8_t KBI1, KBI2, KBI5, TMR1, TMR2, GPIO_43;
+};
+struct sim_gpio {
+	struct sim_pins FUNC_SEL, PAD_DIR_SET, PAD_DIR_RESET, DATA;
+};
+extern struct sim_gpio sim_gpio;
+#define GPIO (&sim_gpio)
+
+enum { SIM_KBI1, SIM_KBI2, SIM_KBI5, SIM_TMR1, SIM_TMR2, SIM_GPIO_43 };
+void sim_gpio_out(uint8_t pin, uint8_t level);
+#define gpio_set(x) sim_gpio_out(SIM_##x, 1)
+#define gpio_reset(x) sim_gpio_out(SIM_##x, 0)
+
+/* interrupts are delivered by calling the isr from the main loop */
+#define enable_irq(x)
+#define disable_irq(x)
+
+/* timers, for the dht's edge capture */
+struct TMR_CTRL {
+	uint16_t COUNT_MODE, PRIMARY_CNT_SOURCE, SECONDARY_CNT_SOURCE,
+		ONCE, LENGTH, DIR, CO_INIT, OUTPUT_MODE;
+};
+struct TMR_SCTRL {
+	uint16_t OEN, OPS, VAL, EEOF, MSTR, CAPTURE_MODE, IPS, IEFIE,
+		TOFIE, TCFIE, IEF;
+};
+struct sim_tmr {
+	struct TMR_CTRL CTRLbits;
+	struct TMR_SCTRL SCTRLbits;
+	uint16_t CSCTRL;
+	struct {
+		uint16_t FILT_EN;
+	} CSCTRLbits;
+	uint16_t LOAD, COMP1, CNTR, CAPT, CTRL;
+};
+extern struct sim_tmr sim_tmr[2];
+extern uint16_t sim_tmr_enbl;
+/* not a macro, TMR1 is a pin name too */
+extern struct sim_tmr * const TMR1;
+#define TMR0_CTRL (&sim_tmr[0].CTRL)
+#define TMR1_CAPT (&sim_tmr[1].CAPT)
+#define TMR_ENBL (&sim_tmr_enbl)
+
+void tmr1_isr(void);
+
+/* adc, readings in mV from the command line */
+void adc_setup_chan(uint8_t chan);
+void adc_service(void);
+uint16_t adc_voltage(uint8_t chan);
+extern uint16_t adc_vbatt;
+
+/* radio, the tun interface has no channel */
+void maca_on(void);
+void maca_off(void);
+void set_channel(uint8_t chan);
+
+/* console */
+extern volatile uint32_t sim_utxcon;
+#define UART1_UTXCON (&sim_utxcon)
+void uart1_putc(char c);
+
+/* nvm, backed by a file the size of the flash */
+typedef enum {
+	gNvmInternalInterface_c,
+	gNvmExternalInterface_c,
+	gNvmInterfaceMax_c,
+} nvmInterface_t;
+
+typedef enum {
+	gNvmType_NoNvm_c,
+	gNvmType_SST_c,
+	gNvmType_ST_c,
+	gNvmType_ATM_c,
+	gNvmType_Max_c,
+} nvmType_t;
+
+typedef enum {
+	gNvmErrNoError_c = 0,
+	gNvmErrInvalidInterface_c,
+	gNvmErrInvalidNvmType_c,
+	gNvmErrInvalidPointer_c,
+	gNvmErrWriteProtect_c,
+	gNvmErrVerifyError_c,
+	gNvmErrAddressSpaceOverflow_c,
+	gNvmErrBlankCheckError_c,
+	gNvmErrRestrictedArea_c,
+	gNvmErrMaxError_c,
+} nvmErr_t;
+
+nvmErr_t nvm_detect(nvmInterface_t nvmInterface, nvmType_t *pNvmType);
+nvmErr_t nvm_read(nvmInterface_t nvmInterface, nvmType_t nvmType,
+		  void *pDest, uint32_t address, uint32_t numBytes);
+/* like the flash, a write can only clear bits */
+nvmErr_t nvm_write(nvmInterface_t nvmInterface, nvmType_t nvmType,
+		   void *pSrc, uint32_t address, uint32_t numBytes);
+/* one bit per 4k sector */
+nvmErr_t nvm_erase(nvmInterface_t nvmInterface, nvmType_t nvmType,
+		   uint32_t sectorBitfield);
+
+#endif /* __MC1322X_H__ */
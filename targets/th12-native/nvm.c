@@ -0,0 +1,143 @@
+/* the flash as a file, and the mc1322x config kept in it */
+
+/* every write goes straight to the file, so a reset or a kill loses */
+/* nothing the hardware wouldn't have kept */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "contiki.h"
+#include "mc1322x.h"
+#include "config.h"
+
+#include "sim.h"
+
+#define SECTOR_SIZE 0x1000
+
+mc1322x_config_t mc1322x_config;
+
+static int fd = -1;
+
+void sim_nvm_init(void)
+{
+	uint8_t blank[SECTOR_SIZE];
+	off_t size;
+	uint32_t a;
+
+	fd = open(sim.nvm, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		perror(sim.nvm);
+		exit(1);
+	}
+	size = lseek(fd, 0, SEEK_END);
+	if (size < SIM_NVM_SIZE) {
+		/* a new flash is erased */
+		memset(blank, 0xff, sizeof(blank));
+		for (a = size; a < SIM_NVM_SIZE; a += SECTOR_SIZE - a % SECTOR_SIZE) {
+			pwrite(fd, blank, SECTOR_SIZE - a % SECTOR_SIZE, a);
+		}
+	}
+}
+
+static int range_ok(uint32_t address, uint32_t n)
+{
+	return address <= SIM_NVM_SIZE && n <= SIM_NVM_SIZE - address;
+}
+
+nvmErr_t nvm_detect(nvmInterface_t nvmInterface, nvmType_t *pNvmType)
+{
+	(void)nvmInterface;
+	*pNvmType = gNvmType_SST_c;
+	return gNvmErrNoError_c;
+}
+
+nvmErr_t nvm_read(nvmInterface_t nvmInterface, nvmType_t nvmType,
+		  void *pDest, uint32_t address, uint32_t numBytes)
+{
+	(void)nvmInterface;
+	(void)nvmType;
+	if (!range_ok(address, numBytes)) {
+		return gNvmErrAddressSpaceOverflow_c;
+	}
+	if (pread(fd, pDest, numBytes, address) != (ssize_t)numBytes) {
+		return gNvmErrVerifyError_c;
+	}
+	return gNvmErrNoError_c;
+}
+
+nvmErr_t nvm_write(nvmInterface_t nvmInterface, nvmType_t nvmType,
+		   void *pSrc, uint32_t address, uint32_t numBytes)
+{
+	uint8_t old[256];
+	const uint8_t *src = pSrc;
+	uint32_t i, n;
+
+	(void)nvmInterface;
+	(void)nvmType;
+	if (!range_ok(address, numBytes)) {
+		return gNvmErrAddressSpaceOverflow_c;
+	}
+	while (numBytes > 0) {
+		n = numBytes < sizeof(old) ? numBytes : sizeof(old);
+		if (pread(fd, old, n, address) != (ssize_t)n) {
+			return gNvmErrVerifyError_c;
+		}
+		for (i = 0; i < n; i++) {
+			old[i] &= src[i];
+		}
+		if (pwrite(fd, old, n, address) != (ssize_t)n) {
+			return gNvmErrVerifyError_c;
+		}
+		src += n;
+		address += n;
+		numBytes -= n;
+	}
+	return gNvmErrNoError_c;
+}
+
+nvmErr_t nvm_erase(nvmInterface_t nvmInterface, nvmType_t nvmType,
+		   uint32_t sectorBitfield)
+{
+	uint8_t blank[SECTOR_SIZE];
+	uint32_t s;
+
+	(void)nvmInterface;
+	(void)nvmType;
+	memset(blank, 0xff, sizeof(blank));
+	for (s = 0; s < 32 && s * SECTOR_SIZE < SIM_NVM_SIZE; s++) {
+		if (sectorBitfield & (1UL << s)) {
+			pwrite(fd, blank, SECTOR_SIZE, s * SECTOR_SIZE);
+		}
+	}
+	return gNvmErrNoError_c;
+}
+
+void mc1322x_config_set_default(mc1322x_config_t *c)
+{
+	memset(c, 0, sizeof(*c));
+	c->magic = MC1322X_CONFIG_MAGIC;
+	c->version = MC1322X_CONFIG_VERSION;
+	/* a random extension in the Redwire development IAB, like the econotag */
+	c->eui = (0x0050C2A8Cull << 24) | (rand() & 0xffffff);
+	c->channel = RF_CHANNEL - 11;
+	c->power = 0x12;
+	c->flags.nvmtype = gNvmType_SST_c;
+}
+
+void mc1322x_config_restore(mc1322x_config_t *c)
+{
+	nvm_read(gNvmInternalInterface_c, gNvmType_SST_c, c, MC1322X_CONFIG_PAGE, sizeof(*c));
+	if (c->magic != MC1322X_CONFIG_MAGIC || c->version != MC1322X_CONFIG_VERSION) {
+		mc1322x_config_set_default(c);
+		mc1322x_config_save(c);
+	}
+}
+
+void mc1322x_config_save(mc1322x_config_t *c)
+{
+	nvm_erase(gNvmInternalInterface_c, gNvmType_SST_c, 1UL << (MC1322X_CONFIG_PAGE / SECTOR_SIZE));
+	nvm_write(gNvmInternalInterface_c, gNvmType_SST_c, c, MC1322X_CONFIG_PAGE, sizeof(*c));
+}
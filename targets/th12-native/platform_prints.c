@@ -0,0 +1 @@
+../th12/platform_prints.c
\ No newline at end of file
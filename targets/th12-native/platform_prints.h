@@ -0,0 +1 @@
+../th12/platform_prints.h
\ No newline at end of file
@@ -0,0 +1 @@
+../th12/platform_stats.h
\ No newline at end of file
@@ -0,0 +1,183 @@
+/* simulated TH12 peripherals: gpio, adc, radio, console and the dht */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "mc1322x.h"
+
+#include "sim.h"
+
+struct sim_opts sim;
+
+struct sim_gpio sim_gpio;
+struct sim_tmr sim_tmr[2];
+struct sim_tmr * const TMR1 = &sim_tmr[1];
+uint16_t sim_tmr_enbl;
+uint16_t adc_vbatt;
+volatile uint32_t sim_utxcon = 32;
+
+static uint8_t pins;
+
+void sim_gpio_out(uint8_t pin, uint8_t level)
+{
+	if (level) {
+		pins |= 1 << pin;
+	} else {
+		pins &= ~(1 << pin);
+	}
+}
+
+void adc_setup_chan(uint8_t chan)
+{
+	(void)chan;
+}
+
+void adc_service(void)
+{
+	adc_vbatt = sim.adc[0] * 2;
+}
+
+uint16_t adc_voltage(uint8_t chan)
+{
+	return chan < SIM_ADC_CHANNELS ? sim.adc[chan] : 0;
+}
+
+void maca_on(void)
+{
+}
+
+void maca_off(void)
+{
+}
+
+void set_channel(uint8_t chan)
+{
+	(void)chan;
+}
+
+void uart1_putc(char c)
+{
+	putchar(c);
+}
+
+/* dht frames */
+/* the sensor answers with alternating low and high pulses, starting low */
+/* a frame is the list of their widths in TMR1 ticks, 1.5 per us */
+/* a trace file has one frame per line and is replayed in a loop, */
+/* "-" is a read the sensor didn't answer, # starts a comment */
+
+#define FRAME_MAX (2 + 2 * 40 + 1)
+#define US(x) ((x) * 3 / 2)
+
+static FILE *trace;
+static uint16_t capt;
+
+static uint8_t jitter(void)
+{
+	return rand() % 7;
+}
+
+/* a nominal frame for the configured reading, with a little jitter */
+static int frame_synth(uint16_t *w)
+{
+	uint8_t dht[5];
+	uint16_t t;
+	int i, n = 0;
+
+	t = (sim.t < 0) ? (0x8000 | -sim.t) : sim.t;
+	dht[0] = sim.rh >> 8;
+	dht[1] = sim.rh;
+	dht[2] = t >> 8;
+	dht[3] = t;
+	dht[4] = dht[0] + dht[1] + dht[2] + dht[3];
+
+	w[n++] = US(80) + jitter();
+	w[n++] = US(80) + jitter();
+	for (i = 0; i < 40; i++) {
+		w[n++] = US(50) + jitter();
+		w[n++] = ((dht[i / 8] >> (7 - i % 8)) & 1) ? US(70) + jitter() : US(26) + jitter();
+	}
+	w[n++] = US(50) + jitter();
+	return n;
+}
+
+/* the next frame from the trace, 0 if the sensor doesn't answer */
+static int frame_trace(uint16_t *w)
+{
+	char line[1024], *p, *end;
+	int n, tries = 0;
+	long v;
+
+	while (tries < 2) {
+		if (fgets(line, sizeof(line), trace) == NULL) {
+			rewind(trace);
+			tries++;
+			continue;
+		}
+		if ((p = strchr(line, '#')) != NULL) {
+			*p = 0;
+		}
+		p = line;
+		while (*p == ' ' || *p == '\t') {
+			p++;
+		}
+		if (*p == '\n' || *p == 0) {
+			continue;
+		}
+		if (*p == '-') {
+			return 0;
+		}
+		for (n = 0; n < FRAME_MAX; n++) {
+			v = strtol(p, &end, 0);
+			if (end == p) {
+				break;
+			}
+			w[n] = v;
+			p = end;
+		}
+		return n;
+	}
+	fprintf(stderr, "%s: no frames\n", sim.trace);
+	exit(1);
+}
+
+/* dht.c releases the line to listen once it's done with the start pulse */
+void sim_dht_service(void)
+{
+	uint16_t w[FRAME_MAX];
+	int i, n;
+
+	if (!GPIO->PAD_DIR_RESET.TMR1) {
+		return;
+	}
+	GPIO->PAD_DIR_RESET.TMR1 = 0;
+	if (!(pins & (1 << SIM_KBI1))) {
+		/* not powered */
+		return;
+	}
+
+	if (sim.trace != NULL && trace == NULL) {
+		if ((trace = fopen(sim.trace, "r")) == NULL) {
+			perror(sim.trace);
+			exit(1);
+		}
+	}
+	n = trace ? frame_trace(w) : frame_synth(w);
+	if (n == 0) {
+		return;
+	}
+
+	/* one capture interrupt per edge, the first falls */
+	capt += rand();
+	for (i = 0; i <= n; i++) {
+		GPIO->DATA.TMR1 = i & 1;
+		*TMR1_CAPT = capt;
+		TMR1->SCTRLbits.IEF = 1;
+		tmr1_isr();
+		if (i < n) {
+			capt += w[i];
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef __SIM_H__
+#define __SIM_H__
+
+/* the simulated TH12 hardware, set up from the command line */
+
+#include <stdint.h>
+
+#define SIM_ADC_CHANNELS 8
+
+struct sim_opts {
+	char **argv;                 /* to restart on a software reset */
+	const char *nvm;             /* file standing in for the flash */
+	const char *tun;             /* tun interface, NULL for no network */
+	const char *trace;           /* recorded dht frames, NULL to synthesize */
+	uint64_t eui;                /* 0 to keep the one in the nvm file */
+	int16_t t;                   /* synthesized reading, C * 10 */
+	uint16_t rh;                 /* synthesized reading, % * 10 */
+	uint16_t adc[SIM_ADC_CHANNELS]; /* mV at each adc input */
+};
+
+extern struct sim_opts sim;
+
+/* clock.c: virtual time, real time plus everything slept */
+void sim_clock_init(void);
+/* us since start, including virtual sleep */
+uint64_t sim_clock_us(void);
+/* us slept in virtual time */
+uint64_t sim_slept_us(void);
+
+/* restart the process if the code asked for a reset */
+void sim_reset_check(void);
+/* and check for it in the background */
+void sim_reset_init(void);
+
+/* sim.c: replay a dht frame once the sensor has been asked for one */
+void sim_dht_service(void);
+
+/* nvm.c */
+void sim_nvm_init(void);
+
+#endif /* __SIM_H__ */
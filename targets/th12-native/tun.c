@@ -0,0 +1,189 @@
+/* IPv6 over a Linux tun interface for the native TH12 */
+
+/* takes the place of sicslowpan: packets go to and from the tun as they */
+/* are, the radio and MAC layers are only initialized. A tun has no */
+/* link layer so there is no one to answer neighbor discovery, this */
+/* answers the node's solicitations itself, except for DAD */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/netstack.h"
+
+#include "sim.h"
+#include "tun.h"
+
+#define IP_BUF (&uip_buf[UIP_LLH_LEN])
+#define IP_HDR 40
+#define ICMP6_NS 135
+#define ICMP6_NA 136
+#define NS_LEN 24
+#define LLAO_LEN 16
+
+static int fd = -1;
+
+/* a solicitation to answer on the next tun_service() */
+static uint8_t na_pending;
+static uint8_t na_target[16], na_dst[16];
+
+static int unspecified(const uint8_t *a)
+{
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		if (a[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* remember a neighbor solicitation, 1 if the packet was one */
+static int ns_catch(void)
+{
+	uint8_t *ip = IP_BUF;
+
+	if (uip_len < IP_HDR + NS_LEN || ip[6] != UIP_PROTO_ICMP6 || ip[IP_HDR] != ICMP6_NS) {
+		return 0;
+	}
+	/* duplicate address detection has to go unanswered */
+	if (!unspecified(&ip[8])) {
+		memcpy(na_target, &ip[IP_HDR + 8], 16);
+		memcpy(na_dst, &ip[8], 16);
+		na_pending = 1;
+	}
+	return 1;
+}
+
+static uint16_t sum16(uint32_t sum, const uint8_t *p, uint16_t n)
+{
+	while (n > 1) {
+		sum += (p[0] << 8) | p[1];
+		p += 2;
+		n -= 2;
+	}
+	if (n) {
+		sum += p[0] << 8;
+	}
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return sum;
+}
+
+/* a solicited advertisement from the target, as if it were a router */
+static void na_build(void)
+{
+	uint8_t *ip = IP_BUF;
+	uint8_t *icmp = ip + IP_HDR;
+	uint16_t len = NS_LEN + LLAO_LEN;
+	uint32_t sum;
+
+	memset(ip, 0, IP_HDR + len);
+	ip[0] = 0x60;
+	ip[4] = len >> 8;
+	ip[5] = len;
+	ip[6] = UIP_PROTO_ICMP6;
+	ip[7] = 255;
+	memcpy(&ip[8], na_target, 16);
+	memcpy(&ip[24], na_dst, 16);
+
+	icmp[0] = ICMP6_NA;
+	icmp[4] = 0xe0;                      /* router, solicited, override */
+	memcpy(&icmp[8], na_target, 16);
+	icmp[NS_LEN] = 2;                    /* target link layer address */
+	icmp[NS_LEN + 1] = LLAO_LEN / 8;
+	/* any address will do, make one from the interface id */
+	memcpy(&icmp[NS_LEN + 2], &na_target[8], 8);
+	icmp[NS_LEN + 2] ^= 0x02;
+
+	sum = len + UIP_PROTO_ICMP6;
+	sum = sum16(sum, &ip[8], 32);
+	sum = ~sum16(sum, icmp, len) & 0xffff;
+	icmp[2] = sum >> 8;
+	icmp[3] = sum;
+	uip_len = IP_HDR + len;
+}
+
+static uint8_t output(uip_lladdr_t *lladdr)
+{
+	(void)lladdr;
+	if (ns_catch() || fd < 0) {
+		return 0;
+	}
+	if (write(fd, IP_BUF, uip_len) < 0) {
+		perror("tun write");
+	}
+	return 1;
+}
+
+int tun_fd(void)
+{
+	return fd;
+}
+
+void tun_service(void)
+{
+	ssize_t n;
+
+	if (na_pending) {
+		na_pending = 0;
+		na_build();
+		tcpip_input();
+	}
+	if (fd < 0) {
+		return;
+	}
+	while ((n = read(fd, IP_BUF, UIP_BUFSIZE - UIP_LLH_LEN)) > 0) {
+		uip_len = n;
+		tcpip_input();
+	}
+	if (n < 0 && errno != EAGAIN && errno != EINTR) {
+		perror("tun read");
+	}
+}
+
+static void init(void)
+{
+	struct ifreq ifr;
+
+	tcpip_set_outputfunc(output);
+	if (sim.tun == NULL) {
+		printf("no network\n");
+		return;
+	}
+	if ((fd = open("/dev/net/tun", O_RDWR)) < 0) {
+		perror("/dev/net/tun");
+		exit(1);
+	}
+	memset(&ifr, 0, sizeof(ifr));
+	ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+	strncpy(ifr.ifr_name, sim.tun, IFNAMSIZ - 1);
+	if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+		fprintf(stderr, "tun %s: %s, create it with\n"
+			"  ip tuntap add %s mode tun user $USER\n",
+			sim.tun, strerror(errno), sim.tun);
+		exit(1);
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	printf("tun %s\n", ifr.ifr_name);
+}
+
+static void input(void)
+{
+}
+
+const struct network_driver tun_driver = {
+	"tun",
+	init,
+	input
+};
@@ -0,0 +1,14 @@
+#ifndef __TUN_H__
+#define __TUN_H__
+
+#include "net/netstack.h"
+
+extern const struct network_driver tun_driver;
+
+/* the tun's file descriptor to wait on, -1 without a network */
+int tun_fd(void);
+
+/* hand what arrived on the tun to the stack, from the main loop */
+void tun_service(void);
+
+#endif /* __TUN_H__ */
@@ -49,15 +49,161 @@
 
 /* econotag */
 #include "platform_prints.h"
+#include "platform_stats.h"
+
+/* after contiki.h and uip-debug.h */
+#include "tlog.h"
 
 SENSORS(&button_sensor);
 
+volatile uint32_t sched_runs;
+volatile uint32_t idle_rtc_ticks;
+volatile uint64_t idle_rtc_total;
+
+/* doze the MCU when there is nothing to run */
+#ifndef TH12_CONF_IDLE
+#define TH12_IDLE 1
+#else
+#define TH12_IDLE TH12_CONF_IDLE
+#endif
+
+/* don't bother dozing if the next timer is due within this many clock ticks */
+#define IDLE_MIN_TICKS 2
+/* upper bound on a single doze, also bounds the cost of a missed wakeup */
+#define IDLE_MAX_TICKS CLOCK_SECOND
+
 #ifndef M12_CONF_SERIAL
 #define M12_SERIAL 0x000000
 #else
 #define M12_SERIAL M12_CONF_SERIAL
 #endif
 
+#if TH12_IDLE
+/* put the MCU in doze until the next interrupt */
+/* clocks and peripherals keep running so the radio, uart and rtc can wake us */
+static void
+doze(void)
+{
+	CRM->SLEEP_CNTLbits.HIB = 0;
+	CRM->SLEEP_CNTLbits.DOZE = 1;
+
+	/* wait for the sleep cycle to complete */
+	while((*CRM_STATUS & 0x1) == 0) { continue; }
+	/* write 1 to sleep_sync --- this clears the bit (it's a r1wc bit) and enters doze */
+	*CRM_STATUS = 1;
+
+	/* wait for the wake cycle to complete */
+	while((*CRM_STATUS & 0x1) == 0) { continue; }
+	*CRM_STATUS = 1;
+
+	CRM->SLEEP_CNTLbits.DOZE = 0;
+}
+
+/* set the I bit in the cpsr and return the old cpsr */
+/* main.c may be thumb, which has no mrs/msr, so hop to arm mode and back */
+static uint32_t
+irq_mask(void)
+{
+	uint32_t cpsr, tmp;
+
+	asm volatile(
+#ifdef __thumb__
+		".align 2\n\t"
+		"bx pc\n\t"
+		"nop\n\t"
+		".arm\n\t"
+#endif
+		"mrs %0, cpsr\n\t"
+		"orr %1, %0, #0x80\n\t"
+		"msr cpsr_c, %1\n\t"
+#ifdef __thumb__
+		"add %1, pc, #1\n\t"
+		"bx %1\n\t"
+		".thumb\n\t"
+#endif
+		: "=&l" (cpsr), "=&l" (tmp) : : "memory");
+	return cpsr;
+}
+
+static void
+irq_restore(uint32_t cpsr)
+{
+	uint32_t tmp;
+
+	asm volatile(
+#ifdef __thumb__
+		".align 2\n\t"
+		"bx pc\n\t"
+		"nop\n\t"
+		".arm\n\t"
+#endif
+		"msr cpsr_c, %1\n\t"
+#ifdef __thumb__
+		"add %0, pc, #1\n\t"
+		"bx %0\n\t"
+		".thumb\n\t"
+#endif
+		: "=&l" (tmp) : "l" (cpsr) : "memory");
+}
+
+/* tickless idle: stretch the rtc tick that drives the contiki clock */
+/* out to the next etimer, doze, and then account for the ticks we skipped */
+static void
+idle(void)
+{
+	clock_time_t now, ticks;
+	uint32_t per_tick, start, elapsed, whole, cpsr;
+
+	now = clock_time();
+	if(etimer_pending()) {
+		ticks = etimer_next_expiration_time() - now;
+		if((int32_t)ticks < IDLE_MIN_TICKS) {
+			return;
+		}
+	} else {
+		ticks = IDLE_MAX_TICKS;
+	}
+	if(ticks > IDLE_MAX_TICKS) {
+		ticks = IDLE_MAX_TICKS;
+	}
+
+	/* an isr that polls a process after the main loop looked would */
+	/* otherwise leave it waiting out the whole doze; with the I bit set */
+	/* a pending source still ends the doze and its isr runs on restore */
+	cpsr = irq_mask();
+	if(process_nevents() > 0 || uart1_can_get()) {
+		irq_restore(cpsr);
+		return;
+	}
+
+	per_tick = rtc_freq / CLOCK_SECOND;
+	start = CRM->RTC_COUNT;
+	CRM->RTC_TIMEOUT = ticks * per_tick;
+
+	doze();
+	irq_restore(cpsr);
+
+	elapsed = CRM->RTC_COUNT - start;
+	whole = elapsed / per_tick;
+	if(clock_time() != now) {
+		/* rtc_isr ran: it counted one tick and went back to single ticks */
+		if(whole > 0) { whole--; }
+	} else {
+		/* woken early by another interrupt: finish the current tick normally */
+		CRM->RTC_TIMEOUT = per_tick - (elapsed % per_tick);
+	}
+	if(whole > 0) {
+		clock_adjust_ticks(whole);
+		if(etimer_pending() && etimer_next_expiration_time() <= clock_time()) {
+			etimer_request_poll();
+		}
+	}
+
+	idle_rtc_ticks += elapsed;
+	idle_rtc_total += elapsed;
+}
+#endif /* TH12_IDLE */
+
 int main(void) {
 
 	mc1322x_init();
@@ -152,8 +298,19 @@ int main(void) {
 				uart1_input_handler(uart1_getc());
 			}
 		}
-		
-		process_run();
+
+		/* deferred log records go out while we're awake anyway */
+		tlog_drain();
+
+		if(process_nevents() > 0) {
+			sched_runs++;
+			process_run();
+		}
+#if TH12_IDLE
+		else if(uart1_can_get() == 0) {
+			idle();
+		}
+#endif
 
 	}
 	
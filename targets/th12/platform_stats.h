@@ -0,0 +1,17 @@
+#ifndef PLATFORM_STATS_H
+#define PLATFORM_STATS_H
+
+#include <stdint.h>
+
+/* counters kept by the main scheduler loop */
+/* the application resets them on each wake and reports them before sleeping */
+
+/* main loop passes that had an event or poll to dispatch */
+extern volatile uint32_t sched_runs;
+/* rtc ticks spent dozing in the idle path */
+extern volatile uint32_t idle_rtc_ticks;
+
+/* the same but never reset, for energy accounting */
+extern volatile uint64_t idle_rtc_total;
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef __TH12_FLASH_H__
+#define __TH12_FLASH_H__
+
+/* where everything lives in the 128k nvm, the only place these are set */
+/* the program image starts at 0 and the mc1322x keeps its own config */
+/* page at MC1322X_CONFIG_PAGE, 0x1E000 */
+
+#define FLASH_PAGE_SIZE 0x1000       /* erase sector */
+
+/* store-and-forward log of readings, see readlog.h */
+#define READLOG_PAGE 0x1A000
+#define READLOG_PAGES 2
+
+/* config and state records, see recstore.h */
+#define RECSTORE_PAGE 0x1C000
+#define RECSTORE_PAGES 2
+
+/* before the record store the config and the state had a page each */
+/* they are read once at boot to migrate and are the record store's pages now */
+#define TH12_LEGACY_STATE_PAGE 0x1C000
+#define TH12_LEGACY_CONFIG_PAGE 0x1D000
+
+#define FLASH_END(page, pages) ((page) + (pages) * FLASH_PAGE_SIZE)
+#define FLASH_APART(a, na, b, nb) (FLASH_END(a, na) <= (b) || FLASH_END(b, nb) <= (a))
+#define FLASH_WITHIN(a, b, nb) ((a) >= (b) && FLASH_END(a, 1) <= FLASH_END(b, nb))
+
+/* compile time checks: the regions don't overlap */
+typedef char readlog_apart_from_recstore[FLASH_APART(READLOG_PAGE, READLOG_PAGES, RECSTORE_PAGE, RECSTORE_PAGES) ? 1 : -1];
+typedef char legacy_state_in_recstore[FLASH_WITHIN(TH12_LEGACY_STATE_PAGE, RECSTORE_PAGE, RECSTORE_PAGES) ? 1 : -1];
+typedef char legacy_config_in_recstore[FLASH_WITHIN(TH12_LEGACY_CONFIG_PAGE, RECSTORE_PAGE, RECSTORE_PAGES) ? 1 : -1];
+#ifdef MC1322X_CONFIG_PAGE
+typedef char readlog_apart_from_mc1322x[FLASH_APART(READLOG_PAGE, READLOG_PAGES, MC1322X_CONFIG_PAGE, 1) ? 1 : -1];
+typedef char recstore_apart_from_mc1322x[FLASH_APART(RECSTORE_PAGE, RECSTORE_PAGES, MC1322X_CONFIG_PAGE, 1) ? 1 : -1];
+#endif
+
+#endif /* __TH12_FLASH_H__ */
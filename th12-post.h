@@ -0,0 +1,100 @@
+#ifndef __TH12_POST_H__
+#define __TH12_POST_H__
+
+/* the config defaults and post cycle constants of coap-post-sleep.c */
+/* post-cycle.c and tools/sim/fleetsim.c include this too, so the */
+/* firmware and the fleet bench can't drift apart on these */
+
+#include "senml.h"
+
+/* default POST location */
+/* hostname for the sink */
+#define DEFAULT_SINK_NAME "coap-8.lowpan.com"
+/* path to post to */
+#define DEFAULT_SINK_PATH "/sink"
+
+/* with a 5 min post interval the sink is checked on every wake until a check */
+/* gets through, then the gap doubles up to every 256th wake, about 21h. A post */
+/* that doesn't reach the parent brings the next check forward, and one failed */
+/* check reboots the node, so it recovers within two wakes of noticing */
+
+/* how long to wait between posts */
+#define DEFAULT_POST_INTERVAL 300
+/* stay awake for this long on power up */
+#define DEFAULT_WAKE_TIME 120
+/* perform a sink check this number of wake cycles */
+#define DEFAULT_POSTS_PER_CHECK 256
+/* after SINK_CHECK_TRIES of sink check failures, the node will reboot itself */
+#define DEFAULT_MAX_POST_FAILS 1
+/* whether or not the sensor is allowed to sleep */
+#define DEFAULT_SLEEP_ALLOWED 1
+/* payload format for posts */
+#define DEFAULT_PAYLOAD_FORMAT FORMAT_JSON
+/* number of readings per post */
+#define DEFAULT_BATCH_SIZE 1
+/* readings within the deadband of the last reported one aren't posted */
+/* in 0.1C and 0.1%, 0 leaves that quantity out, 0 for both turns the deadband off */
+#define DEFAULT_DEADBAND_T 0
+#define DEFAULT_DEADBAND_RH 0
+/* seconds: post at least this often even if nothing changed */
+#define DEFAULT_HEARTBEAT 3600
+/* seconds: how long a resolved sink address is used before it's refreshed */
+#define DEFAULT_SINK_TTL 86400UL
+
+/* payload formats, selected with the "format" config param */
+enum {
+  FORMAT_JSON,       /* {"t":" 22.1C","h":"18.3%","vb":"2678mV"} */
+  FORMAT_SENML_CBOR, /* SenML-CBOR with the raw fixed-point values */
+};
+
+/* try to reread the sensor this many times if it reports a bad checksum before giving up */
+#define SENSOR_RETRIES 3
+/* how far in the future to schedule the retry. Should be short */
+#define RETRY_INTERVAL (0.05 * CLOCK_SECOND)
+
+/* readings waiting to be posted, a ring that drops the oldest when full */
+#define BATCH_MAX 6
+
+/* first post after power up, and after a reboot with a saved parent */
+#define FIRST_POST (5 * CLOCK_SECOND)
+#define REJOIN_FIRST_POST (1 * CLOCK_SECOND)
+/* the first post is also spread over this many seconds by the slot */
+#define SLOT_BOOT_SPREAD 30
+
+/* with th12mac a NON post sleeps as soon as its frames are ACKed by the parent */
+/* SLEEP_AFTER_POST is then only a fallback. If a frame isn't ACKed the post */
+/* is sent again this many times before giving up and forcing a sink check */
+#define POST_TX_RETRIES 1
+
+/* CON sink checks do their own retransmissions, timed from a CoCoA RTO */
+/* estimate of the path to the sink instead of the engine's fixed backoff */
+#define CON_MAX_RETRANSMIT 4
+
+/* NON posts in a row without an answer before the checks are brought forward */
+#define NON_UNANSWERED_MAX 3
+
+/* readings from posts that didn't get through are kept in a flash log */
+/* and sent after a good sink check, LOG_DRAIN_MAX at a time in up to */
+/* LOG_DRAIN_POSTS CONs per wake */
+#define LOG_DRAIN_MAX 14
+#define LOG_DRAIN_POSTS 2
+
+/* longest mailbox ack query: mbx=65535 */
+#define MAILBOX_ACK_MAX 9
+
+/* a sensor post should fit in one 127 byte 802.15.4 frame so 6LoWPAN doesn't fragment it */
+/* mac: fcf, seq, pan id, two long addresses and fcs */
+/* 6lowpan: iphc with the sink's global address inline and compressed udp */
+/* coap: header, the default uri path, content-format and a mailbox ack */
+#define FRAME_MAX 127
+#define FRAME_MAC_OVERHEAD 23
+#define FRAME_IPHC_OVERHEAD 25
+#define FRAME_COAP_OVERHEAD (4 + sizeof(DEFAULT_SINK_PATH) + 2 + 1 + MAILBOX_ACK_MAX)
+#define FRAME_PAYLOAD_MAX (FRAME_MAX - FRAME_MAC_OVERHEAD - FRAME_IPHC_OVERHEAD - FRAME_COAP_OVERHEAD)
+
+/* largest SenML-CBOR sensor message: t, h and vb */
+#define DHT_MSG_CBOR_MAX (1 + SENML_DECIMAL_MAX(1) + SENML_DECIMAL_MAX(1) + SENML_DECIMAL_MAX(2))
+/* older readings in a batch add a record for t and h with a 32-bit relative time */
+#define BATCH_SAMPLE_CBOR_MAX (2 * SENML_DECIMAL_AT_MAX(1))
+
+#endif /* __TH12_POST_H__ */
@@ -0,0 +1,163 @@
+/* deferred binary logging, see tlog.h */
+
+#include <stdarg.h>
+
+#include "contiki.h"
+#include "mc1322x.h"
+
+#include "tlog.h"
+
+#if TLOG_ON
+
+/* depth of the UART1 TX FIFO, UTXCON counts its free bytes */
+#define UART_FIFO 32
+
+/* the linker provides this for the tlog_fmts section */
+extern const char __start_tlog_fmts[];
+
+static uint8_t ring[TLOG_SIZE];
+static uint16_t head, tail;
+static uint32_t dropped;
+
+static uint16_t ring_free(void)
+{
+	return (tail + TLOG_SIZE - head - 1) % TLOG_SIZE;
+}
+
+static void ring_put(const uint8_t *rec, uint8_t len)
+{
+	while (len-- > 0) {
+		ring[head] = *rec++;
+		head = (head + 1) % TLOG_SIZE;
+	}
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+	*p++ = v;
+	*p++ = v >> 8;
+	*p++ = v >> 16;
+	*p++ = v >> 24;
+	return p;
+}
+
+static uint8_t *header(uint8_t *rec, uint16_t id)
+{
+	uint16_t now = clock_time();
+
+	rec[0] = TLOG_SYNC;
+	rec[2] = id;
+	rec[3] = id >> 8;
+	rec[4] = now;
+	rec[5] = now >> 8;
+	return rec + TLOG_HEADER;
+}
+
+/* walk the conversions in fmt for the size of each arg */
+static uint8_t *args(uint8_t *p, uint8_t *end, const char *fmt, va_list ap)
+{
+	const uint8_t *b;
+	const char *s;
+	uint8_t n, lng, max;
+
+	for (; *fmt; fmt++) {
+		if (*fmt != '%') {
+			continue;
+		}
+		lng = 0;
+		for (fmt++; *fmt; fmt++) {
+			if (*fmt == 'l') {
+				lng = 1;
+			} else if (!(*fmt == '-' || *fmt == '+' || *fmt == ' ' || *fmt == '#' ||
+				     *fmt == '.' || *fmt == 'h' || (*fmt >= '0' && *fmt <= '9'))) {
+				break;
+			}
+		}
+		switch (*fmt) {
+		case '\0':
+			return p;
+		case '%':
+			break;
+		case 's':
+			if (end - p < 1) {
+				return p;
+			}
+			s = va_arg(ap, const char *);
+			max = end - p - 1;
+			if (max > TLOG_STR_MAX) {
+				max = TLOG_STR_MAX;
+			}
+			for (n = 0; n < max && s[n]; n++) {
+				p[1 + n] = s[n];
+			}
+			p[0] = n | (s[n] ? 0x80 : 0);
+			p += 1 + n;
+			break;
+		case 'I':
+		case 'L':
+			n = (*fmt == 'I') ? 16 : 8;
+			if (end - p < n) {
+				return p;
+			}
+			b = va_arg(ap, const uint8_t *);
+			while (n-- > 0) {
+				*p++ = *b++;
+			}
+			break;
+		default:
+			if (end - p < 4) {
+				return p;
+			}
+			p = put32(p, lng ? va_arg(ap, unsigned long) : va_arg(ap, unsigned int));
+			break;
+		}
+	}
+	return p;
+}
+
+void tlog(const char *fmt, ...)
+{
+	uint8_t rec[TLOG_REC_MAX];
+	uint8_t *p;
+	va_list ap;
+
+	if (dropped > 0 && ring_free() >= TLOG_HEADER + 4) {
+		p = put32(header(rec, TLOG_DROPPED), dropped);
+		rec[1] = p - rec - 2;
+		ring_put(rec, p - rec);
+		dropped = 0;
+	}
+
+	va_start(ap, fmt);
+	p = args(header(rec, fmt - __start_tlog_fmts), rec + sizeof(rec), fmt, ap);
+	va_end(ap);
+	rec[1] = p - rec - 2;
+
+	if (dropped > 0 || ring_free() < p - rec) {
+		dropped++;
+		return;
+	}
+	ring_put(rec, p - rec);
+}
+
+void tlog_drain(void)
+{
+	uint32_t room;
+	uint8_t len;
+
+	while (tail != head) {
+		len = ring[(tail + 1) % TLOG_SIZE] + 2;
+		room = *UART1_UTXCON;
+		/* records longer than the FIFO start on an empty one, the */
+		/* rest fits the driver's buffer */
+		if (len > room && room < UART_FIFO) {
+			return;
+		}
+		while (len-- > 0) {
+			uart1_putc(ring[tail]);
+			tail = (tail + 1) % TLOG_SIZE;
+		}
+	}
+}
+
+#endif /* TLOG_ON */
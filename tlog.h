@@ -0,0 +1,74 @@
+#ifndef __TLOG_H__
+#define __TLOG_H__
+
+#include <stdint.h>
+
+/* deferred binary logging: a log call stores the id of its format string */
+/* and its raw arguments in a RAM ring instead of formatting them, and */
+/* the main loop sends whole records to UART1 when its FIFO has room. */
+/* tools/tlog-decode.py turns them back into text with the format */
+/* strings from the firmware's ELF, they're kept in the tlog_fmts section */
+
+/* on the wire, and in the ring, a record is */
+/*   TLOG_SYNC, length of the rest, 16 bit id, 16 bit clock_time(), args */
+/* little endian. The id is the format's offset in tlog_fmts */
+/* integer and char args take 4 bytes, %s a length byte (bit 7 set if */
+/* truncated) and the text, %I an ipv6 address as 16 bytes and %L a */
+/* link layer address as 8. Plain printf text on the same UART can sit */
+/* between records but never inside one, it's all below TLOG_SYNC */
+
+#ifdef TLOG_CONF_ON
+#define TLOG_ON TLOG_CONF_ON
+#else
+#define TLOG_ON 0
+#endif
+
+#ifdef TLOG_CONF_SIZE
+#define TLOG_SIZE TLOG_CONF_SIZE
+#else
+#define TLOG_SIZE 512
+#endif
+
+#define TLOG_SYNC 0xff
+#define TLOG_HEADER 6
+/* the UART FIFO plus the uart1 driver's buffer, so a record never blocks */
+#define TLOG_REC_MAX 64
+#define TLOG_STR_MAX 32
+/* this record's one arg counts records lost to a full ring */
+#define TLOG_DROPPED 0xffff
+
+#if TLOG_ON
+
+#define TLOG(fmt, ...) do { \
+	static const char tlog_fmt[] __attribute__((section("tlog_fmts"))) = fmt; \
+	tlog(tlog_fmt, ##__VA_ARGS__); \
+} while(0)
+
+/* fmt must live in tlog_fmts, use TLOG(). Not from interrupts */
+void tlog(const char *fmt, ...);
+
+/* send whole records while the UART has room, from the main loop */
+void tlog_drain(void);
+
+/* route uip-debug.h's PRINTF and ANNOTATE through the ring */
+/* include this after net/uip-debug.h */
+#if defined(DEBUG) && ((DEBUG) & DEBUG_PRINT)
+#undef PRINTF
+#define PRINTF(...) TLOG(__VA_ARGS__)
+#undef PRINT6ADDR
+#define PRINT6ADDR(addr) TLOG("%I", (const uint8_t *)(addr))
+#undef PRINTLLADDR
+#define PRINTLLADDR(lladdr) TLOG("%L", (const uint8_t *)(lladdr))
+#endif
+#if defined(DEBUG) && ((DEBUG) & DEBUG_ANNOTATE)
+#undef ANNOTATE
+#define ANNOTATE(...) TLOG(__VA_ARGS__)
+#endif
+
+#else /* TLOG_ON */
+
+#define tlog_drain()
+
+#endif /* TLOG_ON */
+
+#endif /* __TLOG_H__ */
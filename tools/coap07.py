@@ -0,0 +1,130 @@
+"""Minimal CoAP draft-07 framing, as spoken by er-coap-07 on the nodes.
+
+The header carries an option count, the token is option 11 and there is
+no payload marker. Just enough for the tools in this directory.
+"""
+
+import os
+import socket
+import struct
+
+COAP_PORT = 5683
+
+CON, NON, ACK, RST = 0, 1, 2, 3
+POST = 2
+CHANGED = 68          # 2.04
+
+OPT_CONTENT_TYPE = 1
+OPT_URI_PATH = 9
+OPT_TOKEN = 11
+OPT_URI_QUERY = 15
+
+APPLICATION_JSON = 50
+APPLICATION_CBOR = 60
+SENML_CBOR = 112
+
+
+# draft-07 messages
+
+def parse(data):
+    if len(data) < 4:
+        raise ValueError("short message")
+    ver = data[0] >> 6
+    if ver != 1:
+        raise ValueError("version %d" % ver)
+    msg = {"type": (data[0] >> 4) & 3, "code": data[1],
+           "mid": struct.unpack(">H", data[2:4])[0], "options": []}
+    count = data[0] & 0x0f
+    i, number, seen = 4, 0, 0
+    while count == 15 or seen < count:
+        if i >= len(data):
+            if count == 15:
+                break
+            raise ValueError("truncated options")
+        if count == 15 and data[i] == 0xf0:
+            i += 1
+            break
+        number += data[i] >> 4
+        length = data[i] & 0x0f
+        i += 1
+        if length == 15:
+            length += data[i]
+            i += 1
+        seen += 1
+        # fenceposts, multiples of 14 with no value, only move the number on
+        if number % 14 or length:
+            msg["options"].append((number, bytes(data[i:i + length])))
+        i += length
+    msg["payload"] = bytes(data[i:])
+    return msg
+
+
+def option(msg, number):
+    return [v for n, v in msg["options"] if n == number]
+
+
+def build(type_, code, mid, options, payload):
+    out = bytearray()
+    number = 0
+    opts = bytearray()
+    n_opts = 0
+    for num, value in sorted(options, key=lambda o: o[0]):
+        while num - number > 15:
+            # fencepost to get within reach
+            fence = (number // 14 + 1) * 14
+            opts.append((fence - number) << 4)
+            number = fence
+            n_opts += 1
+        length = len(value)
+        if length < 15:
+            opts.append(((num - number) << 4) | length)
+        else:
+            opts.append(((num - number) << 4) | 15)
+            opts.append(length - 15)
+        opts += value
+        number = num
+        n_opts += 1
+    if n_opts > 14:
+        raise ValueError("too many options")
+    out.append(0x40 | (type_ << 4) | n_opts)
+    out.append(code)
+    out += struct.pack(">H", mid)
+    out += opts
+    out += payload
+    return bytes(out)
+
+
+def uint_bytes(v):
+    out = b""
+    while v:
+        out = bytes([v & 0xff]) + out
+        v >>= 8
+    return out
+
+
+GET = 1
+CONTENT = 69          # 2.05
+
+
+def request(host, path, code=GET, payload=b"", port=COAP_PORT, timeout=5.0, retries=3):
+    """Send a CON request and return the parsed response."""
+    mid = struct.unpack(">H", os.urandom(2))[0]
+    options = [(OPT_URI_PATH, p.encode()) for p in path.strip("/").split("/") if p]
+    msg = build(CON, code, mid, options, payload)
+    info = socket.getaddrinfo(host, port, 0, socket.SOCK_DGRAM)[0]
+    sock = socket.socket(info[0], socket.SOCK_DGRAM)
+    sock.settimeout(timeout)
+    try:
+        for _ in range(retries + 1):
+            sock.sendto(msg, info[4])
+            try:
+                while True:
+                    data, _src = sock.recvfrom(1500)
+                    response = parse(data)
+                    if response["mid"] == mid:
+                        return response
+            except socket.timeout:
+                continue
+    finally:
+        sock.close()
+    raise TimeoutError("no response from %s" % host)
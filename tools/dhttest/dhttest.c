@@ -0,0 +1,149 @@
+/* host test for the DHT22 decoder */
+
+/* replays the frames in frames.txt through dht-decode.c one edge at a */
+/* time, like tmr1_isr() would, and checks each against the expectation */
+/* in its comment: the decoded bytes, the checksum, the confidence and */
+/* that a full frame completes on the falling edge of the 40th bit, one */
+/* edge before the line goes idle. */
+
+/*   make                 build and run against frames.txt */
+/*   ./dhttest file       run against another trace */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "dht-decode.h"
+
+#define FRAME_MAX (2 + 2 * DHT_BITS + 1)
+/* the edge that ends the 40th high pulse */
+#define DONE_EDGE (2 + 2 * DHT_BITS)
+
+static int failed;
+
+static void fail(int line, const char *what)
+{
+	printf("line %d: %s\n", line, what);
+	failed++;
+}
+
+static int parse_hex(const char *p, uint8_t *dht)
+{
+	unsigned int v;
+	int i;
+
+	for (i = 0; i < DHT_BYTES; i++) {
+		if (sscanf(p + 2 * i, "%2x", &v) != 1) {
+			return -1;
+		}
+		dht[i] = v;
+	}
+	return 0;
+}
+
+static void check(int line, const uint16_t *w, int n, char *expect)
+{
+	struct dht_decoder dec;
+	char result[8];
+	uint8_t dht[DHT_BYTES];
+	int min_conf = 0, done = 0, done_edge = -1;
+	uint16_t capt = 0xff80;   /* the capture timer wraps mid-frame */
+	char bytes[16] = "";
+	int i;
+
+	if (sscanf(expect, "%7s %15s %d", result, bytes, &min_conf) < 1) {
+		fail(line, "no expectation");
+		return;
+	}
+
+	/* one capture per edge, the first falls */
+	dht_decode_init(&dec);
+	for (i = 0; i <= n; i++) {
+		if (dht_decode_edge(&dec, i & 1, capt) == DHT_DECODE_DONE) {
+			done++;
+			done_edge = i;
+		}
+		if (i < n) {
+			capt += w[i];
+		}
+	}
+	dht_decode_finish(&dec);
+
+	if (strcmp(result, "short") == 0) {
+		if (done != 0) {
+			fail(line, "a short frame completed");
+		}
+		if (dht_decode_ok(&dec) || dec.conf != 0) {
+			fail(line, "a short frame decoded");
+		}
+		return;
+	}
+
+	if (done != 1 || done_edge != DONE_EDGE) {
+		fail(line, "not done exactly once on the last bit");
+	}
+	if (parse_hex(bytes, dht) != 0) {
+		fail(line, "bad bytes in the expectation");
+		return;
+	}
+	if (memcmp(dec.dht, dht, DHT_BYTES) != 0) {
+		fail(line, "wrong bytes");
+		printf("  %02x%02x%02x%02x%02x, expected %s\n",
+		       dec.dht[0], dec.dht[1], dec.dht[2], dec.dht[3], dec.dht[4], bytes);
+	}
+	if (strcmp(result, "ok") == 0) {
+		if (!dht_decode_ok(&dec)) {
+			fail(line, "checksum didn't pass");
+		}
+		if (dec.conf < min_conf) {
+			fail(line, "confidence too low");
+			printf("  %d, expected at least %d\n", dec.conf, min_conf);
+		}
+	} else if (strcmp(result, "bad") == 0) {
+		if (dht_decode_ok(&dec)) {
+			fail(line, "bad checksum passed");
+		}
+	} else {
+		fail(line, "unknown expectation");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = argc > 1 ? argv[1] : "frames.txt";
+	char text[1024], *p, *end, *expect;
+	uint16_t w[FRAME_MAX];
+	int line = 0, frames = 0, n;
+	FILE *f;
+
+	if ((f = fopen(name, "r")) == NULL) {
+		perror(name);
+		return 1;
+	}
+	while (fgets(text, sizeof(text), f) != NULL) {
+		line++;
+		if ((expect = strchr(text, '#')) == NULL) {
+			continue;
+		}
+		*expect++ = 0;
+		for (n = 0, p = text; n < FRAME_MAX; n++) {
+			long v = strtol(p, &end, 0);
+			if (end == p) {
+				break;
+			}
+			w[n] = v;
+			p = end;
+		}
+		if (n == 0) {
+			/* a comment line */
+			continue;
+		}
+		check(line, w, n, expect);
+		frames++;
+	}
+	fclose(f);
+
+	printf("%d frames, %d failed\n", frames, failed);
+	return failed != 0 || frames == 0;
+}
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Battery budget from a TH12's /energy counters.
+
+/energy reports seconds per power state since boot. cpu, idle and sleep
+split the uptime between them, rx, tx, sensor and flash draw on top.
+Multiplied by a current per state this gives the charge used, mAh per
+day and the projected battery life.
+
+    energy.py --node fd00::250:c2a8:c000:1      fetch and report
+    energy.py energy.json                       a saved /energy response
+    energy.py before.json after.json            only what happened in between
+    energy.py --current rx=18.5 --capacity 1200 energy.json
+
+The default currents are typical MC13224V figures for the MCU and radio
+plus a DHT22; measure your board and override them.
+"""
+
+import argparse
+import json
+import sys
+
+import coap07
+
+# mA per state
+CURRENTS = {
+    "cpu": 3.3,        # MCU running, radio off
+    "idle": 0.8,       # MCU dozing in the idle loop
+    "sleep": 0.005,    # hibernate with the RTC and RAM retention, board leakage
+    "rx": 22.0,        # radio on, receiving
+    "tx": 29.0,        # radio sending at 0dBm
+    "sensor": 1.5,     # DHT22 powered
+    "flash": 10.0,     # nvm erase or program
+}
+BASE = ("cpu", "idle", "sleep")
+STATES = ("cpu", "idle", "sleep", "rx", "tx", "sensor", "flash")
+
+DEFAULT_CAPACITY = 2500    # mAh, two AA alkaline cells
+
+
+def load(source):
+    if source == "-":
+        return json.load(sys.stdin)
+    with open(source) as f:
+        return json.load(f)
+
+
+def fetch(node, port):
+    response = coap07.request(node, "energy", port=port)
+    if response["code"] != coap07.CONTENT:
+        sys.exit("%s: /energy answered %d.%02d" % (node, response["code"] >> 5, response["code"] & 31))
+    return json.loads(response["payload"])
+
+
+def delta(before, after):
+    if after["up"] < before["up"]:
+        sys.exit("the node rebooted between the two snapshots")
+    return {k: after[k] - before.get(k, 0) for k in after}
+
+
+def report(e, currents, capacity):
+    up = e["up"]
+    if up <= 0:
+        sys.exit("no time to report on")
+    charge = {s: e.get(s, 0) * currents[s] for s in STATES}    # mA * s
+    total = sum(charge.values())
+    per_day = total / up * 86400 / 3600
+
+    print("%-8s %12s %7s %8s %10s %7s" % ("state", "seconds", "time", "mA", "mAh/day", "charge"))
+    for s in STATES:
+        t = e.get(s, 0)
+        print("%-8s %12.3f %6.2f%% %8.3f %10.4f %6.2f%%" % (
+            s, t, 100.0 * t / up, currents[s],
+            charge[s] / up * 86400 / 3600, 100.0 * charge[s] / total if total else 0))
+    base = sum(e.get(s, 0) for s in BASE)
+    if abs(base - up) > 0.01 * up + 1:
+        print("warning: cpu+idle+sleep is %.1fs of %.1fs uptime" % (base, up))
+
+    print()
+    print("over %.1f hours: %.4f mAh, average %.4f mA" % (up / 3600, total / 3600, total / up))
+    print("%.3f mAh/day" % per_day)
+    if per_day > 0:
+        days = capacity / per_day
+        print("%.0f mAh lasts %.0f days (%.1f years)" % (capacity, days, days / 365))
+
+
+def main():
+    p = argparse.ArgumentParser(description="mAh per day and battery life from /energy")
+    p.add_argument("snapshots", nargs="*", help="saved /energy responses, - for stdin; two for a difference")
+    p.add_argument("--node", help="fetch /energy from this node instead")
+    p.add_argument("--port", type=int, default=coap07.COAP_PORT)
+    p.add_argument("--current", action="append", default=[], metavar="state=mA",
+                   help="override a current, states: " + ", ".join(STATES))
+    p.add_argument("--capacity", type=float, default=DEFAULT_CAPACITY, help="battery mAh")
+    args = p.parse_args()
+
+    currents = dict(CURRENTS)
+    for c in args.current:
+        state, _, ma = c.partition("=")
+        if state not in currents:
+            sys.exit("unknown state %s" % state)
+        currents[state] = float(ma)
+
+    if args.node:
+        snaps = [fetch(args.node, args.port)]
+    else:
+        snaps = [load(s) for s in args.snapshots]
+    if len(snaps) == 1:
+        e = snaps[0]
+    elif len(snaps) == 2:
+        e = delta(snaps[0], snaps[1])
+    else:
+        p.error("give one or two snapshots, or --node")
+    report(e, currents, args.capacity)
+
+
+if __name__ == "__main__":
+    main()
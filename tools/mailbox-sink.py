@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+"""Reference sink with a config mailbox for TH12 nodes.
+
+Answers the nodes' sensor posts like a normal sink and piggybacks any
+pending config change for the posting node on the response, so a node
+is reconfigured without a wake window. A low-power node only hears the
+answers to its CON sink checks, so that is where its delta lands. Every
+response also carries the sink's time, {"ts":1760000000}, which the
+nodes use to line up their post slots.
+
+Pending changes are kept per EUI-64 in a JSON file:
+
+    {"0050c2a8c0000001": {"seq": 3, "set": {"interval": 600}}}
+
+    mailbox-sink.py set mailbox.json 0050c2a8c0000001 interval=600 netloc=sink.local
+    mailbox-sink.py list mailbox.json
+    mailbox-sink.py serve mailbox.json [--port 5683]
+
+The node answers a delta with ?mb=<seq> (applied) or ?mbx=<seq>
+(rejected) on its next posts; either ends the delivery. Changes added
+while a delta is outstanding are merged into it under a new seq.
+
+The nodes run er-coap-07, so this speaks draft-07 framing, see coap07.py.
+"""
+
+import argparse
+import json
+import os
+import socket
+import struct
+import sys
+import time
+
+from coap07 import (COAP_PORT, CON, NON, ACK, POST, CHANGED,
+                    OPT_CONTENT_TYPE, OPT_TOKEN, OPT_URI_QUERY,
+                    APPLICATION_JSON, APPLICATION_CBOR, SENML_CBOR,
+                    parse, option, build, uint_bytes)
+
+
+# payload encodings of a delta
+
+def cbor_head(major, v):
+    if v < 24:
+        return bytes([major << 5 | v])
+    if v < 0x100:
+        return bytes([major << 5 | 24, v])
+    if v < 0x10000:
+        return bytes([major << 5 | 25]) + struct.pack(">H", v)
+    return bytes([major << 5 | 26]) + struct.pack(">I", v)
+
+
+def cbor_map(d):
+    out = cbor_head(5, len(d))
+    for k, v in d.items():
+        k = k.encode()
+        out += cbor_head(3, len(k)) + k
+        if isinstance(v, bool):
+            out += b"\xf5" if v else b"\xf4"
+        elif isinstance(v, int):
+            out += cbor_head(0, v)
+        else:
+            v = str(v).encode()
+            out += cbor_head(3, len(v)) + v
+    return out
+
+
+def reply(entry, cbor):
+    """The sink's time, for the node's post slots, and any pending delta."""
+    d = {"ts": int(time.time())}
+    if entry is not None:
+        d["mb"] = entry["seq"]
+        d.update(entry["set"])
+    if cbor:
+        return cbor_map(d)
+    return json.dumps(d, separators=(",", ":")).encode()
+
+
+# the mailbox file
+
+def load(path):
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except FileNotFoundError:
+        return {}
+
+
+def store(path, box):
+    tmp = path + ".tmp"
+    with open(tmp, "w") as f:
+        json.dump(box, f, indent=1, sort_keys=True)
+    os.replace(tmp, path)
+
+
+def eui_of(addr):
+    """EUI-64 from the interface id of an autoconfigured address."""
+    iid = bytearray(socket.inet_pton(socket.AF_INET6, addr.split("%")[0])[8:])
+    iid[0] ^= 0x02
+    return iid.hex()
+
+
+def value_of(s):
+    return int(s) if s.isdigit() else s
+
+
+# commands
+
+def cmd_set(args):
+    box = load(args.mailbox)
+    eui = args.eui.lower().replace(":", "").replace("-", "")
+    entry = box.get(eui, {"seq": 0, "set": {}})
+    for kv in args.pairs:
+        if "=" not in kv:
+            sys.exit("expected key=value: %s" % kv)
+        k, v = kv.split("=", 1)
+        entry["set"][k] = value_of(v)
+    entry["seq"] = (entry["seq"] % 65535) + 1
+    box[eui] = entry
+    store(args.mailbox, box)
+    print("%s seq %d %s" % (eui, entry["seq"], json.dumps(entry["set"])))
+
+
+def cmd_list(args):
+    for eui, entry in sorted(load(args.mailbox).items()):
+        print("%s seq %d %s" % (eui, entry["seq"], json.dumps(entry["set"])))
+
+
+def handle(box, msg, addr):
+    """The response to one post, and whether the mailbox changed."""
+    eui = eui_of(addr)
+    changed = False
+    queries = [q.decode(errors="replace") for q in option(msg, OPT_URI_QUERY)]
+    for q in queries:
+        for part in q.split("&"):
+            k, _, v = part.partition("=")
+            if k in ("mb", "mbx") and v.isdigit() and eui in box \
+               and box[eui]["seq"] == int(v):
+                print("%s %s delta %s" % (eui, "applied" if k == "mb" else "REJECTED", v))
+                del box[eui]
+                changed = True
+
+    ct = option(msg, OPT_CONTENT_TYPE)
+    cbor = bool(ct) and int.from_bytes(ct[0], "big") == SENML_CBOR
+    print("%s %s %s" % (time.strftime("%H:%M:%S"), eui,
+                        msg["payload"].hex() if cbor else msg["payload"].decode(errors="replace")))
+
+    options = [(OPT_TOKEN, t) for t in option(msg, OPT_TOKEN)]
+    options.append((OPT_CONTENT_TYPE, uint_bytes(APPLICATION_CBOR if cbor else APPLICATION_JSON)))
+    payload = reply(box.get(eui), cbor)
+    if eui in box:
+        print("%s sending delta %d" % (eui, box[eui]["seq"]))
+    # er-coap-07 matches the response to its request by message id, for NON too
+    type_ = ACK if msg["type"] == CON else NON
+    return build(type_, CHANGED, msg["mid"], options, payload), changed
+
+
+def cmd_serve(args):
+    sock = socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+    sock.bind(("::", args.port))
+    print("listening on port %d, mailbox %s" % (args.port, args.mailbox))
+    while True:
+        data, src = sock.recvfrom(1500)
+        try:
+            msg = parse(data)
+        except (ValueError, IndexError) as e:
+            print("%s: bad message: %s" % (src[0], e))
+            continue
+        if msg["code"] != POST or msg["type"] not in (CON, NON):
+            continue
+        # reread so set can be used while this runs
+        box = load(args.mailbox)
+        response, changed = handle(box, msg, src[0])
+        if changed:
+            store(args.mailbox, box)
+        sock.sendto(response, src)
+
+
+def main():
+    p = argparse.ArgumentParser(description="TH12 sink with a config mailbox")
+    sub = p.add_subparsers(dest="cmd", required=True)
+
+    s = sub.add_parser("serve", help="answer posts and deliver pending changes")
+    s.add_argument("mailbox")
+    s.add_argument("--port", type=int, default=COAP_PORT)
+    s.set_defaults(func=cmd_serve)
+
+    s = sub.add_parser("set", help="queue config changes for a node")
+    s.add_argument("mailbox")
+    s.add_argument("eui", help="EUI-64 in hex")
+    s.add_argument("pairs", nargs="+", metavar="key=value")
+    s.set_defaults(func=cmd_set)
+
+    s = sub.add_parser("list", help="show pending changes")
+    s.add_argument("mailbox")
+    s.set_defaults(func=cmd_list)
+
+    args = p.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,123 @@
+/* host benchmark for the payload serializer */
+
+/* builds the sensor JSON the old way (sprintf) and with msgbuf, checks */
+/* that the output is identical and times both. */
+
+/*   make                 time both builders on the host */
+/*   make size            link each builder on its own and compare code size */
+/*   make CROSS=arm-none-eabi- LDFLAGS=--specs=nosys.specs size */
+/*                        same, against newlib for the mc1322x */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "msgbuf.h"
+
+#define BUF_SIZE 256
+
+/* the payload builder as it was before msgbuf */
+uint16_t build_sprintf(char *buf, int16_t t, uint16_t rh, uint16_t vbatt)
+{
+	uint8_t n = 0;
+	uint16_t frac_t, int_t;
+	char neg = ' ';
+
+	if(t < 0) {
+		neg = '-';
+		int_t = (-1 * t)/10;
+		frac_t = (-1 * t) % 10;
+	} else {
+		neg = ' ';
+		int_t = t/10;
+		frac_t = t % 10;
+	}
+
+	n += sprintf(&(buf[n]),"{\"t\":\"%c%d.%dC\",\"h\":\"%d.%d%%\"",
+		     neg, int_t, frac_t, rh / 10, rh % 10);
+	n += sprintf(&buf[n], ",\"vb\":\"%dmV\"}", vbatt);
+	buf[n] = 0;
+	return n;
+}
+
+/* the same message with msgbuf, as in create_dht_msg() */
+uint16_t build_msgbuf(char *buf, int16_t t, uint16_t rh, uint16_t vbatt)
+{
+	struct msgbuf m;
+
+	msgbuf_init(&m, buf, BUF_SIZE);
+	msgbuf_puts(&m, "{\"t\":\"");
+	if (t >= 0) {
+		msgbuf_putc(&m, ' ');
+	}
+	msgbuf_put_fixed(&m, t, 1);
+	msgbuf_puts(&m, "C\",\"h\":\"");
+	msgbuf_put_fixed(&m, rh, 1);
+	msgbuf_puts(&m, "%\",\"vb\":\"");
+	msgbuf_put_uint(&m, vbatt);
+	msgbuf_puts(&m, "mV\"}");
+	return msgbuf_finish(&m);
+}
+
+#if defined(SIZE_SPRINTF) || defined(SIZE_MSGBUF)
+
+/* just enough of a program to keep one builder linked in */
+int main(int argc, char **argv)
+{
+	char buf[BUF_SIZE];
+#ifdef SIZE_SPRINTF
+	return build_sprintf(buf, argc, argc, argc);
+#else
+	return build_msgbuf(buf, argc, argc, argc);
+#endif
+}
+
+#else
+
+#define ITERATIONS 1000000
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+	char a[BUF_SIZE], b[BUF_SIZE];
+	int16_t t;
+	uint32_t i;
+	volatile uint16_t sink = 0;
+	double start, t_sprintf, t_msgbuf;
+
+	/* every temperature the dht22 can report, and then some */
+	for (t = -500; t <= 1500; t++) {
+		build_sprintf(a, t, (uint16_t)(t + 500) % 1001, 2000 + t);
+		build_msgbuf(b, t, (uint16_t)(t + 500) % 1001, 2000 + t);
+		if (strcmp(a, b) != 0) {
+			printf("mismatch at t=%d:\n  sprintf: %s\n  msgbuf:  %s\n", t, a, b);
+			return 1;
+		}
+	}
+	printf("outputs match, e.g. %s\n", b);
+
+	start = now();
+	for (i = 0; i < ITERATIONS; i++) {
+		sink += build_sprintf(a, (int16_t)(i % 1200) - 400, i % 1000, 2678);
+	}
+	t_sprintf = now() - start;
+
+	start = now();
+	for (i = 0; i < ITERATIONS; i++) {
+		sink += build_msgbuf(b, (int16_t)(i % 1200) - 400, i % 1000, 2678);
+	}
+	t_msgbuf = now() - start;
+
+	printf("sprintf: %6.1f ns/msg\n", t_sprintf * 1e9 / ITERATIONS);
+	printf("msgbuf:  %6.1f ns/msg\n", t_msgbuf * 1e9 / ITERATIONS);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Per-phase wake cycle latencies from a TH12's /profile ring.
+
+/profile holds the last cycles as binary (see prof.h): for each cycle
+the ms from its start to each point on the hot path. This prints, per
+point, percentiles of the time since the cycle started and of the phase
+leading up to it (since the previous point the cycle reached).
+
+    profile.py --node fd00::250:c2a8:c000:1             fetch and report
+    profile.py --node fd00::250:c2a8:c000:1 --save p1.bin
+    profile.py p1.bin p2.bin                              several dumps, merged
+
+Cycles that appear in more than one dump are counted once.
+"""
+
+import argparse
+import struct
+import sys
+
+import coap07
+
+POINTS = ("wake", "dht_init", "edge", "decoded", "adc", "dag",
+          "resolved", "post", "response", "sleep")
+NONE = 0xffff
+MAX = 0xfffe
+
+
+def decode(data):
+    """{cycle number: [ms or None per point]}"""
+    if len(data) < 3:
+        raise ValueError("short profile")
+    version, npoints, count = data[0], data[1], data[2]
+    if version != 1:
+        raise ValueError("profile version %d" % version)
+    size = 2 + 2 * npoints
+    if len(data) < 3 + count * size:
+        raise ValueError("truncated profile")
+    cycles = {}
+    for i in range(count):
+        rec = data[3 + i * size:3 + (i + 1) * size]
+        n = struct.unpack(">H", rec[:2])[0]
+        at = struct.unpack(">%dH" % npoints, rec[2:])
+        cycles[n] = [None if v == NONE else v for v in at]
+    return cycles
+
+
+def percentile(values, p):
+    values = sorted(values)
+    k = (len(values) - 1) * p / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(values) - 1)
+    return values[lo] + (values[hi] - values[lo]) * (k - lo)
+
+
+def fmt(ms):
+    return ">%.1fs" % (MAX / 1000.0) if ms >= MAX else "%d" % round(ms)
+
+
+def report(cycles):
+    if not cycles:
+        print("no cycles")
+        return
+    npoints = max(len(at) for at in cycles.values())
+    names = list(POINTS) + ["p%d" % i for i in range(len(POINTS), npoints)]
+    since_wake = [[] for _ in range(npoints)]
+    phase = [[] for _ in range(npoints)]
+    for at in cycles.values():
+        prev = None
+        # points in the order they were reached
+        for p in sorted((p for p in range(len(at)) if at[p] is not None), key=lambda p: at[p]):
+            since_wake[p].append(at[p])
+            if prev is not None:
+                phase[p].append(at[p] - at[prev])
+            prev = p
+
+    print("%d cycles, ms" % len(cycles))
+    print("%-9s %5s | %7s %7s %7s %7s | %7s %7s %7s %7s" % (
+        "point", "n", "p50", "p90", "p99", "max", "phase50", "p90", "p99", "max"))
+    for p in range(npoints):
+        if not since_wake[p]:
+            continue
+        row = "%-9s %5d |" % (names[p], len(since_wake[p]))
+        for q in (50, 90, 99):
+            row += " %7s" % fmt(percentile(since_wake[p], q))
+        row += " %7s |" % fmt(max(since_wake[p]))
+        if phase[p]:
+            for q in (50, 90, 99):
+                row += " %7s" % fmt(percentile(phase[p], q))
+            row += " %7s" % fmt(max(phase[p]))
+        print(row)
+
+
+def main():
+    p = argparse.ArgumentParser(description="wake cycle latency percentiles from /profile")
+    p.add_argument("dumps", nargs="*", help="saved /profile responses")
+    p.add_argument("--node", help="fetch /profile from this node")
+    p.add_argument("--port", type=int, default=coap07.COAP_PORT)
+    p.add_argument("--save", help="with --node, also write the raw response here")
+    args = p.parse_args()
+
+    blobs = []
+    if args.node:
+        response = coap07.request(args.node, "profile", port=args.port)
+        if response["code"] != coap07.CONTENT:
+            sys.exit("%s: /profile answered %d.%02d" % (args.node, response["code"] >> 5, response["code"] & 31))
+        blobs.append(response["payload"])
+        if args.save:
+            with open(args.save, "wb") as f:
+                f.write(response["payload"])
+    for name in args.dumps:
+        with open(name, "rb") as f:
+            blobs.append(f.read())
+    if not blobs:
+        p.error("give dumps or --node")
+
+    cycles = {}
+    for b in blobs:
+        cycles.update(decode(b))
+    report(cycles)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,8 @@
+#ifndef __CONTIKI_H__
+#define __CONTIKI_H__
+
+/* recstore.c needs nothing from contiki.h on the host */
+
+#include <stdint.h>
+
+#endif /* __CONTIKI_H__ */
@@ -0,0 +1,277 @@
+/* host test for the record store: power cuts during writes */
+
+/* runs recstore.c against a flash in RAM that can lose power part way */
+/* through any program or erase. A fixed sequence of writes is replayed */
+/* and every write is cut at each of its flash operations in turn, page */
+/* switches included. A cut write keeps its first byte, or a quarter, */
+/* half or three quarters of them, and a cut erase half the page. After */
+/* each cut the store is booted again and must read back the last value */
+/* of every key, with the key being written at either its old or its new */
+/* value. It must then carry on through the page switches that follow. */
+/* Those are cut a second time at each flash operation in turn, from the */
+/* boot, which finishes an interrupted page switch, to the next switch */
+/* and past it. */
+
+/*   make                 build and run */
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "contiki.h"
+#include "mc1322x.h"
+#include "config.h"
+
+#include "recstore.h"
+#include "energy.h"
+
+#define SECTOR_SIZE 0x1000
+#define FLASH_SIZE (RECSTORE_PAGES * SECTOR_SIZE)
+
+#define WRITES 160           /* writes in the sequence, a few page switches' worth */
+#define FOLLOW 60            /* writes run after each cut, past the next switch */
+
+mc1322x_config_t mc1322x_config;
+
+static uint8_t flash[FLASH_SIZE];
+static int budget = -1;      /* flash operations before the power goes, -1 for never */
+static int tear;             /* how much of a cut write gets done */
+static jmp_buf cut;
+
+struct value {
+	int len;                     /* -1 if the key has never been written */
+	uint8_t data[RECSTORE_MAX];
+};
+
+struct write {
+	uint8_t key;
+	struct value v;
+};
+
+static struct write writes[WRITES];
+/* what the store should hold after the writes since the first cut */
+/* and the write going on, they're read back after a longjmp */
+static struct value saved[RECSTORE_KEYS];
+static volatile int cur;
+static int failed, cuts, boot_cuts;
+
+void energy_on(uint8_t meter) { (void)meter; }
+void energy_off(uint8_t meter) { (void)meter; }
+
+static int range_ok(uint32_t address, uint32_t n)
+{
+	return address >= RECSTORE_PAGE && n <= FLASH_SIZE &&
+	       address - RECSTORE_PAGE <= FLASH_SIZE - n;
+}
+
+/* the power goes at the budget'th operation, after doing part of it */
+static int power_cut(void)
+{
+	if (budget < 0) {
+		return 0;
+	}
+	return budget-- == 0;
+}
+
+nvmErr_t nvm_read(nvmInterface_t nvmInterface, nvmType_t nvmType,
+		  void *pDest, uint32_t address, uint32_t numBytes)
+{
+	(void)nvmInterface;
+	(void)nvmType;
+	if (!range_ok(address, numBytes)) {
+		printf("read of %u bytes at 0x%x is outside the store\n", numBytes, address);
+		failed++;
+		return gNvmErrAddressSpaceOverflow_c;
+	}
+	memcpy(pDest, flash + address - RECSTORE_PAGE, numBytes);
+	return gNvmErrNoError_c;
+}
+
+nvmErr_t nvm_write(nvmInterface_t nvmInterface, nvmType_t nvmType,
+		   void *pSrc, uint32_t address, uint32_t numBytes)
+{
+	const uint8_t *src = pSrc;
+	uint8_t *dst = flash + address - RECSTORE_PAGE;
+	uint32_t i, n = numBytes;
+	int torn;
+
+	(void)nvmInterface;
+	(void)nvmType;
+	if (!range_ok(address, numBytes)) {
+		printf("write of %u bytes at 0x%x is outside the store\n", numBytes, address);
+		failed++;
+		return gNvmErrAddressSpaceOverflow_c;
+	}
+	torn = power_cut();
+	if (torn) {
+		/* the first byte alone leaves a record header torn */
+		n = (tear % 4 == 0) ? 1 : numBytes * (tear % 4) / 4;
+		tear++;
+	}
+	/* like the flash, a write can only clear bits */
+	for (i = 0; i < n; i++) {
+		dst[i] &= src[i];
+	}
+	if (torn) {
+		longjmp(cut, 1);
+	}
+	return gNvmErrNoError_c;
+}
+
+nvmErr_t nvm_erase(nvmInterface_t nvmInterface, nvmType_t nvmType,
+		   uint32_t sectorBitfield)
+{
+	uint32_t s, n = SECTOR_SIZE;
+	int torn;
+
+	(void)nvmInterface;
+	(void)nvmType;
+	torn = power_cut();
+	if (torn) {
+		n = SECTOR_SIZE / 2;
+	}
+	for (s = RECSTORE_PAGE / SECTOR_SIZE; s < RECSTORE_PAGE / SECTOR_SIZE + RECSTORE_PAGES; s++) {
+		if (sectorBitfield & (1UL << s)) {
+			memset(flash + s * SECTOR_SIZE - RECSTORE_PAGE, 0xff, n);
+		}
+	}
+	if (torn) {
+		longjmp(cut, 1);
+	}
+	return gNvmErrNoError_c;
+}
+
+static uint32_t rnd(void)
+{
+	static uint32_t s = 0x2545f491;
+
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	return s;
+}
+
+static int same(const struct value *a, const struct value *b)
+{
+	return a->len == b->len && (a->len < 0 || memcmp(a->data, b->data, a->len) == 0);
+}
+
+/* every key reads back as in model, except that key may also read as alt */
+static void check(const struct value *model, int key, const struct value *alt, const char *when, int i)
+{
+	struct value v;
+	int k;
+
+	for (k = 0; k < RECSTORE_KEYS; k++) {
+		v.len = recstore_read(k, v.data, sizeof(v.data));
+		if (same(&v, &model[k]) || (k == key && same(&v, alt))) {
+			continue;
+		}
+		printf("write %d, %s: key %d reads %d bytes, expected %d\n",
+		       i, when, k, v.len, model[k].len);
+		failed++;
+	}
+}
+
+static void write_ok(int i)
+{
+	if (recstore_write(writes[i].key, writes[i].v.data, writes[i].v.len) != 0) {
+		printf("write %d failed\n", i);
+		failed++;
+	}
+}
+
+/* boot after a cut during write alt and check that saved reads back */
+static void boot(int alt)
+{
+	int key = writes[alt].key;
+
+	recstore_init();
+	check(saved, key, &writes[alt].v, "after the cut", alt);
+	saved[key].len = recstore_read(key, saved[key].data, sizeof(saved[key].data));
+}
+
+/* the writes from from on, up to FOLLOW after write i, then a reboot */
+static void follow(int from, int i)
+{
+	for (cur = from; cur < WRITES && cur <= i + FOLLOW; cur++) {
+		write_ok(cur);
+		saved[writes[cur].key] = writes[cur].v;
+		check(saved, -1, NULL, "after the cut and more writes", cur);
+	}
+	cur--;
+	recstore_init();
+	check(saved, -1, NULL, "after the cut, more writes and a reboot", cur);
+}
+
+int main(void)
+{
+	static uint8_t before[FLASH_SIZE], after[FLASH_SIZE];
+	struct value model[RECSTORE_KEYS];
+	volatile int c, d;
+	int i, j, k;
+
+	for (i = 0; i < WRITES; i++) {
+		/* like config next to state, the last key is rarely written, so a */
+		/* switch cut short usually leaves its newest record in the older page */
+		writes[i].key = (rnd() % 32 == 0) ? RECSTORE_KEYS - 1 : rnd() % (RECSTORE_KEYS - 1);
+		writes[i].v.len = rnd() % (RECSTORE_MAX + 1);
+		for (j = 0; j < writes[i].v.len; j++) {
+			writes[i].v.data[j] = rnd();
+		}
+	}
+	for (k = 0; k < RECSTORE_KEYS; k++) {
+		model[k].len = -1;
+	}
+
+	mc1322x_config.flags.nvmtype = gNvmType_SST_c;
+	memset(flash, 0xff, sizeof(flash));
+
+	for (i = 0; i < WRITES; i++) {
+		memcpy(before, flash, sizeof(flash));
+
+		/* cut the write at its first operation, then its second, and so */
+		/* on until it gets through */
+		for (c = 0; ; c++) {
+			memcpy(flash, before, sizeof(flash));
+			recstore_init();
+			budget = c;
+			if (setjmp(cut) == 0) {
+				write_ok(i);
+				budget = -1;
+				break;
+			}
+			budget = -1;
+			cuts++;
+			memcpy(after, flash, sizeof(flash));
+
+			/* then cut what follows the same way: the boot, then the */
+			/* writes after it, until they all get through */
+			for (d = 0; ; d++) {
+				memcpy(flash, after, sizeof(flash));
+				memcpy(saved, model, sizeof(saved));
+				budget = d;
+				cur = i;
+				if (setjmp(cut) == 0) {
+					boot(i);
+					follow(i + 1, i);
+					budget = -1;
+					break;
+				}
+				budget = -1;
+				boot_cuts++;
+				boot(cur);
+				follow(cur + 1, i);
+			}
+		}
+
+		model[writes[i].key] = writes[i].v;
+		check(model, -1, NULL, "without a cut", i);
+	}
+
+	printf("%d writes, %d power cuts, %d more after them, %d failed\n",
+	       WRITES, cuts, boot_cuts, failed);
+	return failed != 0;
+}
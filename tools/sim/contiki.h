@@ -0,0 +1,15 @@
+#ifndef __CONTIKI_H__
+#define __CONTIKI_H__
+
+/* just enough of contiki.h to build rtt.c and post-cycle.c on the host for fleetsim */
+/* clock_time() is the local clock of the node the simulator is running */
+
+#include <stdint.h>
+
+#define CLOCK_SECOND 100
+
+typedef uint32_t clock_time_t;
+
+clock_time_t clock_time(void);
+
+#endif /* __CONTIKI_H__ */
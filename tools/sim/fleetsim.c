@@ -0,0 +1,1613 @@
+/* fleet simulator: TH12s posting to the sink through one border router */
+
+/* runs the post cycle of coap-post-sleep.c for every node on one */
+/* virtual clock: slots, sensor warm-up, batching and the deadband, NON */
+/* posts that sleep on the link-layer ACK, CON sink checks timed by */
+/* rtt.c, the sink address cache, store and forward, and the reboot */
+/* after a failed check. The decisions are the firmware's own: */
+/* post-cycle.c picks the checks, what gets posted and what follows a */
+/* post, slot.c the slots and rtt.c the timeouts, with the constants */
+/* from th12-post.h. What drives them, the th_12 and do_post processes, */
+/* resolv and the sleep, is modelled here and kept in step by hand */
+
+/* all frames share the border router's channel: unslotted CSMA-CA, */
+/* hardware ACKs and retries, and no capture, so any overlap at a */
+/* receiver loses the frame. Nodes all hear the parent but only -a of */
+/* each other, the rest are hidden terminals. -l loses frames at random */
+/* on top of that. The sink is -R ms away, answers every post and */
+/* sends its time. RPL and neighbor discovery traffic isn't simulated */
+
+/* a run depends only on its options, so the output of make bench can */
+/* be diffed across changes to post-cycle.c, slot.c, rtt.c and */
+/* th12-post.h. Other changes to coap-post-sleep.c aren't seen */
+
+/*   make                       200 nodes, 300s interval, 24 hours */
+/*   make bench                 the benchmark scenarios */
+/*   ./fleetsim -n 500 -b 4     more nodes, posting every 4th reading */
+/*   ./fleetsim -a 0.2 -l 0.05  more hidden terminals, a noisy channel */
+/*   ./fleetsim -v              with a line per node */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "contiki.h"
+#include "post-cycle.h"
+#include "readlog.h"
+#include "rtt.h"
+#include "senml.h"
+#include "slot.h"
+#include "th12-post.h"
+
+typedef int64_t usec_t;
+#define MS 1000LL
+#define SEC 1000000LL
+#define TICK (SEC / CLOCK_SECOND)
+
+/* frames are sized by the firmware's frame budget, which leaves room */
+/* for a mailbox ack on every post */
+/* 6lowpan fragments carry multiples of 8 bytes */
+#define FRAG_HEADER 5
+#define FRAG_DATA ((FRAME_MAX - FRAME_MAC_OVERHEAD - FRAG_HEADER) & ~7)
+
+/* payloads: {"t":" 21.5C","h":"45.0%","vb":"3000mV"} and ,[-300,215,450] */
+#define DHT_MSG_JSON 40
+#define BATCH_SAMPLE_JSON 15
+#define LOG_JSON 8
+#define LOG_CBOR 2
+
+/* answers: {"ts":1760000000}, a DNS query for the sink and its AAAA */
+#define RESPONSE_LEN (FRAME_MAC_OVERHEAD + FRAME_IPHC_OVERHEAD + 4 + 17)
+#define DNS_QUERY_LEN (FRAME_MAC_OVERHEAD + FRAME_IPHC_OVERHEAD + 12 + 19 + 4)
+#define DNS_REPLY_LEN (DNS_QUERY_LEN + 28)
+#define DNS_TRIES 8
+
+/* the flash log, as many records as fit in its pages */
+#define READLOG_CAP READLOG_SLOTS
+
+/* 802.15.4 at 2.4GHz */
+#define BYTE_US 32
+#define PHY_HEADER 6
+#define ACK_LEN 5
+#define TURNAROUND 192
+#define ACK_WAIT 864
+#define BACKOFF_PERIOD 320
+#define MIN_BE 3
+#define MAX_BE 5
+#define MAX_CSMA_BACKOFFS 4
+#define MAC_QUEUE 32
+
+#define DHT_READ (5 * MS)
+#define SINK_TS_BASE 1760000000UL
+
+/* frame kinds */
+enum { F_ACK, F_NON, F_CON, F_LOG, F_DNS, F_RESPONSE, F_DNS_REPLY };
+
+/* what do_post is doing */
+enum { P_IDLE, P_RESOLV, P_NON, P_CON, P_DRAIN };
+
+enum {
+	/* node timers, at most one of each pending */
+	EV_WAKE,                 /* et_do_dht */
+	EV_WARM,                 /* et_warmup, the sensor can be read */
+	EV_CON,                  /* et_con */
+	EV_RESOLV,               /* DNS retry */
+	EV_SLEEP_OK,             /* ct_powerwake */
+	EV_RTC,                  /* the end of rtimer_arch_sleep() */
+	TIMERS,
+	/* per station */
+	EV_CCA = TIMERS,
+	EV_TX,
+	EV_TX_END,
+	EV_ACK_TX,
+	EV_ACK_WAIT,
+	/* beyond the parent */
+	EV_SINK,                 /* a post reaches the sink */
+	EV_REPLY,                /* an answer reaches the parent */
+};
+
+/* a post as the node sent it */
+struct msg {
+	uint8_t kind;
+	uint8_t nread;
+	uint16_t mid;
+	uint16_t len;            /* ip packet, compressed */
+	uint32_t serial;         /* per transmission, for reassembly */
+	uint32_t read[LOG_DRAIN_MAX];
+};
+
+struct frame {
+	int16_t src, dst;
+	uint8_t kind, frag, nfrag, seq;
+	uint8_t bad;
+	uint16_t mid;
+	uint16_t len;
+	uint32_t serial;
+	usec_t start;
+};
+
+struct event {
+	usec_t t;
+	uint32_t seq;
+	uint8_t type;
+	int32_t who;
+	uint32_t tag;
+	union {
+		struct msg m;
+		struct frame f;
+	} u;
+};
+
+enum { S_IDLE, S_BACKOFF, S_TX, S_ACK_WAIT };
+
+struct station {
+	struct frame q[MAC_QUEUE];
+	uint8_t head, len;
+	uint8_t state, nb, be, retries, acked, seq;
+	uint32_t tag;
+	struct frame air;
+	uint8_t on_air;
+	unsigned long frames, failed, cca_failed, dropped;
+};
+
+struct node {
+	uint8_t eui[8];
+	usec_t boot;             /* true time the local clock counts from */
+	double rate;             /* local time per true time */
+	uint64_t rng;
+
+	/* th_12 and do_post, names as in coap-post-sleep.c */
+	uint32_t slot_id;
+	int32_t slot_epoch;
+	uint8_t sleep_ok, asleep, radio, retry;
+	uint8_t con_pending, doing_con, con_done, con_ok, con_tries, con_exit;
+	int8_t resolv_ok;
+	uint8_t dns_tries, dns_background;
+	uint16_t dns_id;
+	uint8_t sink_ok;
+	uint8_t sensor_tries, tx_failed;
+	uint8_t drained;
+	uint8_t post;
+	uint16_t rto;
+	clock_time_t con_sent, next_post;
+	usec_t wake_at, dht_power;
+	struct rtt rtt;
+	uint16_t mid;
+	struct msg msg;
+	struct post_cycle cycle;
+
+	uint32_t batch[BATCH_MAX];
+	uint8_t batch_head, batch_count;
+	uint32_t inflight[BATCH_MAX];
+	uint8_t inflight_count;
+
+	/* kept in flash over reboots */
+	uint32_t *log;
+	uint16_t log_head, log_count;
+	uint8_t has_parent, cache_valid, cache_fresh;
+	clock_time_t cache_ok;
+
+	/* the sensor: a daily swing around t0 and rh0 */
+	int16_t t0;
+	uint16_t rh0;
+	double phase;
+
+	uint8_t rx_seq, rx_seq_valid;
+
+	/* readings by number, and whether the sink has each */
+	uint8_t *delivered;
+	uint32_t readings, cap, counted, n_delivered;
+
+	usec_t on_since, radio_us, tx_us;
+	unsigned long wakes, posts, noack, reboots, logged;
+
+	uint32_t tag[TIMERS];
+};
+
+/* the parent's reassembly and duplicate filter, per node */
+struct rx {
+	uint32_t serial, mask;
+	uint8_t done, seq, seq_valid;
+};
+
+static int n_nodes = 200;
+static unsigned interval = DEFAULT_POST_INTERVAL;
+static unsigned hours = 24;
+static struct post_cycle_cfg cycle_cfg = {
+	.posts_per_check = DEFAULT_POSTS_PER_CHECK,
+	.max_post_fails = DEFAULT_MAX_POST_FAILS,
+	.batch_size = DEFAULT_BATCH_SIZE,
+	.deadband_t = DEFAULT_DEADBAND_T,
+	.deadband_rh = DEFAULT_DEADBAND_RH,
+	.heartbeat = DEFAULT_HEARTBEAT,
+};
+static uint8_t payload_format = DEFAULT_PAYLOAD_FORMAT;
+static uint8_t sink_by_ip = 0;
+static double audible = 0.5;
+static double loss = 0;
+static double sink_rtt = 100;     /* ms, border router to sink and back */
+static int mac_retries = 3;
+static int cca = 1;
+static double drift = 40;         /* ppm */
+static double warmup = 700;       /* ms, the measured warm-up plus the margin */
+static double sensor_fail = 0;
+static unsigned boot_spread = 0;  /* s */
+static uint32_t seed = 1;
+static int verbose = 0;
+
+static struct node *nodes;
+static struct station *stations;
+static struct rx *prx;
+static int parent;
+
+static struct event *heap;
+static size_t heap_len, heap_cap;
+static uint32_t event_seq;
+
+static usec_t now, end;
+static struct node *cur;
+static uint32_t msg_serial;
+static uint64_t chan_rng;
+
+/* channel and sink counters */
+static int *active;
+static int n_active;
+static usec_t busy_since, busy_us;
+static unsigned long collided, noise_lost, unanswered, parent_queue_peak;
+static unsigned long sink_msgs, sink_dups, dns_queries;
+static unsigned *per_second;
+
+static uint64_t splitmix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static uint32_t rnd(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s >> 32;
+}
+
+static double rnd_unit(uint64_t *s)
+{
+	return rnd(s) / 4294967296.0;
+}
+
+/* the node's clock_time() at true time t */
+static clock_time_t ticks(struct node *n, usec_t t)
+{
+	return (clock_time_t)((t - n->boot) * n->rate / TICK);
+}
+
+clock_time_t clock_time(void)
+{
+	return ticks(cur, now);
+}
+
+static unsigned long clock_seconds(void)
+{
+	return clock_time() / CLOCK_SECOND;
+}
+
+/* true time of a local delay from now */
+static usec_t after(struct node *n, clock_time_t delay)
+{
+	return now + (usec_t)ceil(delay * TICK / n->rate);
+}
+
+/* events */
+
+static int earlier(const struct event *a, const struct event *b)
+{
+	return a->t < b->t || (a->t == b->t && a->seq < b->seq);
+}
+
+static struct event *push(usec_t t, uint8_t type, int32_t who, uint32_t tag)
+{
+	size_t i;
+
+	if (heap_len == heap_cap) {
+		heap_cap = heap_cap ? 2 * heap_cap : 1024;
+		heap = realloc(heap, heap_cap * sizeof(*heap));
+	}
+	i = heap_len++;
+	while (i > 0 && t < heap[(i - 1) / 2].t) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i].t = t;
+	heap[i].seq = event_seq++;
+	heap[i].type = type;
+	heap[i].who = who;
+	heap[i].tag = tag;
+	return &heap[i];
+}
+
+static void pop(struct event *e)
+{
+	struct event last;
+	size_t i = 0, c;
+
+	*e = heap[0];
+	last = heap[--heap_len];
+	while ((c = 2 * i + 1) < heap_len) {
+		if (c + 1 < heap_len && earlier(&heap[c + 1], &heap[c])) {
+			c++;
+		}
+		if (!earlier(&heap[c], &last)) {
+			break;
+		}
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = last;
+}
+
+static void timer_set(struct node *n, uint8_t type, clock_time_t delay)
+{
+	push(after(n, delay), type, n - nodes, ++n->tag[type]);
+}
+
+static void timer_stop(struct node *n, uint8_t type)
+{
+	n->tag[type]++;
+}
+
+/* the channel */
+
+/* node a hears node b, or the parent */
+static int hears(int a, int b)
+{
+	uint64_t lo = a < b ? a : b, hi = a < b ? b : a;
+
+	if (a == parent || b == parent) {
+		return 1;
+	}
+	return (splitmix((uint64_t)seed << 40 ^ lo << 20 ^ hi) >> 11) * (1.0 / 9007199254740992.0) < audible;
+}
+
+static int listening(int i, usec_t since)
+{
+	return i == parent || (nodes[i].radio && !nodes[i].asleep && nodes[i].on_since <= since);
+}
+
+static int channel_busy(int s)
+{
+	int i;
+
+	for (i = 0; i < n_active; i++) {
+		if (active[i] != s && hears(s, active[i])) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static usec_t airtime(uint16_t len)
+{
+	return (PHY_HEADER + len) * BYTE_US;
+}
+
+static void tx_begin(int s, struct frame *f)
+{
+	struct station *st = &stations[s];
+	int i;
+
+	f->start = now;
+	f->bad = 0;
+	for (i = 0; i < n_active; i++) {
+		struct frame *o = &stations[active[i]].air;
+		if (o->dst == f->src || hears(o->dst, f->src)) {
+			o->bad = 1;
+		}
+		if (f->dst == o->src || hears(f->dst, o->src)) {
+			f->bad = 1;
+		}
+	}
+	if (n_active == 0) {
+		busy_since = now;
+	}
+	active[n_active++] = s;
+	st->air = *f;
+	st->on_air = 1;
+	if (s != parent) {
+		nodes[s].tx_us += airtime(f->len);
+	}
+	push(now + airtime(f->len), EV_TX_END, s, 0);
+}
+
+/* the MAC, one per station */
+
+static void node_tx_done(struct node *n, struct frame *f, int ok);
+static void parent_tx_done(int ok);
+
+static void backoff(int s)
+{
+	struct station *st = &stations[s];
+	uint64_t *r = s == parent ? &chan_rng : &nodes[s].rng;
+
+	st->state = S_BACKOFF;
+	push(now + (rnd(r) % (1 << st->be)) * BACKOFF_PERIOD, EV_CCA, s, st->tag);
+}
+
+static void mac_next(int s)
+{
+	struct station *st = &stations[s];
+
+	if (st->len == 0) {
+		st->state = S_IDLE;
+		return;
+	}
+	st->nb = 0;
+	st->be = MIN_BE;
+	st->retries = 0;
+	backoff(s);
+}
+
+static void mac_send(int s, struct frame *f)
+{
+	struct station *st = &stations[s];
+
+	if (st->len == MAC_QUEUE) {
+		st->dropped++;
+		return;
+	}
+	f->seq = ++st->seq;
+	st->q[(st->head + st->len++) % MAC_QUEUE] = *f;
+	if (s == parent && st->len > parent_queue_peak) {
+		parent_queue_peak = st->len;
+	}
+	if (st->state == S_IDLE) {
+		mac_next(s);
+	}
+}
+
+static void mac_done(int s, int ok)
+{
+	struct station *st = &stations[s];
+	struct frame f = st->q[st->head];
+
+	st->head = (st->head + 1) % MAC_QUEUE;
+	st->len--;
+	st->state = S_IDLE;
+	st->frames++;
+	if (!ok) {
+		st->failed++;
+	}
+	if (s == parent) {
+		parent_tx_done(ok);
+	} else {
+		cur = &nodes[s];
+		node_tx_done(&nodes[s], &f, ok);
+	}
+	if (st->state == S_IDLE) {
+		mac_next(s);
+	}
+}
+
+/* a sleeping radio drops what it hasn't sent */
+static void mac_flush(int s)
+{
+	struct station *st = &stations[s];
+
+	st->tag++;
+	st->len = 0;
+	st->state = S_IDLE;
+}
+
+static void cca_done(int s)
+{
+	struct station *st = &stations[s];
+
+	if (cca && channel_busy(s)) {
+		st->nb++;
+		if (st->be < MAX_BE) {
+			st->be++;
+		}
+		if (st->nb > MAX_CSMA_BACKOFFS) {
+			st->cca_failed++;
+			mac_done(s, 0);
+		} else {
+			backoff(s);
+		}
+		return;
+	}
+	push(now + TURNAROUND, EV_TX, s, st->tag);
+}
+
+static void tx_start(int s)
+{
+	struct station *st = &stations[s];
+
+	/* still sending an ACK */
+	if (st->on_air) {
+		backoff(s);
+		return;
+	}
+	st->state = S_TX;
+	tx_begin(s, &st->q[st->head]);
+}
+
+static void receive(struct frame *f);
+
+static void tx_end(int s)
+{
+	struct station *st = &stations[s];
+	struct frame f = st->air;
+	struct event *e;
+	int i, ok;
+
+	st->on_air = 0;
+	for (i = 0; i < n_active; i++) {
+		if (active[i] == s) {
+			active[i] = active[--n_active];
+			break;
+		}
+	}
+	if (n_active == 0) {
+		busy_us += now - busy_since;
+	}
+
+	ok = !f.bad && listening(f.dst, f.start);
+	if (f.bad) {
+		collided++;
+	} else if (ok && loss > 0 && rnd_unit(&chan_rng) < loss) {
+		noise_lost++;
+		ok = 0;
+	}
+
+	if (f.kind == F_ACK) {
+		struct station *to = &stations[f.dst];
+		if (ok && to->state == S_ACK_WAIT && to->q[to->head].seq == f.seq) {
+			to->acked = 1;
+		}
+		return;
+	}
+
+	if (ok) {
+		e = push(now + TURNAROUND, EV_ACK_TX, f.dst, 0);
+		e->u.f.src = f.dst;
+		e->u.f.dst = f.src;
+		e->u.f.kind = F_ACK;
+		e->u.f.seq = f.seq;
+		e->u.f.len = ACK_LEN;
+		receive(&f);
+	}
+	/* flushed while it was on the air */
+	if (st->state == S_TX) {
+		st->state = S_ACK_WAIT;
+		st->acked = 0;
+		push(now + ACK_WAIT, EV_ACK_WAIT, s, st->tag);
+	}
+}
+
+static void ack_wait(int s)
+{
+	struct station *st = &stations[s];
+
+	if (st->acked) {
+		mac_done(s, 1);
+	} else if (st->retries < mac_retries) {
+		st->retries++;
+		st->nb = 0;
+		st->be = MIN_BE;
+		backoff(s);
+	} else {
+		mac_done(s, 0);
+	}
+}
+
+/* the node's side of coap-post-sleep.c */
+
+static void go_to_sleep(struct node *n);
+static void do_post(struct node *n, int resend);
+static void do_post_send(struct node *n);
+static void after_con(struct node *n);
+
+static void radio_on(struct node *n)
+{
+	if (!n->radio) {
+		n->radio = 1;
+		n->on_since = now;
+	}
+}
+
+static void radio_off(struct node *n)
+{
+	if (n->radio) {
+		n->radio = 0;
+		n->radio_us += now - n->on_since;
+	}
+}
+
+static void send_msg(struct node *n)
+{
+	uint16_t left = n->msg.len;
+	struct frame f;
+	uint8_t i;
+
+	radio_on(n);
+	n->msg.serial = ++msg_serial;
+	memset(&f, 0, sizeof(f));
+	f.src = n - nodes;
+	f.dst = parent;
+	f.kind = n->msg.kind;
+	f.mid = n->msg.mid;
+	f.serial = n->msg.serial;
+	f.nfrag = 1;
+	if (FRAME_MAC_OVERHEAD + left > FRAME_MAX) {
+		f.nfrag = (left + FRAG_DATA - 1) / FRAG_DATA;
+	}
+	for (i = 0; i < f.nfrag; i++) {
+		f.frag = i;
+		if (f.nfrag == 1) {
+			f.len = FRAME_MAC_OVERHEAD + left;
+		} else {
+			f.len = FRAME_MAC_OVERHEAD + FRAG_HEADER + (left < FRAG_DATA ? left : FRAG_DATA);
+			left -= left < FRAG_DATA ? left : FRAG_DATA;
+		}
+		mac_send(f.src, &f);
+	}
+}
+
+/* compressed ip packet for a payload */
+static uint16_t packet_len(uint16_t payload)
+{
+	return FRAME_IPHC_OVERHEAD + FRAME_COAP_OVERHEAD + payload;
+}
+
+static uint8_t sink_cache_current(struct node *n)
+{
+	return n->cache_valid && n->cache_fresh &&
+		clock_seconds() - n->cache_ok / CLOCK_SECOND < DEFAULT_SINK_TTL;
+}
+
+static void sink_cache_update(struct node *n)
+{
+	n->cache_ok = clock_time();
+	n->cache_fresh = 1;
+	n->cache_valid = 1;
+}
+
+static void dns_query(struct node *n)
+{
+	struct frame f;
+
+	/* retries after go_to_sleep() go to the maca while it is off */
+	if (n->radio) {
+		memset(&f, 0, sizeof(f));
+		f.src = n - nodes;
+		f.dst = parent;
+		f.kind = F_DNS;
+		f.mid = n->dns_id;
+		f.nfrag = 1;
+		f.len = DNS_QUERY_LEN;
+		f.serial = ++msg_serial;
+		mac_send(f.src, &f);
+		dns_queries++;
+	}
+	n->dns_tries++;
+	/* resolv.c waits retries * retries * 3 quarter seconds */
+	timer_set(n, EV_RESOLV, n->dns_tries * n->dns_tries * 3 * CLOCK_SECOND / 4);
+}
+
+static void resolv_start(struct node *n, uint8_t background)
+{
+	n->dns_background = background;
+	n->dns_tries = 0;
+	n->dns_id++;
+	dns_query(n);
+}
+
+static void resolv_done(struct node *n, int8_t ok)
+{
+	timer_stop(n, EV_RESOLV);
+	n->dns_id++;
+	if (ok) {
+		sink_cache_update(n);
+	}
+	if (n->dns_background) {
+		return;
+	}
+	n->resolv_ok = ok;
+	if (n->post == P_RESOLV) {
+		do_post_send(n);
+	}
+}
+
+static void sink_check_start(struct node *n)
+{
+	n->con_pending = 1;
+	n->sink_ok = 0;
+	timer_stop(n, EV_RESOLV);
+	n->dns_id++;
+	if (sink_by_ip) {
+		n->resolv_ok = 1;
+	} else if (n->cache_valid) {
+		n->resolv_ok = 1;
+		if (!sink_cache_current(n)) {
+			resolv_start(n, 1);
+		}
+	} else {
+		n->resolv_ok = -1;
+		resolv_start(n, 0);
+	}
+}
+
+static void slot_schedule(struct node *n)
+{
+	clock_time_t wait;
+
+	wait = slot_wait(clock_seconds() + n->slot_epoch, clock_time() % CLOCK_SECOND,
+			 n->slot_id, interval, CLOCK_SECOND);
+	n->next_post = clock_time() + wait;
+	timer_set(n, EV_WAKE, wait);
+}
+
+static void slot_shift(struct node *n, clock_time_t delay)
+{
+	n->slot_id = n->slot_id % ((uint32_t)interval * CLOCK_SECOND) + delay;
+}
+
+static clock_time_t slot_boot_delay(struct node *n)
+{
+	uint32_t spread = SLOT_BOOT_SPREAD;
+
+	if (spread > interval) {
+		spread = interval;
+	}
+	return n->slot_id % (spread * CLOCK_SECOND);
+}
+
+/* readings */
+
+static uint32_t reading_new(struct node *n)
+{
+	if (n->readings == n->cap) {
+		n->cap = n->cap ? 2 * n->cap : 256;
+		n->delivered = realloc(n->delivered, n->cap);
+	}
+	n->delivered[n->readings] = 0;
+	return n->readings++;
+}
+
+static void batch_add(struct node *n, uint32_t r)
+{
+	if (n->batch_count == BATCH_MAX) {
+		n->batch_head = (n->batch_head + 1) % BATCH_MAX;
+		n->batch_count--;
+	}
+	n->batch[(n->batch_head + n->batch_count) % BATCH_MAX] = r;
+	n->batch_count++;
+}
+
+static void log_put(struct node *n, uint32_t r)
+{
+	if (n->log_count == READLOG_CAP) {
+		n->log_head = (n->log_head + 1) % READLOG_CAP;
+		n->log_count--;
+	}
+	n->log[(n->log_head + n->log_count) % READLOG_CAP] = r;
+	n->log_count++;
+	n->logged++;
+}
+
+static void log_inflight(struct node *n)
+{
+	uint8_t i;
+
+	for (i = 0; i < n->inflight_count; i++) {
+		log_put(n, n->inflight[i]);
+	}
+	n->inflight_count = 0;
+}
+
+static void create_dht_msg(struct node *n)
+{
+	uint8_t i, older = n->batch_count - 1;
+	uint16_t len;
+
+	if (payload_format == FORMAT_SENML_CBOR) {
+		len = DHT_MSG_CBOR_MAX + older * BATCH_SAMPLE_CBOR_MAX;
+	} else {
+		len = DHT_MSG_JSON + (older ? 7 + older * BATCH_SAMPLE_JSON : 0);
+	}
+	n->msg.len = packet_len(len);
+	n->msg.nread = n->batch_count;
+	for (i = 0; i < n->batch_count; i++) {
+		n->msg.read[i] = n->inflight[i] = n->batch[(n->batch_head + i) % BATCH_MAX];
+	}
+	n->inflight_count = n->batch_count;
+	n->batch_head = n->batch_count = 0;
+}
+
+static void create_log_msg(struct node *n)
+{
+	uint8_t i;
+
+	n->drained = n->log_count < LOG_DRAIN_MAX ? n->log_count : LOG_DRAIN_MAX;
+	for (i = 0; i < n->drained; i++) {
+		n->msg.read[i] = n->log[(n->log_head + i) % READLOG_CAP];
+	}
+	n->msg.nread = n->drained;
+	if (payload_format == FORMAT_SENML_CBOR) {
+		n->msg.len = packet_len(LOG_CBOR + n->drained * BATCH_SAMPLE_CBOR_MAX);
+	} else {
+		n->msg.len = packet_len(LOG_JSON + n->drained * BATCH_SAMPLE_JSON);
+	}
+}
+
+static void log_consume(struct node *n, uint8_t k)
+{
+	n->log_head = (n->log_head + k) % READLOG_CAP;
+	n->log_count -= k;
+}
+
+/* the sensor */
+
+static void sensor_read(struct node *n, int16_t *t, uint16_t *rh)
+{
+	double day = sin(2 * M_PI * (now / (86400.0 * SEC) + n->phase));
+
+	*t = n->t0 + (int16_t)lround(30 * day) + (int16_t)(rnd(&n->rng) % 5) - 2;
+	*rh = n->rh0 - (int16_t)lround(60 * day) + (int16_t)(rnd(&n->rng) % 11) - 5;
+}
+
+/* con exchanges */
+
+static void con_start(struct node *n, uint8_t kind)
+{
+	n->post = kind == F_LOG ? P_DRAIN : P_CON;
+	n->msg.kind = kind;
+	n->msg.mid = ++n->mid;
+	n->con_done = 0;
+	n->con_tries = 0;
+	n->con_sent = clock_time();
+	send_msg(n);
+	n->rto = rtt_rto(&n->rtt);
+	timer_set(n, EV_CON, n->rto + rnd(&n->rng) % (n->rto / 2 + 1));
+}
+
+static void con_timeout(struct node *n)
+{
+	if (n->con_tries == CON_MAX_RETRANSMIT) {
+		after_con(n);
+		return;
+	}
+	n->con_tries++;
+	n->rto = rtt_backoff(n->rto);
+	send_msg(n);
+	timer_set(n, EV_CON, n->rto + rnd(&n->rng) % (n->rto / 2 + 1));
+}
+
+static void post_complete(struct node *n)
+{
+	n->post = P_IDLE;
+	slot_schedule(n);
+	n->retry = 0;
+	go_to_sleep(n);
+}
+
+/* do_post after con_exchange */
+static void after_con(struct node *n)
+{
+	timer_stop(n, EV_CON);
+	if (n->post == P_CON) {
+		post_cycle_check_result(&n->cycle, n->con_ok);
+		if (n->con_ok && n->con_tries > 0) {
+			slot_shift(n, clock_time() - n->con_sent);
+		}
+		if (!n->con_ok) {
+			post_cycle_failed(&n->cycle);
+			n->cache_valid = n->cache_fresh = 0;
+			log_inflight(n);
+		} else {
+			n->inflight_count = 0;
+			if (!sink_by_ip) {
+				sink_cache_update(n);
+			}
+			n->has_parent = 1;
+		}
+	} else if (n->post == P_DRAIN && n->con_ok) {
+		log_consume(n, n->drained);
+	}
+
+	if (n->con_ok && post_cycle_drain(&n->cycle, n->log_count)) {
+		create_log_msg(n);
+		n->con_ok = 0;
+		con_start(n, F_LOG);
+		return;
+	}
+	post_complete(n);
+}
+
+/* the sink answered a NON or a CON */
+static void sink_answered(struct node *n)
+{
+	int32_t epoch;
+
+	post_cycle_answered(&n->cycle, 1);
+	n->sink_ok = 1;
+	n->con_ok = 1;
+	epoch = SINK_TS_BASE + now / SEC - clock_seconds();
+	if (n->slot_epoch == 0 || epoch > n->slot_epoch + 1 || epoch < n->slot_epoch - 1) {
+		n->slot_epoch = epoch;
+	}
+}
+
+static void client_chunk_handler(struct node *n)
+{
+	sink_answered(n);
+	go_to_sleep(n);
+}
+
+static void con_response(struct node *n)
+{
+	n->con_done = 1;
+	timer_stop(n, EV_CON);
+	rtt_sample(&n->rtt, clock_time() - n->con_sent, n->con_tries);
+	sink_answered(n);
+	if (n->post == P_CON || n->post == P_DRAIN) {
+		after_con(n);
+	}
+}
+
+/* post_tx_check(), after the last fragment of a NON */
+static void post_tx_check(struct node *n)
+{
+	uint8_t resent = n->cycle.tx_tries > 0;
+
+	if (n->tx_failed) {
+		n->noack++;
+	}
+	/* no mailbox here, so never a reason to listen for the answer */
+	switch (post_cycle_tx(&n->cycle, !n->tx_failed, 0)) {
+	case POST_CYCLE_SLEEP:
+		if (resent) {
+			slot_shift(n, clock_time() - n->cycle.last_post);
+		}
+		go_to_sleep(n);
+		break;
+	case POST_CYCLE_RESEND:
+		n->post = P_IDLE;
+		do_post(n, 1);
+		break;
+	case POST_CYCLE_GIVE_UP:
+		log_inflight(n);
+		go_to_sleep(n);
+		break;
+	}
+}
+
+static void node_tx_done(struct node *n, struct frame *f, int ok)
+{
+	if (f->kind != F_NON || n->post != P_NON || f->serial != n->msg.serial) {
+		return;
+	}
+	if (!ok) {
+		n->tx_failed = 1;
+	}
+	if (f->frag == f->nfrag - 1) {
+		post_tx_check(n);
+	}
+}
+
+/* a frame from the parent */
+static void node_receive(struct node *n, struct frame *f)
+{
+	if (f->kind == F_DNS_REPLY) {
+		if (n->resolv_ok == -1 || n->dns_background) {
+			if (f->mid == n->dns_id && n->dns_tries > 0) {
+				resolv_done(n, 1);
+			}
+		}
+		return;
+	}
+	if ((n->post == P_CON || n->post == P_DRAIN) && !n->con_done && f->mid == n->msg.mid) {
+		con_response(n);
+	} else if (n->post == P_NON && f->mid == n->msg.mid) {
+		client_chunk_handler(n);
+	}
+}
+
+static void do_post_send(struct node *n)
+{
+	if (n->resolv_ok == 0) {
+		post_cycle_failed(&n->cycle);
+		if (n->doing_con) {
+			post_cycle_check_result(&n->cycle, 0);
+		}
+		log_inflight(n);
+		post_complete(n);
+		return;
+	}
+	if (n->doing_con) {
+		con_start(n, F_CON);
+	} else {
+		n->post = P_NON;
+		n->tx_failed = 0;
+		n->msg.kind = F_NON;
+		n->msg.mid = ++n->mid;
+		send_msg(n);
+	}
+}
+
+static void do_post(struct node *n, int resend)
+{
+	radio_on(n);
+	if (!resend) {
+		n->posts++;
+	}
+
+	if (!n->con_pending && post_cycle_check_due(&n->cycle, n->resolv_ok)) {
+		sink_check_start(n);
+	}
+	n->doing_con = n->con_pending;
+	n->con_pending = 0;
+	post_cycle_send(&n->cycle, n->doing_con, resend);
+
+	if (n->doing_con) {
+		n->con_ok = 0;
+		/* ev_post_con_started */
+		timer_stop(n, EV_WAKE);
+	}
+
+	if (n->resolv_ok == -1) {
+		n->post = P_RESOLV;
+		return;
+	}
+	do_post_send(n);
+}
+
+static void go_to_sleep(struct node *n)
+{
+	if (n->sleep_ok) {
+		radio_off(n);
+		mac_flush(n - nodes);
+		if (n->next_post > clock_time() + 5) {
+			n->asleep = 1;
+			n->wake_at = after(n, n->next_post - clock_time() - 5);
+			timer_set(n, EV_RTC, n->next_post - clock_time() - 5);
+		}
+	}
+
+	/* process_exit(&do_post): an answered CON runs the rest of do_post */
+	if ((n->post == P_CON || n->post == P_DRAIN) && n->con_done) {
+		n->con_exit = 1;
+	} else if (n->post != P_IDLE) {
+		timer_stop(n, EV_CON);
+		n->post = P_IDLE;
+	}
+	if (!n->asleep && n->con_exit) {
+		n->con_exit = 0;
+		after_con(n);
+	}
+}
+
+static void rtc_wake(struct node *n)
+{
+	n->asleep = 0;
+	n->dht_power = now;
+	if (n->con_exit) {
+		n->con_exit = 0;
+		after_con(n);
+	}
+}
+
+static void do_result(struct node *n)
+{
+	int16_t t;
+	uint16_t rh;
+	uint32_t r;
+	uint8_t next;
+
+	n->sensor_tries++;
+	if (sensor_fail > 0 && rnd_unit(&n->rng) < sensor_fail) {
+		if (n->sensor_tries < SENSOR_RETRIES) {
+			n->retry = 1;
+			n->next_post = clock_time() + RETRY_INTERVAL;
+			timer_set(n, EV_WAKE, RETRY_INTERVAL);
+		} else {
+			/* "sensor failed" */
+			n->retry = 0;
+			n->inflight_count = 0;
+			n->msg.len = packet_len(DHT_MSG_JSON);
+			n->msg.nread = 0;
+			do_post(n, 0);
+		}
+		return;
+	}
+
+	sensor_read(n, &t, &rh);
+	next = post_cycle_reading(&n->cycle, t, rh, n->batch_count, n->con_pending);
+	if (next == POST_CYCLE_SUPPRESS) {
+		post_complete(n);
+		return;
+	}
+
+	r = reading_new(n);
+	if (now < end - (usec_t)(cycle_cfg.batch_size + 2) * interval * SEC) {
+		n->counted = n->readings;
+	}
+	batch_add(n, r);
+	if (next == POST_CYCLE_BATCH) {
+		post_complete(n);
+		return;
+	}
+	create_dht_msg(n);
+	n->post = P_IDLE;
+	do_post(n, 0);
+}
+
+static void node_boot(struct node *n);
+
+/* et_do_dht */
+static void th12_wake(struct node *n)
+{
+	usec_t warm;
+
+	slot_schedule(n);
+	if (post_cycle_reboot_due(&n->cycle)) {
+		n->reboots++;
+		node_boot(n);
+		return;
+	}
+	if (!n->retry) {
+		n->wakes++;
+		post_cycle_wake(&n->cycle);
+		n->sensor_tries = 0;
+	}
+	if (post_cycle_likely(&n->cycle, n->resolv_ok, n->batch_count)) {
+		radio_on(n);
+	}
+	if (!n->retry && post_cycle_check_due(&n->cycle, n->resolv_ok)) {
+		sink_check_start(n);
+	}
+	warm = (usec_t)(warmup * MS) - (now - n->dht_power);
+	if (warm < 0) {
+		warm = 0;
+	}
+	push(now + warm + DHT_READ, EV_WARM, n - nodes, ++n->tag[EV_WARM]);
+}
+
+static void set_sleep_ok(struct node *n)
+{
+	n->sleep_ok = 1;
+	if (n->post != P_IDLE) {
+		return;
+	}
+	go_to_sleep(n);
+}
+
+/* power up, or the reboot after a failed sink check: RAM is lost, */
+/* the flash log, saved parent and sink cache are kept */
+static void node_boot(struct node *n)
+{
+	struct post_cycle was = n->cycle;
+	int i;
+
+	for (i = 0; i < TIMERS; i++) {
+		n->tag[i]++;
+	}
+	mac_flush(n - nodes);
+	radio_off(n);
+
+	n->boot = now;
+	n->slot_id = slot_hash(n->eui, sizeof(n->eui));
+	n->slot_epoch = 0;
+	n->sleep_ok = n->asleep = n->retry = 0;
+	n->con_pending = n->doing_con = n->con_done = n->con_ok = n->con_exit = 0;
+	n->resolv_ok = 0;
+	n->sink_ok = 0;
+	n->cycle.cfg = cycle_cfg;
+	post_cycle_init(&n->cycle);
+	/* the report counts over the whole run, not since the last reboot */
+	n->cycle.suppressed = was.suppressed;
+	n->cycle.cons_sent = was.cons_sent;
+	n->cycle.cons_failed = was.cons_failed;
+	n->cycle.con_probes = was.con_probes;
+	n->post = P_IDLE;
+	n->next_post = 0;
+	n->batch_head = n->batch_count = 0;
+	n->inflight_count = 0;
+	n->cache_fresh = 0;
+	n->dht_power = now;
+	rtt_init(&n->rtt);
+
+	/* the radio and sensor are on from power up, sleep waits for the wake time */
+	radio_on(n);
+	timer_set(n, EV_SLEEP_OK, DEFAULT_WAKE_TIME * CLOCK_SECOND);
+	timer_set(n, EV_WAKE, (n->has_parent ? REJOIN_FIRST_POST : FIRST_POST) + slot_boot_delay(n));
+}
+
+/* the parent, sink and DNS server */
+
+static void parent_tx_done(int ok)
+{
+	if (!ok) {
+		unanswered++;
+	}
+}
+
+static void parent_receive(struct frame *f)
+{
+	struct rx *rx = &prx[f->src];
+	struct node *n = &nodes[f->src];
+	struct event *e;
+
+	if (rx->seq_valid && rx->seq == f->seq) {
+		return;
+	}
+	rx->seq = f->seq;
+	rx->seq_valid = 1;
+	if (rx->serial != f->serial) {
+		rx->serial = f->serial;
+		rx->mask = 0;
+		rx->done = 0;
+	}
+	rx->mask |= 1UL << f->frag;
+	if (rx->done || rx->mask != (1UL << f->nfrag) - 1) {
+		return;
+	}
+	rx->done = 1;
+
+	if (f->kind == F_DNS) {
+		e = push(now + (usec_t)(sink_rtt * MS), EV_REPLY, f->src, 0);
+		e->u.f.kind = F_DNS_REPLY;
+		e->u.f.mid = f->mid;
+		e->u.f.len = DNS_REPLY_LEN;
+		return;
+	}
+	/* the node doesn't change its message while the MAC is sending it */
+	e = push(now + (usec_t)(sink_rtt * MS / 2), EV_SINK, f->src, 0);
+	e->u.m = n->msg;
+}
+
+static void receive(struct frame *f)
+{
+	struct node *n;
+
+	if (f->dst == parent) {
+		parent_receive(f);
+		return;
+	}
+	n = &nodes[f->dst];
+	if (n->rx_seq_valid && n->rx_seq == f->seq) {
+		return;
+	}
+	n->rx_seq = f->seq;
+	n->rx_seq_valid = 1;
+	cur = n;
+	node_receive(n, f);
+}
+
+/* the sink counts every post, keeps each reading once and answers */
+static void sink_receive(int i, struct msg *m)
+{
+	struct node *n = &nodes[i];
+	struct event *e;
+	uint8_t k;
+
+	sink_msgs++;
+	per_second[now / SEC]++;
+	for (k = 0; k < m->nread; k++) {
+		if (n->delivered[m->read[k]]) {
+			sink_dups++;
+		} else {
+			n->delivered[m->read[k]] = 1;
+			n->n_delivered++;
+		}
+	}
+	e = push(now + (usec_t)(sink_rtt * MS / 2), EV_REPLY, i, 0);
+	e->u.f.kind = F_RESPONSE;
+	e->u.f.mid = m->mid;
+	e->u.f.len = RESPONSE_LEN;
+}
+
+static void parent_reply(int i, struct frame *r)
+{
+	struct frame f;
+
+	memset(&f, 0, sizeof(f));
+	f.src = parent;
+	f.dst = i;
+	f.kind = r->kind;
+	f.mid = r->mid;
+	f.len = r->len;
+	f.nfrag = 1;
+	f.serial = ++msg_serial;
+	mac_send(parent, &f);
+}
+
+/* running it */
+
+static void node_timer(struct node *n, struct event *e)
+{
+	/* nothing runs in rtimer_arch_sleep(), timers that expire go off at the wake */
+	if (n->asleep && e->type != EV_RTC) {
+		push(n->wake_at, e->type, e->who, e->tag);
+		return;
+	}
+	switch (e->type) {
+	case EV_WAKE:
+		th12_wake(n);
+		break;
+	case EV_WARM:
+		do_result(n);
+		break;
+	case EV_CON:
+		if (n->post == P_CON || n->post == P_DRAIN) {
+			con_timeout(n);
+		}
+		break;
+	case EV_RESOLV:
+		if (n->dns_tries == DNS_TRIES) {
+			resolv_done(n, 0);
+		} else {
+			dns_query(n);
+		}
+		break;
+	case EV_SLEEP_OK:
+		set_sleep_ok(n);
+		break;
+	case EV_RTC:
+		rtc_wake(n);
+		break;
+	}
+}
+
+static void run(void)
+{
+	struct event e;
+	int i;
+
+	while (heap_len > 0 && heap[0].t < end) {
+		pop(&e);
+		now = e.t;
+		if (e.type < TIMERS) {
+			struct node *n = &nodes[e.who];
+			if (e.tag != n->tag[e.type]) {
+				continue;
+			}
+			cur = n;
+			node_timer(n, &e);
+			continue;
+		}
+		switch (e.type) {
+		case EV_CCA:
+			if (e.tag == stations[e.who].tag && stations[e.who].state == S_BACKOFF) {
+				cca_done(e.who);
+			}
+			break;
+		case EV_TX:
+			if (e.tag == stations[e.who].tag && stations[e.who].state == S_BACKOFF) {
+				tx_start(e.who);
+			}
+			break;
+		case EV_TX_END:
+			tx_end(e.who);
+			break;
+		case EV_ACK_TX:
+			if (!stations[e.who].on_air) {
+				tx_begin(e.who, &e.u.f);
+			}
+			break;
+		case EV_ACK_WAIT:
+			if (e.tag == stations[e.who].tag && stations[e.who].state == S_ACK_WAIT) {
+				ack_wait(e.who);
+			}
+			break;
+		case EV_SINK:
+			sink_receive(e.who, &e.u.m);
+			break;
+		case EV_REPLY:
+			parent_reply(e.who, &e.u.f);
+			break;
+		}
+	}
+	now = end;
+	if (n_active > 0) {
+		busy_us += now - busy_since;
+	}
+	for (i = 0; i < n_nodes; i++) {
+		radio_off(&nodes[i]);
+	}
+}
+
+static void setup(void)
+{
+	uint64_t r = splitmix(seed);
+	int i;
+
+	nodes = calloc(n_nodes, sizeof(*nodes));
+	stations = calloc(n_nodes + 1, sizeof(*stations));
+	prx = calloc(n_nodes, sizeof(*prx));
+	active = calloc(n_nodes + 1, sizeof(*active));
+	per_second = calloc(hours * 3600 + 1, sizeof(*per_second));
+	parent = n_nodes;
+	chan_rng = splitmix(r ^ 0xc4a17e1);
+	end = hours * 3600 * SEC;
+
+	for (i = 0; i < n_nodes; i++) {
+		struct node *n = &nodes[i];
+		uint32_t id;
+
+		n->rng = splitmix(r + i + 1) | 1;
+		id = rnd(&n->rng);
+		n->eui[0] = 0x00; n->eui[1] = 0x50; n->eui[2] = 0xc2;
+		n->eui[3] = 0xa8; n->eui[4] = 0xc0 | (id >> 24 & 0x0f);
+		n->eui[5] = id >> 16; n->eui[6] = id >> 8; n->eui[7] = id;
+		n->rate = 1 + (rnd_unit(&n->rng) * 2 - 1) * drift / 1e6;
+		n->t0 = 180 + rnd(&n->rng) % 80;
+		n->rh0 = 300 + rnd(&n->rng) % 300;
+		n->phase = rnd_unit(&n->rng) / 8;
+		n->log = calloc(READLOG_CAP, sizeof(*n->log));
+		/* the fleet powers up together, give or take a few hundred ms, or over -S */
+		now = (usec_t)(rnd_unit(&n->rng) * (boot_spread ? boot_spread * SEC : 200 * MS));
+		cur = n;
+		node_boot(n);
+	}
+	now = 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static int cmp_unsigned(const void *a, const void *b)
+{
+	unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+	return (x > y) - (x < y);
+}
+
+static void report(void)
+{
+	double *radio = calloc(n_nodes, sizeof(double)), *ratio = calloc(n_nodes, sizeof(double));
+	unsigned *ps = calloc(hours * 3600, sizeof(unsigned));
+	unsigned long counted = 0, delivered = 0, reboots = 0, cons = 0, cons_failed = 0;
+	unsigned long posts = 0, noack = 0, suppressed = 0, logged = 0, frames = 0;
+	unsigned long cca_failed = 0, dropped = 0;
+	double radio_sum = 0;
+	uint32_t k;
+	int i;
+
+	for (i = 0; i < n_nodes; i++) {
+		struct node *n = &nodes[i];
+		uint32_t got = 0;
+		for (k = 0; k < n->counted; k++) {
+			got += n->delivered[k];
+		}
+		counted += n->counted;
+		delivered += got;
+		ratio[i] = n->counted ? (double)got / n->counted : 1;
+		radio[i] = n->radio_us / 1000.0 / hours;
+		radio_sum += radio[i];
+		reboots += n->reboots;
+		cons += n->cycle.cons_sent;
+		cons_failed += n->cycle.cons_failed;
+		posts += n->posts;
+		noack += n->noack;
+		suppressed += n->cycle.suppressed;
+		logged += n->logged;
+	}
+	for (i = 0; i <= n_nodes; i++) {
+		frames += stations[i].frames;
+		cca_failed += stations[i].cca_failed;
+		dropped += stations[i].dropped;
+	}
+
+	printf("%d nodes, %us interval, batch %u, %uh, seed %u\n", n_nodes, interval, cycle_cfg.batch_size, hours, seed);
+	printf("%.0f%% hear each other, %.1f%% noise loss, %s, sink %.0fms away\n",
+	       100 * audible, 100 * loss, cca ? "csma" : "aloha", sink_rtt);
+	printf("channel  %.2f%% busy, %lu frames, %lu collided, %lu lost to noise, %lu cca failures\n",
+	       100.0 * busy_us / end, frames, collided, noise_lost, cca_failed);
+	printf("parent   %lu answers not ACKed, queue peak %lu, %lu dropped\n",
+	       unanswered, parent_queue_peak, dropped);
+
+	memcpy(ps, per_second, hours * 3600 * sizeof(unsigned));
+	qsort(ps, hours * 3600, sizeof(unsigned), cmp_unsigned);
+	printf("sink     %lu posts, %.3f/s, p99 %u/s, peak %u/s, %lu duplicate readings, %lu dns queries\n",
+	       sink_msgs, (double)sink_msgs / (hours * 3600), ps[(size_t)(0.99 * (hours * 3600 - 1))],
+	       ps[hours * 3600 - 1], sink_dups, dns_queries);
+
+	printf("nodes    %lu posts, %lu not ACKed, %lu suppressed, %lu logged, %lu checks %lu failed, %lu reboots\n",
+	       posts, noack, suppressed, logged, cons, cons_failed, reboots);
+	qsort(ratio, n_nodes, sizeof(double), cmp_double);
+	printf("delivery %.2f%%, worst node %.2f%%, p1 %.2f%%\n",
+	       counted ? 100.0 * delivered / counted : 100.0, 100 * ratio[0],
+	       100 * ratio[(size_t)(0.01 * (n_nodes - 1))]);
+	if (verbose) {
+		printf("\n%-18s %10s %8s %7s %6s %6s %6s %7s\n",
+		       "eui", "radio ms/h", "tx ms/h", "posts", "noack", "checks", "failed", "reboots");
+		for (i = 0; i < n_nodes; i++) {
+			struct node *n = &nodes[i];
+			printf("%02x%02x%02x%02x%02x%02x%02x%02x   %10.0f %8.1f %7lu %6lu %6lu %6lu %7lu\n",
+			       n->eui[0], n->eui[1], n->eui[2], n->eui[3], n->eui[4], n->eui[5], n->eui[6], n->eui[7],
+			       n->radio_us / 1000.0 / hours, n->tx_us / 1000.0 / hours, n->posts, n->noack,
+			       (unsigned long)n->cycle.cons_sent, (unsigned long)n->cycle.cons_failed, n->reboots);
+		}
+		printf("\n");
+	}
+	qsort(radio, n_nodes, sizeof(double), cmp_double);
+	printf("radio    mean %.0f ms/h, median %.0f, p99 %.0f, max %.0f\n",
+	       radio_sum / n_nodes, radio[n_nodes / 2], radio[(size_t)(0.99 * (n_nodes - 1))], radio[n_nodes - 1]);
+
+	free(radio);
+	free(ratio);
+	free(ps);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:i:H:b:k:D:E:B:cNa:l:R:m:Cd:w:e:S:s:v")) != -1) {
+		switch (c) {
+		case 'n': n_nodes = atoi(optarg); break;
+		case 'i': interval = atoi(optarg); break;
+		case 'H': hours = atoi(optarg); break;
+		case 'b': cycle_cfg.batch_size = atoi(optarg); break;
+		case 'k': cycle_cfg.posts_per_check = atoi(optarg); break;
+		case 'D': cycle_cfg.deadband_t = atoi(optarg); break;
+		case 'E': cycle_cfg.deadband_rh = atoi(optarg); break;
+		case 'B': cycle_cfg.heartbeat = atoi(optarg); break;
+		case 'c': payload_format = FORMAT_SENML_CBOR; break;
+		case 'N': sink_by_ip = 1; break;
+		case 'a': audible = atof(optarg); break;
+		case 'l': loss = atof(optarg); break;
+		case 'R': sink_rtt = atof(optarg); break;
+		case 'm': mac_retries = atoi(optarg); break;
+		case 'C': cca = 0; break;
+		case 'd': drift = atof(optarg); break;
+		case 'w': warmup = atof(optarg); break;
+		case 'e': sensor_fail = atof(optarg); break;
+		case 'S': boot_spread = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case 'v': verbose = 1; break;
+		default:
+			fprintf(stderr, "usage: %s [options]\n"
+				"  -n nodes     fleet size (200)\n"
+				"  -i s         post_interval (300)\n"
+				"  -H hours     simulated time (24)\n"
+				"  -b n         batch_size (1)\n"
+				"  -k n         posts_per_check (256)\n"
+				"  -D t -E rh   deadband in tenths of C and %% (off)\n"
+				"  -B s         heartbeat (3600)\n"
+				"  -c           SenML-CBOR payloads\n"
+				"  -N           sink by ip, no DNS\n"
+				"  -a p         chance two nodes hear each other (0.5)\n"
+				"  -l p         chance a frame is lost to noise (0)\n"
+				"  -R ms        round trip from the border router to the sink (100)\n"
+				"  -m n         MAC retries (3)\n"
+				"  -C           no CCA, pure ALOHA\n"
+				"  -d ppm       clock drift (40)\n"
+				"  -w ms        sensor warm-up (700)\n"
+				"  -e p         chance a sensor read fails (0)\n"
+				"  -S s         power up over s seconds instead of together\n"
+				"  -s seed      fleet and channel (1)\n"
+				"  -v           a line per node\n", argv[0]);
+			return 1;
+		}
+	}
+	if (n_nodes < 1 || interval < 1 || hours < 1 || cycle_cfg.batch_size < 1 ||
+	    cycle_cfg.batch_size > BATCH_MAX || cycle_cfg.posts_per_check < 1) {
+		fprintf(stderr, "nodes, interval, hours and posts per check must be positive, batch 1 to %d\n",
+			BATCH_MAX);
+		return 1;
+	}
+
+	setup();
+	run();
+	report();
+	return 0;
+}
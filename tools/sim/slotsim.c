@@ -0,0 +1,252 @@
+/* fleet post collision simulator for the EUI post slots in slot.c */
+
+/* powers up a fleet together, as after a building power outage, and */
+/* counts transmissions that overlap on the parent's channel for */
+/*   boot     the old schedule: interval after the last post, from boot */
+/*   slot     EUI slots, counted from boot */
+/*   slot+ts  the same but aligned to the time in the sink's responses */
+/* a collided post is retransmitted like a CON with a 2-3s timeout */
+/* doubling each time, up to 4 times. Clocks drift by up to -d ppm */
+/* the slot policies move a node's slot to where a retransmission got */
+/* through, like slot_shift() in the firmware */
+
+/*   make                     120 nodes, 300s interval, 24 hours */
+/*   ./slotsim -n 500 -i 60   more nodes, shorter interval */
+/*   ./slotsim -r             slots that never move */
+/*   ./slotsim -j 2000        a random extra delay of up to 2s on every */
+/*                            slotted post, an eighth of the interval at most */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "slot.h"
+
+#define MAX_RETRANSMIT 4
+#define FIRST_POST 5000          /* ms after boot, as in th_12 */
+#define BOOT_SPREAD 30           /* s, SLOT_BOOT_SPREAD */
+#define BOOT_SKEW 200            /* ms, nodes don't power up at exactly the same time */
+
+enum { BOOT, SLOT, SLOT_TS, POLICIES };
+static const char *policy_name[] = { "boot", "slot", "slot+ts" };
+
+enum { EV_NONE, EV_START, EV_END };
+
+struct node {
+	uint8_t eui[8];
+	uint32_t hash;
+	double boot;             /* true time of power up, ms */
+	double rate;             /* local ms per true ms */
+	int32_t epoch;           /* sink seconds - local seconds */
+	int synced;
+	double t;                /* true time of the next event */
+	int ev;
+	int tries;
+	double first;            /* true time of the first send of this post */
+	int on_air;
+	int collided;
+};
+
+struct stats {
+	unsigned long tx, collided, delivered, lost, peak;
+};
+
+static int n_nodes = 120;
+static unsigned interval = 300;
+static unsigned hours = 24;
+static double airtime = 20;      /* ms the parent is busy per exchange */
+static double drift = 40;        /* ppm */
+static uint32_t seed = 1;
+static uint32_t jitter_max = 0;
+static int shift = 1;
+
+static uint64_t rng;
+
+static uint32_t rnd(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return rng >> 32;
+}
+
+static double rnd_unit(void)
+{
+	return rnd() / 4294967296.0;
+}
+
+static double local(struct node *n, double t)
+{
+	return (t - n->boot) * n->rate;
+}
+
+static double true_time(struct node *n, double l)
+{
+	return n->boot + l / n->rate;
+}
+
+/* when the node posts next, as true time, after finishing at true time t */
+static double next_post(struct node *n, int policy, double t)
+{
+	double l = local(n, t);
+	uint32_t now, wait, jitter;
+
+	if (policy == BOOT) {
+		return true_time(n, l + interval * 1000.0);
+	}
+	now = (uint32_t)(l / 1000);
+	if (policy == SLOT_TS && n->synced) {
+		now += n->epoch;
+	}
+	wait = slot_wait(now, (uint16_t)fmod(l, 1000), n->hash, interval, 1000);
+	jitter = interval * 1000 / 8;
+	if (jitter > jitter_max) {
+		jitter = jitter_max;
+	}
+	if (jitter > 0) {
+		wait += rnd() % jitter;
+	}
+	return true_time(n, l + wait);
+}
+
+static void run(int policy, struct stats *st)
+{
+	struct node *nodes = calloc(n_nodes, sizeof(*nodes));
+	double end = hours * 3600000.0;
+	unsigned *per_second = calloc(hours * 3600 + 1, sizeof(unsigned));
+	int i, j, on_air = 0;
+	unsigned spread;
+
+	/* the same fleet for every policy */
+	rng = 0x9e3779b97f4a7c15ULL * (seed + 1);
+	memset(st, 0, sizeof(*st));
+	for (i = 0; i < n_nodes; i++) {
+		struct node *n = &nodes[i];
+		uint32_t r = rnd();
+		n->eui[0] = 0x00; n->eui[1] = 0x50; n->eui[2] = 0xc2;
+		n->eui[3] = 0xff; n->eui[4] = 0xfe;
+		n->eui[5] = r >> 16; n->eui[6] = r >> 8; n->eui[7] = r;
+		n->hash = slot_hash(n->eui, 8);
+		n->boot = rnd_unit() * BOOT_SKEW;
+		n->rate = 1 + (rnd_unit() * 2 - 1) * drift / 1e6;
+		spread = BOOT_SPREAD < interval ? BOOT_SPREAD : interval;
+		n->t = true_time(n, FIRST_POST + (policy == BOOT ? 0 : n->hash % (spread * 1000)));
+		n->ev = EV_START;
+	}
+	/* the retransmission timeouts differ per policy, but not the fleet */
+	rng ^= policy + 1;
+
+	while (1) {
+		struct node *n = NULL;
+		for (i = 0; i < n_nodes; i++) {
+			if (nodes[i].ev != EV_NONE && (n == NULL || nodes[i].t < n->t)) {
+				n = &nodes[i];
+			}
+		}
+		if (n == NULL || n->t >= end) {
+			break;
+		}
+
+		if (n->ev == EV_START) {
+			st->tx++;
+			if (n->tries == 0) {
+				n->first = n->t;
+			}
+			per_second[(unsigned)(n->t / 1000)]++;
+			n->collided = 0;
+			if (on_air > 0) {
+				n->collided = 1;
+				for (j = 0; j < n_nodes; j++) {
+					if (nodes[j].on_air) {
+						nodes[j].collided = 1;
+					}
+				}
+			}
+			n->on_air = 1;
+			on_air++;
+			n->ev = EV_END;
+			n->t += airtime;
+			continue;
+		}
+
+		/* EV_END */
+		n->on_air = 0;
+		on_air--;
+		if (n->collided) {
+			st->collided++;
+			if (n->tries < MAX_RETRANSMIT) {
+				n->ev = EV_START;
+				n->t += 2000.0 * (1 + rnd_unit() / 2) * (1 << n->tries);
+				n->tries++;
+				continue;
+			}
+			st->lost++;
+		} else {
+			st->delivered++;
+			if (shift && n->tries > 0) {
+				/* a retransmission got through here, move the slot here as slot_shift() does */
+				n->hash = n->hash % (interval * 1000) +
+					(uint32_t)((n->t - n->first) * n->rate);
+			}
+			/* the sink's time in the response, in whole seconds */
+			int32_t epoch = (int32_t)(n->t / 1000) - (int32_t)(local(n, n->t) / 1000);
+			if (!n->synced || epoch - n->epoch > 1 || n->epoch - epoch > 1) {
+				n->epoch = epoch;
+				n->synced = 1;
+			}
+		}
+		n->tries = 0;
+		n->ev = EV_START;
+		n->t = next_post(n, policy, n->t);
+	}
+
+	for (i = 0; i < (int)(hours * 3600); i++) {
+		if (per_second[i] > st->peak) {
+			st->peak = per_second[i];
+		}
+	}
+	free(per_second);
+	free(nodes);
+}
+
+int main(int argc, char **argv)
+{
+	struct stats st;
+	int c, p;
+
+	while ((c = getopt(argc, argv, "n:i:H:a:d:s:j:r")) != -1) {
+		switch (c) {
+		case 'n': n_nodes = atoi(optarg); break;
+		case 'i': interval = atoi(optarg); break;
+		case 'H': hours = atoi(optarg); break;
+		case 'a': airtime = atof(optarg); break;
+		case 'd': drift = atof(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case 'j': jitter_max = atoi(optarg); break;
+		case 'r': shift = 0; break;
+		default:
+			fprintf(stderr, "usage: %s [-n nodes] [-i interval s] [-H hours] "
+				"[-a airtime ms] [-d drift ppm] [-s seed] [-j jitter ms] [-r]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (n_nodes < 1 || interval < 1 || hours < 1) {
+		fprintf(stderr, "nodes, interval and hours must be positive\n");
+		return 1;
+	}
+
+	printf("%d nodes, %us interval, %uh, %.0fms airtime, %.0fppm drift\n\n",
+	       n_nodes, interval, hours, airtime, drift);
+	printf("%-8s %10s %10s %8s %10s %8s %6s\n",
+	       "policy", "tx", "collided", "%", "delivered", "lost", "peak/s");
+	for (p = 0; p < POLICIES; p++) {
+		run(p, &st);
+		printf("%-8s %10lu %10lu %7.2f%% %10lu %8lu %6lu\n", policy_name[p],
+		       st.tx, st.collided, st.tx ? 100.0 * st.collided / st.tx : 0.0,
+		       st.delivered, st.lost, st.peak);
+	}
+	return 0;
+}
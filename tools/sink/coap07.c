@@ -0,0 +1,154 @@
+/* minimal CoAP draft-07 framing, see coap07.h */
+
+#include <string.h>
+
+#include "coap07.h"
+
+int coap_parse(struct coap_msg *m, const uint8_t *buf, uint16_t len)
+{
+	uint16_t i, number, length, path_len;
+	uint8_t count, seen;
+	uint32_t v;
+
+	if (len < 4 || buf[0] >> 6 != 1) {
+		return -1;
+	}
+	m->type = (buf[0] >> 4) & 3;
+	m->code = buf[1];
+	m->mid = buf[2] << 8 | buf[3];
+	m->content_type = -1;
+	m->token_len = 0;
+	m->path[0] = 0;
+	path_len = 0;
+
+	/* a count of 15 means options up to an end marker */
+	count = buf[0] & 0x0f;
+	i = 4;
+	number = 0;
+	for (seen = 0; count == 15 || seen < count; seen++) {
+		if (i >= len) {
+			if (count == 15) {
+				break;
+			}
+			return -1;
+		}
+		if (count == 15 && buf[i] == 0xf0) {
+			i++;
+			break;
+		}
+		number += buf[i] >> 4;
+		length = buf[i] & 0x0f;
+		i++;
+		if (length == 15) {
+			if (i >= len) {
+				return -1;
+			}
+			length += buf[i++];
+		}
+		if (i + length > len) {
+			return -1;
+		}
+
+		switch (number) {
+		case COAP_OPT_CONTENT_TYPE:
+			for (v = 0; length > 0 && length <= 2; length--) {
+				v = v << 8 | buf[i++];
+			}
+			m->content_type = v;
+			break;
+		case COAP_OPT_URI_PATH:
+			if (path_len + (path_len > 0) + length >= COAP_PATH_MAX) {
+				return -1;
+			}
+			if (path_len > 0) {
+				m->path[path_len++] = '/';
+			}
+			memcpy(m->path + path_len, buf + i, length);
+			path_len += length;
+			m->path[path_len] = 0;
+			break;
+		case COAP_OPT_TOKEN:
+			if (length > COAP_TOKEN_MAX) {
+				return -1;
+			}
+			memcpy(m->token, buf + i, length);
+			m->token_len = length;
+			break;
+		}
+		/* fenceposts, multiples of 14 with no value, only move the number on */
+		i += length;
+	}
+
+	m->payload = buf + i;
+	m->payload_len = len - i;
+	return 0;
+}
+
+int coap_path_is(const struct coap_msg *m, const char *path)
+{
+	return strcmp(m->path, path) == 0;
+}
+
+/* one option, the numbers used here are all within a delta of 15 */
+static uint8_t *option(uint8_t *p, uint8_t *end, uint16_t *number, uint16_t n,
+		       const void *value, uint16_t len)
+{
+	if (p == NULL || len > 15 + 255 || p + 2 + len > end) {
+		return NULL;
+	}
+	if (len < 15) {
+		*p++ = (n - *number) << 4 | len;
+	} else {
+		*p++ = (n - *number) << 4 | 15;
+		*p++ = len - 15;
+	}
+	memcpy(p, value, len);
+	*number = n;
+	return p + len;
+}
+
+uint16_t coap_build(uint8_t *buf, uint16_t size, const struct coap_msg *m)
+{
+	uint8_t *p, *end = buf + size;
+	const char *seg, *slash;
+	uint16_t number = 0;
+	uint8_t ct[2], count = 0;
+
+	if (size < 4) {
+		return 0;
+	}
+	buf[1] = m->code;
+	buf[2] = m->mid >> 8;
+	buf[3] = m->mid;
+	p = buf + 4;
+
+	if (m->content_type >= 0) {
+		ct[0] = m->content_type >> 8;
+		ct[1] = m->content_type;
+		if (m->content_type > 0xff) {
+			p = option(p, end, &number, COAP_OPT_CONTENT_TYPE, ct, 2);
+		} else {
+			p = option(p, end, &number, COAP_OPT_CONTENT_TYPE, ct + 1, 1);
+		}
+		count++;
+	}
+	for (seg = m->path; *seg != 0; seg = *slash ? slash + 1 : slash) {
+		slash = strchr(seg, '/');
+		if (slash == NULL) {
+			slash = seg + strlen(seg);
+		}
+		p = option(p, end, &number, COAP_OPT_URI_PATH, seg, slash - seg);
+		count++;
+	}
+	if (m->token_len > 0) {
+		p = option(p, end, &number, COAP_OPT_TOKEN, m->token, m->token_len);
+		count++;
+	}
+	if (p == NULL || count > 14 || p + m->payload_len > end) {
+		return 0;
+	}
+	buf[0] = 0x40 | m->type << 4 | count;
+
+	memcpy(p, m->payload, m->payload_len);
+	return p + m->payload_len - buf;
+}
@@ -0,0 +1,51 @@
+#ifndef __COAP07_H__
+#define __COAP07_H__
+
+#include <stdint.h>
+
+/* minimal CoAP draft-07 framing, as spoken by er-coap-07 on the nodes */
+/* the header carries an option count, the token is option 11 and there */
+/* is no payload marker. The C side of ../coap07.py */
+
+#define COAP_PORT 5683
+
+enum { COAP_CON, COAP_NON, COAP_ACK, COAP_RST };
+
+#define COAP_POST 2
+#define COAP_CHANGED 68              /* 2.04 */
+#define COAP_NOT_FOUND 132           /* 4.04 */
+#define COAP_METHOD_NOT_ALLOWED 133  /* 4.05 */
+
+#define COAP_OPT_CONTENT_TYPE 1
+#define COAP_OPT_URI_PATH 9
+#define COAP_OPT_TOKEN 11
+
+#define APPLICATION_JSON 50
+#define APPLICATION_CBOR 60
+#define SENML_CBOR 112
+
+#define COAP_TOKEN_MAX 8
+#define COAP_PATH_MAX 64
+
+struct coap_msg {
+	uint8_t type;
+	uint8_t code;
+	uint16_t mid;
+	int16_t content_type;        /* -1 for none */
+	uint8_t token[COAP_TOKEN_MAX];
+	uint8_t token_len;
+	char path[COAP_PATH_MAX];    /* uri path segments joined with '/' */
+	const uint8_t *payload;
+	uint16_t payload_len;
+};
+
+/* 0 if buf holds a well formed message, the payload points into buf */
+int coap_parse(struct coap_msg *m, const uint8_t *buf, uint16_t len);
+
+/* 1 if the uri path is path, given without the leading '/' */
+int coap_path_is(const struct coap_msg *m, const char *path);
+
+/* the message in m, its length or 0 if it doesn't fit in size */
+uint16_t coap_build(uint8_t *buf, uint16_t size, const struct coap_msg *m);
+
+#endif /* __COAP07_H__ */
@@ -0,0 +1,560 @@
+/* the readings in the nodes' posts, see readings.h */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "readings.h"
+
+/* RFC 8428: times under 2^28 are relative to now */
+#define SENML_RELATIVE (1 << 28)
+
+/* SenML-CBOR labels */
+#define SENML_BASE_NAME -2
+#define SENML_BASE_TIME -3
+#define SENML_NAME 0
+#define SENML_VALUE 2
+#define SENML_STRING 3
+#define SENML_TIME 6
+
+#define CBOR_TAG_DECIMAL 4
+
+/* posts don't nest, this is only to stop a hostile one */
+#define DEPTH_MAX 8
+
+struct out {
+	struct reading *r;
+	int n, max;
+	struct reading spare;   /* takes the readings past max */
+};
+
+static struct reading *add(struct out *o, const char *base, uint16_t base_len,
+			   const char *name, uint16_t name_len)
+{
+	struct reading *r = o->n < o->max ? &o->r[o->n++] : &o->spare;
+
+	memset(r, 0, sizeof(*r));
+	if (base_len > READING_NAME_MAX - 1) {
+		base_len = READING_NAME_MAX - 1;
+	}
+	if (name_len > READING_NAME_MAX - 1 - base_len) {
+		name_len = READING_NAME_MAX - 1 - base_len;
+	}
+	memcpy(r->name, base, base_len);
+	memcpy(r->name + base_len, name, name_len);
+	return r;
+}
+
+/* JSON, only as much as create_dht_msg() and friends write */
+
+struct json {
+	const uint8_t *p, *end;
+};
+
+static int peek(struct json *j)
+{
+	while (j->p < j->end && (*j->p == ' ' || *j->p == '\t' || *j->p == '\r' || *j->p == '\n')) {
+		j->p++;
+	}
+	return j->p < j->end ? *j->p : -1;
+}
+
+static int expect(struct json *j, char c)
+{
+	if (peek(j) != c) {
+		return -1;
+	}
+	j->p++;
+	return 0;
+}
+
+/* a string, escapes are left in */
+static int string(struct json *j, const char **s, uint16_t *len)
+{
+	if (expect(j, '"') != 0) {
+		return -1;
+	}
+	*s = (const char *)j->p;
+	while (j->p < j->end && *j->p != '"') {
+		if (*j->p == '\\') {
+			j->p++;
+		}
+		j->p++;
+	}
+	if (j->p >= j->end) {
+		return -1;
+	}
+	*len = (const char *)j->p - *s;
+	j->p++;
+	return 0;
+}
+
+static int integer(struct json *j, int32_t *v)
+{
+	int64_t x = 0;
+	int neg = 0, digits = 0;
+
+	if (peek(j) == '-') {
+		neg = 1;
+		j->p++;
+	}
+	while (j->p < j->end && *j->p >= '0' && *j->p <= '9' && x <= INT32_MAX) {
+		x = x * 10 + *j->p++ - '0';
+		digits++;
+	}
+	if (digits == 0 || x > INT32_MAX) {
+		return -1;
+	}
+	*v = neg ? -x : x;
+	return 0;
+}
+
+static int skip(struct json *j, int depth)
+{
+	const uint8_t *start;
+	const char *s;
+	uint16_t n;
+	int c, close;
+
+	c = peek(j);
+	if (depth > DEPTH_MAX) {
+		return -1;
+	}
+	if (c == '"') {
+		return string(j, &s, &n);
+	}
+	if (c == '{' || c == '[') {
+		close = c == '{' ? '}' : ']';
+		j->p++;
+		if (peek(j) == close) {
+			j->p++;
+			return 0;
+		}
+		for (;;) {
+			if (c == '{' && (string(j, &s, &n) != 0 || expect(j, ':') != 0)) {
+				return -1;
+			}
+			if (skip(j, depth + 1) != 0) {
+				return -1;
+			}
+			if (peek(j) != ',') {
+				break;
+			}
+			j->p++;
+		}
+		return expect(j, close);
+	}
+	/* numbers, true, false and null */
+	start = j->p;
+	while (j->p < j->end && *j->p != 0 && strchr("+-.0123456789eEtrufalsn", *j->p)) {
+		j->p++;
+	}
+	return j->p == start ? -1 : 0;
+}
+
+/* a value with a unit, " 22.1C", "18.3%" or "2678mV" */
+static int decimal_text(const char *s, uint16_t len, struct reading *r)
+{
+	const char *end = s + len;
+	int64_t v = 0;
+	int neg = 0, digits = 0, frac = -1;
+
+	while (s < end && *s == ' ') {
+		s++;
+	}
+	if (s < end && (*s == '-' || *s == '+')) {
+		neg = *s++ == '-';
+	}
+	for (; s < end; s++) {
+		if (*s == '.' && frac < 0) {
+			frac = 0;
+		} else if (*s >= '0' && *s <= '9' && v <= INT32_MAX / 10) {
+			v = v * 10 + *s - '0';
+			digits++;
+			if (frac >= 0) {
+				frac++;
+			}
+		} else {
+			break;
+		}
+	}
+	if (digits == 0 || v > INT32_MAX) {
+		return -1;
+	}
+	r->mantissa = neg ? -v : v;
+	r->exponent = frac > 0 ? -frac : 0;
+	/* a milli unit */
+	if (end - s >= 2 && *s == 'm') {
+		r->exponent -= 3;
+	}
+	return r->exponent < -9 ? -1 : 0;
+}
+
+/* "s" and "q": [[-600,221,183],[-300,220,184]], age and the raw fixed-point values */
+static int samples(struct json *j, struct out *o)
+{
+	struct reading *r;
+	int32_t v[3];
+
+	if (expect(j, '[') != 0) {
+		return -1;
+	}
+	if (peek(j) == ']') {
+		j->p++;
+		return 0;
+	}
+	for (;;) {
+		if (expect(j, '[') != 0 || integer(j, &v[0]) != 0 || expect(j, ',') != 0 ||
+		    integer(j, &v[1]) != 0 || expect(j, ',') != 0 ||
+		    integer(j, &v[2]) != 0 || expect(j, ']') != 0) {
+			return -1;
+		}
+		r = add(o, "", 0, "t", 1);
+		r->mantissa = v[1];
+		r->exponent = -1;
+		r->time = v[0];
+		r = add(o, "", 0, "h", 1);
+		r->mantissa = v[2];
+		r->exponent = -1;
+		r->time = v[0];
+		if (peek(j) != ',') {
+			break;
+		}
+		j->p++;
+	}
+	return expect(j, ']');
+}
+
+int readings_json(const uint8_t *p, uint16_t len, struct reading *r, int max)
+{
+	struct json j = { p, p + len };
+	struct out o = { .r = r, .n = 0, .max = max };
+	struct reading *rec;
+	const char *key, *s;
+	uint16_t key_len, n;
+	int32_t v;
+	int c;
+
+	if (expect(&j, '{') != 0) {
+		return -1;
+	}
+	if (peek(&j) == '}') {
+		return 0;
+	}
+	for (;;) {
+		if (string(&j, &key, &key_len) != 0 || expect(&j, ':') != 0) {
+			return -1;
+		}
+		c = peek(&j);
+		if (key_len == 1 && (*key == 's' || *key == 'q')) {
+			if (samples(&j, &o) != 0) {
+				return -1;
+			}
+		} else if (c == '"') {
+			/* "t", "h", "vb" and "err" */
+			string(&j, &s, &n);
+			rec = add(&o, "", 0, key, key_len);
+			if (decimal_text(s, n, rec) != 0) {
+				rec->str = s;
+				rec->str_len = n;
+			}
+		} else if (c == '-' || (c >= '0' && c <= '9')) {
+			if (integer(&j, &v) != 0) {
+				return -1;
+			}
+			rec = add(&o, "", 0, key, key_len);
+			rec->mantissa = v;
+		} else if (skip(&j, 0) != 0) {
+			return -1;
+		}
+		if (peek(&j) != ',') {
+			break;
+		}
+		j.p++;
+	}
+	if (expect(&j, '}') != 0) {
+		return -1;
+	}
+	return o.n;
+}
+
+/* SenML-CBOR, RFC 8428 */
+
+struct cbor {
+	const uint8_t *p, *end;
+};
+
+static int head(struct cbor *c, uint8_t *major, uint64_t *arg)
+{
+	uint8_t ai, n;
+
+	if (c->p >= c->end) {
+		return -1;
+	}
+	*major = *c->p >> 5;
+	ai = *c->p++ & 0x1f;
+	if (ai < 24) {
+		*arg = ai;
+		return 0;
+	}
+	/* no indefinite lengths */
+	if (ai > 27) {
+		return -1;
+	}
+	n = 1 << (ai - 24);
+	if (c->end - c->p < n) {
+		return -1;
+	}
+	for (*arg = 0; n > 0; n--) {
+		*arg = *arg << 8 | *c->p++;
+	}
+	return 0;
+}
+
+static int cbor_int(struct cbor *c, int32_t *v)
+{
+	uint8_t major;
+	uint64_t arg;
+
+	if (head(c, &major, &arg) != 0 || major > 1 || arg > INT32_MAX) {
+		return -1;
+	}
+	*v = major == 0 ? (int32_t)arg : -1 - (int32_t)arg;
+	return 0;
+}
+
+static int cbor_text(struct cbor *c, const char **s, uint16_t *len)
+{
+	uint8_t major;
+	uint64_t arg;
+
+	if (head(c, &major, &arg) != 0 || major != 3 || arg > (uint64_t)(c->end - c->p)) {
+		return -1;
+	}
+	*s = (const char *)c->p;
+	*len = arg;
+	c->p += arg;
+	return 0;
+}
+
+static int cbor_skip(struct cbor *c, int depth)
+{
+	uint8_t major;
+	uint64_t arg, i;
+
+	if (depth > DEPTH_MAX || head(c, &major, &arg) != 0) {
+		return -1;
+	}
+	switch (major) {
+	case 2:
+	case 3:
+		if (arg > (uint64_t)(c->end - c->p)) {
+			return -1;
+		}
+		c->p += arg;
+		return 0;
+	case 4:
+	case 5:
+		for (i = 0; i < (major == 5 ? 2 * arg : arg); i++) {
+			if (cbor_skip(c, depth + 1) != 0) {
+				return -1;
+			}
+		}
+		return 0;
+	case 6:
+		return cbor_skip(c, depth + 1);
+	default:
+		/* integers and simple values */
+		return 0;
+	}
+}
+
+/* a value: an integer, a decimal fraction like the nodes send, or a float */
+static int cbor_number(struct cbor *c, int32_t *mantissa, int8_t *exponent)
+{
+	const uint8_t *start = c->p;
+	uint8_t major;
+	uint64_t arg;
+	uint32_t bits;
+	int32_t e;
+	float f;
+	double d;
+
+	if (head(c, &major, &arg) != 0) {
+		return -1;
+	}
+	if (major <= 1) {
+		c->p = start;
+		*exponent = 0;
+		return cbor_int(c, mantissa);
+	}
+	if (major == 6 && arg == CBOR_TAG_DECIMAL) {
+		if (head(c, &major, &arg) != 0 || major != 4 || arg != 2 ||
+		    cbor_int(c, &e) != 0 || cbor_int(c, mantissa) != 0 || e < -9 || e > 9) {
+			return -1;
+		}
+		*exponent = e;
+		return 0;
+	}
+	if (major == 7 && (*start == 0xfa || *start == 0xfb)) {
+		if (*start == 0xfa) {
+			bits = arg;
+			memcpy(&f, &bits, sizeof(f));
+			d = f;
+		} else {
+			memcpy(&d, &arg, sizeof(d));
+		}
+		/* thousandths are plenty for a sensor */
+		if (!(fabs(d) < 2e6)) {
+			return -1;
+		}
+		*mantissa = lround(d * 1000);
+		*exponent = -3;
+		while (*exponent < 0 && *mantissa % 10 == 0) {
+			*mantissa /= 10;
+			(*exponent)++;
+		}
+		return 0;
+	}
+	return -1;
+}
+
+/* a time in whole seconds */
+static int cbor_seconds(struct cbor *c, int32_t *t)
+{
+	int32_t m;
+	int8_t e;
+
+	if (cbor_number(c, &m, &e) != 0 || e > 0) {
+		return -1;
+	}
+	for (; e < 0; e++) {
+		m /= 10;
+	}
+	*t = m;
+	return 0;
+}
+
+int readings_senml(const uint8_t *p, uint16_t len, struct reading *r, int max)
+{
+	struct cbor c = { p, p + len };
+	struct out o = { .r = r, .n = 0, .max = max };
+	struct reading rec, *out;
+	const char *base = "", *name;
+	uint16_t base_len = 0, name_len;
+	int32_t base_time = 0, label;
+	uint64_t records, pairs;
+	uint8_t major;
+	int has_value;
+
+	if (head(&c, &major, &records) != 0 || major != 4) {
+		return -1;
+	}
+	while (records-- > 0) {
+		if (head(&c, &major, &pairs) != 0 || major != 5) {
+			return -1;
+		}
+		memset(&rec, 0, sizeof(rec));
+		name = "";
+		name_len = 0;
+		has_value = 0;
+		while (pairs-- > 0) {
+			if (cbor_int(&c, &label) != 0) {
+				return -1;
+			}
+			switch (label) {
+			case SENML_BASE_NAME:
+				if (cbor_text(&c, &base, &base_len) != 0) {
+					return -1;
+				}
+				break;
+			case SENML_BASE_TIME:
+				if (cbor_seconds(&c, &base_time) != 0) {
+					return -1;
+				}
+				break;
+			case SENML_NAME:
+				if (cbor_text(&c, &name, &name_len) != 0) {
+					return -1;
+				}
+				break;
+			case SENML_VALUE:
+				if (cbor_number(&c, &rec.mantissa, &rec.exponent) != 0) {
+					return -1;
+				}
+				has_value = 1;
+				break;
+			case SENML_STRING:
+				if (cbor_text(&c, &rec.str, &rec.str_len) != 0) {
+					return -1;
+				}
+				has_value = 1;
+				break;
+			case SENML_TIME:
+				if (cbor_seconds(&c, &rec.time) != 0) {
+					return -1;
+				}
+				break;
+			default:
+				if (cbor_skip(&c, 0) != 0) {
+					return -1;
+				}
+			}
+		}
+		/* a record with only base fields */
+		if (!has_value) {
+			continue;
+		}
+		out = add(&o, base, base_len, name, name_len);
+		out->mantissa = rec.mantissa;
+		out->exponent = rec.exponent;
+		out->str = rec.str;
+		out->str_len = rec.str_len;
+		out->time = base_time + rec.time;
+	}
+	return o.n;
+}
+
+void reading_value(const struct reading *r, char *text)
+{
+	uint32_t u, pow10;
+	int8_t e, digits;
+	uint16_t i;
+
+	if (r->str != NULL) {
+		/* one field on the line */
+		for (i = 0; i < r->str_len && i < READING_TEXT_MAX - 1; i++) {
+			text[i] = r->str[i] > ' ' && r->str[i] < 127 ? r->str[i] : '_';
+		}
+		if (i == 0) {
+			text[i++] = '-';
+		}
+		text[i] = 0;
+		return;
+	}
+	if (r->exponent >= 0) {
+		snprintf(text, READING_TEXT_MAX, "%ld", (long)r->mantissa);
+		for (i = strlen(text), e = 0; e < r->exponent && i < READING_TEXT_MAX - 1; e++) {
+			text[i++] = '0';
+		}
+		text[i] = 0;
+		return;
+	}
+	/* the parsers keep exponents to -9 */
+	digits = r->exponent < -9 ? 9 : -r->exponent;
+	u = r->mantissa < 0 ? -(uint32_t)r->mantissa : (uint32_t)r->mantissa;
+	for (pow10 = 1, e = 0; e < digits; e++) {
+		pow10 *= 10;
+	}
+	snprintf(text, READING_TEXT_MAX, "%s%lu.%0*lu", r->mantissa < 0 ? "-" : "",
+		 (unsigned long)(u / pow10), digits, (unsigned long)(u % pow10));
+}
+
+uint32_t reading_time(const struct reading *r, uint32_t now)
+{
+	if (r->time < SENML_RELATIVE) {
+		return now + r->time;
+	}
+	return r->time;
+}
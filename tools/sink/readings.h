@@ -0,0 +1,34 @@
+#ifndef __READINGS_H__
+#define __READINGS_H__
+
+#include <stdint.h>
+
+/* the readings in a node's post, from the JSON of create_dht_msg(), */
+/* create_log_msg() and create_error_msg(), or from SenML-CBOR */
+
+#define READINGS_MAX 64
+#define READING_NAME_MAX 16
+#define READING_TEXT_MAX 48
+
+/* one SenML record: a value of mantissa * 10^exponent or a string */
+struct reading {
+	char name[READING_NAME_MAX];
+	int32_t mantissa;
+	int8_t exponent;
+	int32_t time;           /* under 2^28 it is seconds relative to now */
+	const char *str;        /* a string value if not NULL, points into the post */
+	uint16_t str_len;
+};
+
+/* the readings in a post, how many or -1 if it can't be read */
+/* readings past max are dropped */
+int readings_json(const uint8_t *p, uint16_t len, struct reading *r, int max);
+int readings_senml(const uint8_t *p, uint16_t len, struct reading *r, int max);
+
+/* the value as text, READING_TEXT_MAX with the nul */
+void reading_value(const struct reading *r, char *text);
+
+/* when it was taken, in unix seconds */
+uint32_t reading_time(const struct reading *r, uint32_t now);
+
+#endif /* __READINGS_H__ */
@@ -0,0 +1,559 @@
+/* reference sink for TH12 posts */
+
+/* answers the nodes' sensor posts on /sink like the sink the firmware */
+/* points at by default, and writes out the readings in them. Every */
+/* answer carries the sink's time, {"ts":1760000000}, for the post slots. */
+
+/* each worker has its own socket on the port (SO_REUSEPORT), so the */
+/* kernel keeps a node's messages on one worker and the CON dedup needs */
+/* no locks. A worker reads a batch with recvmmsg, answers all of it with */
+/* one sendmmsg and only then writes the readings, so nodes hear back */
+/* as soon as possible and can go to sleep. */
+
+/*   ./sink [-p port] [-w workers] [-P path] [-o file] [-i secs] [-q] */
+/*   make bench          load test with sinkload, see sinkload.c */
+
+/* the nodes run er-coap-07, so this speaks draft-07 framing, see coap07.py */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "msgbuf.h"
+#include "coap07.h"
+#include "readings.h"
+
+#define WORKERS_MAX 64
+#define BATCH 64
+#define MSG_MAX 1280
+#define RESPONSE_MAX 64
+#define OUT_SIZE 65536
+
+/* how long a CON can be retransmitted, draft-07's EXCHANGE_LIFETIME */
+#define EXCHANGE_LIFETIME 247
+
+/* CONs seen per worker: 4 ways per bucket, the oldest is replaced, */
+/* so under load it only has to cover the retransmit window */
+#define DEDUP_BUCKETS (1 << 16)
+#define DEDUP_WAYS 4
+
+/* answer times in us, the last bucket is everything slower */
+#define LAT_BUCKETS 10000
+
+struct seen {
+	struct in6_addr addr;
+	uint16_t port;
+	uint16_t mid;
+	uint32_t time;
+};
+
+struct stats {
+	uint64_t msgs, dups, bad, unparsed, readings, refused;
+	uint64_t lat[LAT_BUCKETS + 1];
+};
+
+struct worker {
+	pthread_t thread;
+	int sock;
+	struct seen (*seen)[DEDUP_WAYS];
+	char out[OUT_SIZE];
+	size_t out_len;
+	struct stats stats;
+} __attribute__((aligned(64)));
+
+static struct worker *workers;
+static int n_workers = 4;
+static uint16_t port = COAP_PORT;
+static const char *path = "sink";
+static int out_fd = 1;
+static int quiet;
+static volatile sig_atomic_t stop;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -p port     udp port (5683)\n"
+		"  -w n        workers, one socket each (4)\n"
+		"  -P path     uri path the nodes post to (/sink)\n"
+		"  -o file     append readings to file instead of stdout\n"
+		"  -q          don't write readings\n"
+		"  -i secs     print rates every secs to stderr, 0 for none (10)\n",
+		prog);
+	exit(2);
+}
+
+static void stat_add(uint64_t *v, uint64_t n)
+{
+	__atomic_fetch_add(v, n, __ATOMIC_RELAXED);
+}
+
+static uint64_t stat_get(uint64_t *v)
+{
+	return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+/* 1 if this CON was answered already, else it is remembered */
+static int dedup(struct worker *w, const struct sockaddr_in6 *src, uint16_t mid, uint32_t now)
+{
+	struct seen *b, *e, *oldest;
+	uint32_t h;
+	int i;
+
+	h = mid * 0x9e3779b1u ^ src->sin6_port * 0x85ebca6bu;
+	for (i = 0; i < 16; i += 4) {
+		uint32_t a;
+		memcpy(&a, src->sin6_addr.s6_addr + i, 4);
+		h = (h ^ a) * 0xc2b2ae35u;
+	}
+	b = w->seen[(h ^ (h >> 16)) & (DEDUP_BUCKETS - 1)];
+
+	oldest = b;
+	for (e = b; e < b + DEDUP_WAYS; e++) {
+		if (e->time != 0 && now - e->time < EXCHANGE_LIFETIME && e->mid == mid &&
+		    e->port == src->sin6_port && memcmp(&e->addr, &src->sin6_addr, sizeof(e->addr)) == 0) {
+			return 1;
+		}
+		if (e->time < oldest->time) {
+			oldest = e;
+		}
+	}
+	oldest->addr = src->sin6_addr;
+	oldest->port = src->sin6_port;
+	oldest->mid = mid;
+	oldest->time = now;
+	return 0;
+}
+
+/* the EUI-64 from the interface id of an autoconfigured address */
+static void eui_of(const struct in6_addr *a, char *eui)
+{
+	static const char hex[] = "0123456789abcdef";
+	uint8_t b;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		b = a->s6_addr[8 + i] ^ (i == 0 ? 0x02 : 0);
+		eui[2 * i] = hex[b >> 4];
+		eui[2 * i + 1] = hex[b & 0xf];
+	}
+	eui[16] = 0;
+}
+
+static void out_flush(struct worker *w)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < w->out_len) {
+		n = write(out_fd, w->out + done, w->out_len - done);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("write");
+			break;
+		}
+		done += n;
+	}
+	w->out_len = 0;
+}
+
+/* one line per reading: time, eui, name and value */
+static void out_readings(struct worker *w, const struct in6_addr *src, uint32_t now,
+			 const struct reading *r, int n)
+{
+	char eui[17], value[READING_TEXT_MAX];
+	int i, len;
+
+	eui_of(src, eui);
+	for (i = 0; i < n; i++) {
+		if (w->out_len > OUT_SIZE - 2 * READING_TEXT_MAX) {
+			out_flush(w);
+		}
+		reading_value(&r[i], value);
+		len = snprintf(w->out + w->out_len, OUT_SIZE - w->out_len, "%lu %s %s %s\n",
+			       (unsigned long)reading_time(&r[i], now), eui, r[i].name, value);
+		w->out_len += len;
+	}
+}
+
+/* the answer to one post, its length or 0 for none */
+static uint16_t answer(struct worker *w, const uint8_t *msg, uint16_t len,
+		       const struct sockaddr_in6 *src, uint32_t now, uint8_t *response)
+{
+	struct coap_msg req, resp;
+	struct reading r[READINGS_MAX];
+	uint8_t payload[24];
+	struct msgbuf m;
+	int n;
+
+	if (coap_parse(&req, msg, len) != 0) {
+		stat_add(&w->stats.bad, 1);
+		return 0;
+	}
+	if (req.type != COAP_CON && req.type != COAP_NON) {
+		return 0;
+	}
+	stat_add(&w->stats.msgs, 1);
+
+	memset(&resp, 0, sizeof(resp));
+	/* er-coap-07 matches the response to its request by message id, for NON too */
+	resp.type = req.type == COAP_CON ? COAP_ACK : COAP_NON;
+	resp.mid = req.mid;
+	memcpy(resp.token, req.token, req.token_len);
+	resp.token_len = req.token_len;
+	resp.content_type = -1;
+
+	if (!coap_path_is(&req, path)) {
+		stat_add(&w->stats.refused, 1);
+		resp.code = COAP_NOT_FOUND;
+		return coap_build(response, RESPONSE_MAX, &resp);
+	}
+	if (req.code != COAP_POST) {
+		stat_add(&w->stats.refused, 1);
+		resp.code = COAP_METHOD_NOT_ALLOWED;
+		return coap_build(response, RESPONSE_MAX, &resp);
+	}
+
+	/* a retransmission, the ACK got lost: answer again but keep the readings once */
+	if (req.type == COAP_CON && dedup(w, src, req.mid, now)) {
+		stat_add(&w->stats.dups, 1);
+	} else {
+		if (req.content_type == SENML_CBOR) {
+			n = readings_senml(req.payload, req.payload_len, r, READINGS_MAX);
+		} else {
+			n = readings_json(req.payload, req.payload_len, r, READINGS_MAX);
+		}
+		if (n < 0) {
+			stat_add(&w->stats.unparsed, 1);
+		} else {
+			stat_add(&w->stats.readings, n);
+			if (!quiet) {
+				out_readings(w, &src->sin6_addr, now, r, n);
+			}
+		}
+	}
+
+	/* a post we can't read is answered too, the node only needs to know we're here */
+	resp.code = COAP_CHANGED;
+	resp.payload = payload;
+	if (req.content_type == SENML_CBOR) {
+		/* {"ts":now} */
+		resp.content_type = APPLICATION_CBOR;
+		payload[0] = 0xa1;
+		payload[1] = 0x62;
+		payload[2] = 't';
+		payload[3] = 's';
+		payload[4] = 0x1a;
+		payload[5] = now >> 24;
+		payload[6] = now >> 16;
+		payload[7] = now >> 8;
+		payload[8] = now;
+		resp.payload_len = 9;
+	} else {
+		resp.content_type = APPLICATION_JSON;
+		msgbuf_init(&m, (char *)payload, sizeof(payload));
+		msgbuf_puts(&m, "{\"ts\":");
+		msgbuf_put_uint(&m, now);
+		msgbuf_putc(&m, '}');
+		resp.payload_len = msgbuf_finish(&m);
+	}
+	return coap_build(response, RESPONSE_MAX, &resp);
+}
+
+/* kernel receive time to answer sent */
+static void lat_add(struct worker *w, const struct msghdr *h, const struct timespec *sent)
+{
+	struct cmsghdr *c;
+	struct timespec rx;
+	int64_t us;
+
+	for (c = CMSG_FIRSTHDR(h); c != NULL; c = CMSG_NXTHDR((struct msghdr *)h, c)) {
+		if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+			memcpy(&rx, CMSG_DATA(c), sizeof(rx));
+			us = (sent->tv_sec - rx.tv_sec) * 1000000 + (sent->tv_nsec - rx.tv_nsec) / 1000;
+			if (us < 0) {
+				us = 0;
+			}
+			stat_add(&w->stats.lat[us < LAT_BUCKETS ? us : LAT_BUCKETS], 1);
+			return;
+		}
+	}
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	static __thread uint8_t bufs[BATCH][MSG_MAX];
+	static __thread uint8_t responses[BATCH][RESPONSE_MAX];
+	static __thread char ctrl[BATCH][CMSG_SPACE(sizeof(struct timespec))];
+	struct sockaddr_in6 srcs[BATCH];
+	struct mmsghdr in[BATCH], out[BATCH];
+	struct iovec iov_in[BATCH], iov_out[BATCH];
+	uint16_t len;
+	struct timespec ts;
+	int i, n, n_out, sent;
+
+	for (i = 0; i < BATCH; i++) {
+		iov_in[i].iov_base = bufs[i];
+		iov_in[i].iov_len = MSG_MAX;
+		iov_out[i].iov_base = responses[i];
+	}
+
+	while (!stop) {
+		for (i = 0; i < BATCH; i++) {
+			memset(&in[i].msg_hdr, 0, sizeof(in[i].msg_hdr));
+			in[i].msg_hdr.msg_name = &srcs[i];
+			in[i].msg_hdr.msg_namelen = sizeof(srcs[i]);
+			in[i].msg_hdr.msg_iov = &iov_in[i];
+			in[i].msg_hdr.msg_iovlen = 1;
+			in[i].msg_hdr.msg_control = ctrl[i];
+			in[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+		}
+		/* wait for one, then take whatever else is queued */
+		n = recvmmsg(w->sock, in, BATCH, MSG_WAITFORONE, NULL);
+		if (n <= 0) {
+			if (n < 0 && errno != EAGAIN && errno != EINTR) {
+				perror("recvmmsg");
+			}
+			/* idle, the readings so far go out */
+			out_flush(w);
+			continue;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		n_out = 0;
+		for (i = 0; i < n; i++) {
+			len = answer(w, bufs[i], in[i].msg_len, &srcs[i], ts.tv_sec, responses[i]);
+			if (len == 0) {
+				continue;
+			}
+			iov_out[i].iov_len = len;
+			memset(&out[n_out].msg_hdr, 0, sizeof(out[n_out].msg_hdr));
+			out[n_out].msg_hdr.msg_name = &srcs[i];
+			out[n_out].msg_hdr.msg_namelen = in[i].msg_hdr.msg_namelen;
+			out[n_out].msg_hdr.msg_iov = &iov_out[i];
+			out[n_out].msg_hdr.msg_iovlen = 1;
+			n_out++;
+		}
+
+		for (sent = 0; sent < n_out; ) {
+			i = sendmmsg(w->sock, out + sent, n_out - sent, 0);
+			if (i < 0) {
+				if (errno != EINTR) {
+					perror("sendmmsg");
+					break;
+				}
+				continue;
+			}
+			sent += i;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		for (i = 0; i < n; i++) {
+			lat_add(w, &in[i].msg_hdr, &ts);
+		}
+		if (w->out_len > OUT_SIZE / 2) {
+			out_flush(w);
+		}
+	}
+	out_flush(w);
+	return NULL;
+}
+
+static int sink_socket(void)
+{
+	struct sockaddr_in6 a;
+	struct timeval tv = { 0, 100000 };
+	int s, on = 1, off = 0, rcvbuf = 4 << 20;
+
+	s = socket(AF_INET6, SOCK_DGRAM, 0);
+	if (s < 0) {
+		perror("socket");
+		exit(1);
+	}
+	setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+	setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+	setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	setsockopt(s, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+	/* wakes an idle worker to flush and to see stop */
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	memset(&a, 0, sizeof(a));
+	a.sin6_family = AF_INET6;
+	a.sin6_addr = in6addr_any;
+	a.sin6_port = htons(port);
+	if (bind(s, (struct sockaddr *)&a, sizeof(a)) < 0) {
+		perror("bind");
+		exit(1);
+	}
+	return s;
+}
+
+/* answer time percentile in us from a histogram */
+static unsigned lat_percentile(const uint64_t *lat, double p)
+{
+	uint64_t total = 0, sum = 0;
+	unsigned i;
+
+	for (i = 0; i <= LAT_BUCKETS; i++) {
+		total += lat[i];
+	}
+	for (i = 0; i <= LAT_BUCKETS; i++) {
+		sum += lat[i];
+		if (sum > 0 && sum >= p * total) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+static void stats_sum(struct stats *s)
+{
+	int i, j;
+
+	memset(s, 0, sizeof(*s));
+	for (i = 0; i < n_workers; i++) {
+		struct stats *ws = &workers[i].stats;
+		s->msgs += stat_get(&ws->msgs);
+		s->dups += stat_get(&ws->dups);
+		s->bad += stat_get(&ws->bad);
+		s->unparsed += stat_get(&ws->unparsed);
+		s->readings += stat_get(&ws->readings);
+		s->refused += stat_get(&ws->refused);
+		for (j = 0; j <= LAT_BUCKETS; j++) {
+			s->lat[j] += stat_get(&ws->lat[j]);
+		}
+	}
+}
+
+static void stats_print(const struct stats *s, const struct stats *last, double secs)
+{
+	uint64_t lat[LAT_BUCKETS + 1];
+	int j;
+
+	for (j = 0; j <= LAT_BUCKETS; j++) {
+		lat[j] = s->lat[j] - last->lat[j];
+	}
+	fprintf(stderr, "%.0f msgs/s, %lu msgs, %lu dups, %lu readings, %lu unparsed, %lu bad, %lu refused, answer p50 %uus p99 %uus\n",
+		(s->msgs - last->msgs) / secs,
+		(unsigned long)(s->msgs - last->msgs), (unsigned long)(s->dups - last->dups),
+		(unsigned long)(s->readings - last->readings), (unsigned long)(s->unparsed - last->unparsed),
+		(unsigned long)(s->bad - last->bad), (unsigned long)(s->refused - last->refused),
+		lat_percentile(lat, 0.50), lat_percentile(lat, 0.99));
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static double seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	static struct stats total, last, zero;
+	struct sigaction sa;
+	double start, t_last, t;
+	int interval = 10;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "p:w:P:o:qi:")) != -1) {
+		switch (c) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'w':
+			n_workers = atoi(optarg);
+			if (n_workers < 1 || n_workers > WORKERS_MAX) {
+				usage(argv[0]);
+			}
+			break;
+		case 'P':
+			path = optarg;
+			while (*path == '/') {
+				path++;
+			}
+			break;
+		case 'o':
+			out_fd = open(optarg, O_WRONLY | O_CREAT | O_APPEND, 0644);
+			if (out_fd < 0) {
+				perror(optarg);
+				exit(1);
+			}
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	workers = aligned_alloc(64, n_workers * sizeof(*workers));
+	if (workers == NULL) {
+		perror("workers");
+		exit(1);
+	}
+	memset(workers, 0, n_workers * sizeof(*workers));
+	for (i = 0; i < n_workers; i++) {
+		workers[i].seen = calloc(DEDUP_BUCKETS, sizeof(*workers[i].seen));
+		if (workers[i].seen == NULL) {
+			perror("dedup");
+			exit(1);
+		}
+		workers[i].sock = sink_socket();
+	}
+	for (i = 0; i < n_workers; i++) {
+		pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+	}
+	fprintf(stderr, "listening on port %u, /%s, %d workers\n", port, path, n_workers);
+
+	start = t_last = seconds();
+	while (!stop) {
+		sleep(interval > 0 ? interval : 1);
+		t = seconds();
+		if (interval > 0 && !stop) {
+			stats_sum(&total);
+			stats_print(&total, &last, t - t_last);
+			last = total;
+			t_last = t;
+		}
+	}
+
+	for (i = 0; i < n_workers; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	stats_sum(&total);
+	fprintf(stderr, "total: ");
+	stats_print(&total, &zero, seconds() - start);
+	return 0;
+}
@@ -0,0 +1,340 @@
+/* load generator for the reference sink */
+
+/* stands in for a fleet of nodes. Each source has its own socket, so the */
+/* sink sees a separate node, and keeps one post outstanding like a node */
+/* does. Posts are built like create_dht_msg() builds them, with the */
+/* firmware's msgbuf and senml code. Some CONs go out twice, like a */
+/* retransmission after a lost ACK, so the sink's dedup gets exercised. */
+/* Reports answered posts per second and the response latency. */
+
+/*   ./sinkload [-h host] [-p port] [-n sources] [-t threads] [-d secs] [-N] [-c] [-r dup%] */
+
+#define _GNU_SOURCE
+
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "msgbuf.h"
+#include "senml.h"
+#include "coap07.h"
+
+#define THREADS_MAX 64
+#define MSG_MAX 1280
+#define BUF_SIZE 256
+
+/* latency in us, the last bucket is everything slower */
+#define LAT_BUCKETS 100000
+
+struct source {
+	int sock;
+	uint16_t mid;
+	uint8_t waiting;
+	uint64_t sent;
+};
+
+struct thread {
+	pthread_t thread;
+	struct source *src;
+	struct pollfd *fds;
+	int n;
+	uint32_t rng;
+	uint64_t sent, answered, lost, twice, max_ns;
+	uint32_t lat[LAT_BUCKETS + 1];
+};
+
+static const char *host = "::1";
+static const char *port = "5683";
+static int n_sources = 256;
+static int n_threads = 4;
+static int secs = 10;
+static int timeout_ms = 1000;
+static uint8_t type = COAP_CON;
+static uint8_t cbor;
+static int dup_pct = 1;
+static struct addrinfo *sink;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -h host     the sink (::1)\n"
+		"  -p port     its port (5683)\n"
+		"  -n n        sources, one socket each (256)\n"
+		"  -t n        threads (4)\n"
+		"  -d secs     how long to run (10)\n"
+		"  -T ms       an answer later than this is lost (1000)\n"
+		"  -N          NON posts instead of CON\n"
+		"  -c          SenML-CBOR instead of JSON\n"
+		"  -r pct      CONs sent twice, in percent (1)\n",
+		prog);
+	exit(2);
+}
+
+static uint64_t ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t rnd(struct thread *t)
+{
+	t->rng ^= t->rng << 13;
+	t->rng ^= t->rng >> 17;
+	t->rng ^= t->rng << 5;
+	return t->rng;
+}
+
+/* a reading as a node would post it */
+static uint16_t payload(struct thread *th, char *buf)
+{
+	struct msgbuf m;
+	int16_t t = 180 + rnd(th) % 80;
+	uint16_t rh = 300 + rnd(th) % 400;
+	uint16_t vb = 2500 + rnd(th) % 500;
+
+	msgbuf_init(&m, buf, BUF_SIZE);
+	if (cbor) {
+		senml_start(&m, 3);
+		senml_decimal(&m, "t", t, -1);
+		senml_decimal(&m, "h", rh, -1);
+		senml_decimal(&m, "vb", vb, -3);
+		return msgbuf_len(&m);
+	}
+	msgbuf_puts(&m, "{\"t\":\" ");
+	msgbuf_put_fixed(&m, t, 1);
+	msgbuf_puts(&m, "C\",\"h\":\"");
+	msgbuf_put_fixed(&m, rh, 1);
+	msgbuf_puts(&m, "%\",\"vb\":\"");
+	msgbuf_put_uint(&m, vb);
+	msgbuf_puts(&m, "mV\"}");
+	return msgbuf_finish(&m);
+}
+
+static void post(struct thread *th, struct source *s)
+{
+	struct coap_msg req;
+	uint8_t msg[MSG_MAX];
+	char buf[BUF_SIZE];
+	uint16_t len;
+
+	memset(&req, 0, sizeof(req));
+	req.type = type;
+	req.code = COAP_POST;
+	req.mid = ++s->mid;
+	req.content_type = cbor ? SENML_CBOR : APPLICATION_JSON;
+	strcpy(req.path, "sink");
+	req.payload = (uint8_t *)buf;
+	req.payload_len = payload(th, buf);
+	len = coap_build(msg, sizeof(msg), &req);
+
+	s->sent = ns();
+	s->waiting = 1;
+	send(s->sock, msg, len, 0);
+	th->sent++;
+	if (type == COAP_CON && rnd(th) % 100 < (uint32_t)dup_pct) {
+		send(s->sock, msg, len, 0);
+		th->twice++;
+	}
+}
+
+static void answered(struct thread *th, struct source *s, uint64_t now)
+{
+	uint8_t buf[MSG_MAX];
+	uint64_t d, us;
+	ssize_t n;
+
+	while ((n = recv(s->sock, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+		/* the answer to a post sent twice comes twice */
+		if (n < 4 || !s->waiting || (buf[2] << 8 | buf[3]) != s->mid || buf[1] != COAP_CHANGED) {
+			continue;
+		}
+		d = now - s->sent;
+		us = d / 1000;
+		th->lat[us < LAT_BUCKETS ? us : LAT_BUCKETS]++;
+		if (d > th->max_ns) {
+			th->max_ns = d;
+		}
+		th->answered++;
+		s->waiting = 0;
+	}
+}
+
+static void *thread_run(void *arg)
+{
+	struct thread *th = arg;
+	uint64_t now, end, next_check;
+	int i;
+
+	now = ns();
+	end = now + secs * 1000000000ull;
+	next_check = now;
+	while (now < end) {
+		for (i = 0; i < th->n; i++) {
+			if (!th->src[i].waiting) {
+				post(th, &th->src[i]);
+			}
+		}
+		if (poll(th->fds, th->n, 1) < 0) {
+			perror("poll");
+			break;
+		}
+		now = ns();
+		for (i = 0; i < th->n; i++) {
+			if (th->fds[i].revents & POLLIN) {
+				answered(th, &th->src[i], now);
+			}
+		}
+		if (now >= next_check) {
+			for (i = 0; i < th->n; i++) {
+				if (th->src[i].waiting && now - th->src[i].sent > timeout_ms * 1000000ull) {
+					th->src[i].waiting = 0;
+					th->lost++;
+				}
+			}
+			next_check = now + 100000000ull;
+		}
+	}
+	return NULL;
+}
+
+static int source_socket(void)
+{
+	int s;
+
+	s = socket(sink->ai_family, sink->ai_socktype, sink->ai_protocol);
+	if (s < 0) {
+		perror("socket");
+		exit(1);
+	}
+	if (connect(s, sink->ai_addr, sink->ai_addrlen) < 0) {
+		perror("connect");
+		exit(1);
+	}
+	return s;
+}
+
+static unsigned percentile(const uint64_t *lat, uint64_t total, double p)
+{
+	uint64_t sum = 0;
+	unsigned i;
+
+	for (i = 0; i <= LAT_BUCKETS; i++) {
+		sum += lat[i];
+		if (sum > 0 && sum >= p * total) {
+			return i;
+		}
+	}
+	return LAT_BUCKETS;
+}
+
+int main(int argc, char **argv)
+{
+	static struct thread threads[THREADS_MAX];
+	static uint64_t lat[LAT_BUCKETS + 1];
+	struct addrinfo hints;
+	uint64_t sent = 0, answered = 0, lost = 0, twice = 0, max_ns = 0, start;
+	double elapsed;
+	int c, i, j, per, err;
+
+	while ((c = getopt(argc, argv, "h:p:n:t:d:T:Ncr:")) != -1) {
+		switch (c) {
+		case 'h':
+			host = optarg;
+			break;
+		case 'p':
+			port = optarg;
+			break;
+		case 'n':
+			n_sources = atoi(optarg);
+			break;
+		case 't':
+			n_threads = atoi(optarg);
+			break;
+		case 'd':
+			secs = atoi(optarg);
+			break;
+		case 'T':
+			timeout_ms = atoi(optarg);
+			break;
+		case 'N':
+			type = COAP_NON;
+			break;
+		case 'c':
+			cbor = 1;
+			break;
+		case 'r':
+			dup_pct = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (n_threads < 1 || n_threads > THREADS_MAX || n_sources < n_threads || secs < 1) {
+		usage(argv[0]);
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_DGRAM;
+	err = getaddrinfo(host, port, &hints, &sink);
+	if (err != 0) {
+		fprintf(stderr, "%s: %s\n", host, gai_strerror(err));
+		exit(1);
+	}
+
+	for (i = 0; i < n_threads; i++) {
+		struct thread *th = &threads[i];
+		per = n_sources / n_threads + (i < n_sources % n_threads);
+		th->src = calloc(per, sizeof(*th->src));
+		th->fds = calloc(per, sizeof(*th->fds));
+		th->n = per;
+		th->rng = 2463534242u + i;
+		for (j = 0; j < per; j++) {
+			th->src[j].sock = source_socket();
+			th->src[j].mid = rnd(th);
+			th->fds[j].fd = th->src[j].sock;
+			th->fds[j].events = POLLIN;
+		}
+	}
+
+	start = ns();
+	for (i = 0; i < n_threads; i++) {
+		pthread_create(&threads[i].thread, NULL, thread_run, &threads[i]);
+	}
+	for (i = 0; i < n_threads; i++) {
+		struct thread *th = &threads[i];
+		pthread_join(th->thread, NULL);
+		sent += th->sent;
+		answered += th->answered;
+		lost += th->lost;
+		twice += th->twice;
+		if (th->max_ns > max_ns) {
+			max_ns = th->max_ns;
+		}
+		for (j = 0; j <= LAT_BUCKETS; j++) {
+			lat[j] += th->lat[j];
+		}
+	}
+	elapsed = (ns() - start) / 1e9;
+
+	printf("%d sources, %d threads, %s %s, %.1fs\n", n_sources, n_threads,
+	       type == COAP_CON ? "CON" : "NON", cbor ? "SenML-CBOR" : "JSON", elapsed);
+	printf("sent %lu, answered %lu, %.0f msgs/s, lost %lu, sent twice %lu\n",
+	       (unsigned long)sent, (unsigned long)answered, answered / elapsed,
+	       (unsigned long)lost, (unsigned long)twice);
+	if (answered > 0) {
+		printf("latency p50 %uus, p99 %uus, p99.9 %uus, max %luus\n",
+		       percentile(lat, answered, 0.50), percentile(lat, answered, 0.99),
+		       percentile(lat, answered, 0.999), (unsigned long)(max_ns / 1000));
+	}
+	return answered > 0 ? 0 : 1;
+}
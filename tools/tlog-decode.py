@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""Text from a TH12's deferred binary log.
+
+With TLOG_CONF_ON the firmware logs a format id and the raw arguments
+instead of formatted text (see tlog.h). This reads the UART stream,
+looks the formats up in the tlog_fmts section of the firmware's ELF and
+prints what printf would have. Plain text between records is passed
+through.
+
+    stty -F /dev/ttyUSB1 115200 raw
+    tlog-decode.py coap-post-sleep_th12-lowpower.elf /dev/ttyUSB1
+    tlog-decode.py --time coap-post-sleep_th12-lowpower.elf capture.bin
+
+Use the ELF the node is running, the ids are offsets into its section.
+"""
+
+import argparse
+import ipaddress
+import re
+import struct
+import sys
+
+SYNC = 0xff
+HEADER = 6
+DROPPED = 0xffff
+SECTION = "tlog_fmts"
+CLOCK_SECOND = 100
+
+CONVERSION = re.compile(r"%([-+ #0]*)(\d*)(?:\.(\d+))?(hh|h|ll|l)?([diouxXcsIL%])")
+
+
+def tlog_section(path):
+    """The format section's bytes from an ELF32 or ELF64 file."""
+    with open(path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF":
+        raise ValueError("%s: not an ELF file" % path)
+    wide = elf[4] == 2
+    e = "<" if elf[5] == 1 else ">"
+    if wide:
+        shoff, = struct.unpack_from(e + "Q", elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(e + "HHH", elf, 0x3a)
+    else:
+        shoff, = struct.unpack_from(e + "I", elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(e + "HHH", elf, 0x2e)
+
+    def header(i):
+        at = shoff + i * shentsize
+        if wide:
+            name, type_, _, _, offset, size = struct.unpack_from(e + "IIQQQQ", elf, at)
+        else:
+            name, type_, _, _, offset, size = struct.unpack_from(e + "IIIIII", elf, at)
+        return name, type_, offset, size
+
+    _, _, stroff, _ = header(shstrndx)
+    for i in range(shnum):
+        name, type_, offset, size = header(i)
+        end = elf.index(b"\0", stroff + name)
+        if elf[stroff + name:end].decode() == SECTION:
+            if type_ == 8:    # SHT_NOBITS
+                raise ValueError("%s: %s section has no contents" % (path, SECTION))
+            return elf[offset:offset + size]
+    raise ValueError("%s: no %s section, was it built with TLOG_CONF_ON?" % (path, SECTION))
+
+
+def format_at(section, fid):
+    if fid >= len(section):
+        return None
+    end = section.find(b"\0", fid)
+    return section[fid:end if end >= 0 else len(section)].decode(errors="replace")
+
+
+def ip6(b):
+    return str(ipaddress.IPv6Address(bytes(b)))
+
+
+def render(fmt, args):
+    """printf of fmt with the raw args of a record."""
+    out = []
+    pos = 0
+    at = 0
+    for m in CONVERSION.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, prec, _, conv = m.groups()
+        spec = "%" + flags + width + ("." + prec if prec is not None else "")
+        if conv == "%":
+            out.append("%")
+            continue
+        if conv == "s":
+            if at >= len(args):
+                out.append("<?>")
+                continue
+            n = args[at] & 0x7f
+            text = args[at + 1:at + 1 + n].decode(errors="replace")
+            if args[at] & 0x80:
+                text += "..."
+            at += 1 + n
+            out.append((spec + "s") % text)
+        elif conv in "IL":
+            n = 16 if conv == "I" else 8
+            b = args[at:at + n]
+            at += n
+            if len(b) < n:
+                out.append("<?>")
+            else:
+                out.append(ip6(b) if conv == "I" else ":".join("%02x" % x for x in b))
+        else:
+            if at + 4 > len(args):
+                out.append("<?>")
+                continue
+            v, = struct.unpack_from("<I", args, at)
+            at += 4
+            if conv in "di":
+                v = v - (1 << 32) if v & 0x80000000 else v
+            if conv == "c":
+                out.append((spec + "c") % chr(v & 0xff))
+            else:
+                out.append((spec + ("d" if conv in "iu" else conv)) % v)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+class Decoder:
+    def __init__(self, section, out, time):
+        self.section = section
+        self.out = out
+        self.time = time
+        self.pending = bytearray()
+        self.clock = None
+        self.line_start = True
+
+    def emit(self, text, ticks=None):
+        if self.time and ticks is not None and self.line_start and text:
+            # 16 bit clock_time(), unwrapped against the previous record
+            if self.clock is None:
+                self.clock = ticks
+            else:
+                self.clock += (ticks - self.clock) & 0xffff
+            self.out.write("[%9.2f] " % (self.clock / CLOCK_SECOND))
+        self.out.write(text)
+        if text:
+            self.line_start = text[-1] in "\r\n"
+
+    def record(self, rec):
+        fid, ticks = struct.unpack_from("<HH", rec, 2)
+        args = rec[HEADER:]
+        if fid == DROPPED:
+            n, = struct.unpack_from("<I", args) if len(args) >= 4 else (0,)
+            self.emit("[tlog: %d records dropped]\n" % n, ticks)
+            return
+        fmt = format_at(self.section, fid)
+        if fmt is None:
+            self.emit("[tlog: unknown id 0x%04x, wrong ELF?]\n" % fid, ticks)
+            return
+        self.emit(render(fmt, args), ticks)
+
+    def feed(self, data):
+        self.pending += data
+        p = self.pending
+        i = 0
+        while i < len(p):
+            if p[i] != SYNC:
+                j = p.find(bytes([SYNC]), i)
+                j = len(p) if j < 0 else j
+                self.emit(p[i:j].decode(errors="replace"))
+                i = j
+                continue
+            if i + 2 > len(p) or i + 2 + p[i + 1] > len(p):
+                break
+            n = p[i + 1] + 2
+            if n < HEADER:
+                i += 1
+                continue
+            self.record(bytes(p[i:i + n]))
+            i += n
+        del p[:i]
+        self.out.flush()
+
+
+def main():
+    p = argparse.ArgumentParser(description="decode a TH12's tlog stream")
+    p.add_argument("elf", help="the firmware the node runs")
+    p.add_argument("input", nargs="?", default="-", help="tty or capture file, - for stdin")
+    p.add_argument("--time", action="store_true", help="prefix lines with the node's clock")
+    args = p.parse_args()
+
+    try:
+        section = tlog_section(args.elf)
+    except (OSError, ValueError) as e:
+        sys.exit(str(e))
+    d = Decoder(section, sys.stdout, args.time)
+    f = sys.stdin.buffer if args.input == "-" else open(args.input, "rb", buffering=0)
+    try:
+        while True:
+            data = f.read(256)
+            if not data:
+                break
+            d.feed(data)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()